@@ -8,11 +8,24 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
 #include <triangle.h>
 #include <dipole.h>
 
 namespace OpenMEEG {
 
+    /// Instruction sets used by the batched versions of the analytical kernels.
+    /// By default, the widest one supported by the processor is selected at runtime.
+
+    enum class InstructionSet { Scalar, AVX2, AVX512 };
+
+    OPENMEEG_EXPORT InstructionSet instruction_set();
+
+    /// Select the instruction set used by the batched kernels (this is limited to what the processor supports).
+    /// InstructionSet::Scalar selects the reference (non batched) implementation.
+
+    OPENMEEG_EXPORT void set_instruction_set(const InstructionSet iset);
+
     inline double integral_simplified_green(const Vect3& p0x, const double norm2p0x,
                                             const Vect3& p1x, const double norm2p1x,
                                             const Vect3& p1p0,const double norm2p1p0)
@@ -25,8 +38,12 @@ namespace OpenMEEG {
         return (std::isnormal(arg) && arg>0.0) ? log(arg) : fabs(log(norm2p1x/norm2p0x));
     }
 
+    class analyticSD;
+
     class OPENMEEG_EXPORT analyticS {
 
+        friend class analyticSD;
+
         void initialize(const Vect3& v0,const Vect3& v1,const Vect3& v2) {
             // All computations needed when the first triangle of integration is changed
 
@@ -85,6 +102,10 @@ namespace OpenMEEG {
             return ((dotprod(p0x,nu0)*g0+dotprod(p1x,nu1)*g1+dotprod(p2x,nu2)*g2)-alpha*x.solid_angle(p0,p1,p2));
         }
 
+        // Batched version of f for the npts points (x[i],y[i],z[i]) (structure of arrays layout).
+
+        void f(const std::size_t npts,const double* x,const double* y,const double* z,double* results) const;
+
     private:
 
         Vect3 p0, p1, p2; //!< vertices of the triangle
@@ -96,6 +117,8 @@ namespace OpenMEEG {
 
     class OPENMEEG_EXPORT analyticD3 {
 
+        friend class analyticSD;
+
         static Vect3 unit_vector(const Vect3& V) { return V/V.norm(); }
 
         Vect3 diff(const unsigned i,const unsigned j) const { return triangle.vertex(i)-triangle.vertex(j); }
@@ -150,6 +173,12 @@ namespace OpenMEEG {
             return (omega*Vect3(dotprod(Z1,N),dotprod(Z2,N),dotprod(Z3,N))+d*Vect3(dotprod(D2,S),dotprod(D3,S),dotprod(D1,S)))/N.norm2();
         }
 
+        // Batched version of f for the npts points (x[i],y[i],z[i]) (structure of arrays layout).
+        // The integrals wrt the three P1 functions are returned in results0, results1 and results2.
+
+        void f(const std::size_t npts,const double* x,const double* y,const double* z,
+               double* results0,double* results1,double* results2) const;
+
     private:
 
         const Triangle& triangle;
@@ -162,6 +191,26 @@ namespace OpenMEEG {
         const Vect3     U3;
     };
 
+    // Inner integrals of operators S and D over the same triangle, evaluated together: the solid angle and the logarithms
+    // associated with the edges of the triangle are common to both kernels and are computed only once.
+
+    class OPENMEEG_EXPORT analyticSD {
+    public:
+
+        analyticSD(const Triangle& T): analyS(T),analyD(T) { }
+
+        // Batched evaluation of analyticS::f (in resultsS) and of analyticD3::f (in resultsD0, resultsD1 and resultsD2)
+        // for the npts points (x[i],y[i],z[i]).
+
+        void f(const std::size_t npts,const double* x,const double* y,const double* z,
+               double* resultsS,double* resultsD0,double* resultsD1,double* resultsD2) const;
+
+    private:
+
+        const analyticS  analyS;
+        const analyticD3 analyD;
+    };
+
     class OPENMEEG_EXPORT analyticDipPotDer {
     public:
 
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <vector.h>
@@ -15,6 +16,7 @@
 #include <geometry.h>
 #include <sensors.h>
 #include <integrator.h>
+#include <hmatrix.h>
 
 #include <sparse_matrix.h>
 
@@ -27,8 +29,175 @@ namespace OpenMEEG {
     // It would be nice to define some constant integrators for the default values but swig does not like them.
 
     OPENMEEG_EXPORT SymMatrix HeadMat(const Geometry& geo,const Integrator& integrator=Integrator(3,0,0.005));
+
+    /// Incremental reassembly of the head matrix of geo, given the head matrix old_matrix of the geometry old_geo
+    /// (computed with the same integrator). Only the blocks of the mesh pairs involving a mesh that changed
+    /// (name, vertex positions or current barrier status) or whose conductivity coefficients changed are recomputed,
+    /// the other ones are copied (with the unknown indices remapped) from old_matrix.
+
+    OPENMEEG_EXPORT SymMatrix HeadMat(const Geometry& geo,const Geometry& old_geo,const SymMatrix& old_matrix,
+                                      const Integrator& integrator=Integrator(3,0,0.005));
+
+    /// Conductivity independent components of the head matrix, for conductivity sweeps.
+    /// Before deflation, HeadMat is the sum over the pairs of communicating meshes of their S, N and D blocks weighted
+    /// by coefficients depending on the conductivities (see Details::pair_coefficients). The blocks of each pair are
+    /// assembled once with unit coefficients and stored restricted to the unknowns of its two meshes (the conductivities
+    /// of the geometry are only used to locate the current barriers), after which the head matrix for any set of
+    /// conductivities with the same null conductivity domains is obtained by a linear combination.
+
+    class OPENMEEG_EXPORT HeadMatComponents {
+    public:
+
+        HeadMatComponents(const Geometry& geo,const Integrator& integrator=Integrator(3,0,0.005));
+        HeadMatComponents(const std::string& filename) { load(filename); }
+        HeadMatComponents(const char* filename): HeadMatComponents(std::string(filename)) { }
+
+        /// Save/load the components in/from the binary file filename.
+
+        void save(const std::string& filename) const;
+        void load(const std::string& filename);
+
+        /// \return the head matrix for the conductivities of geo (which must be the geometry used for the components).
+
+        SymMatrix head_matrix(const Geometry& geo) const;
+
+    private:
+
+        /// Unit blocks of a pair of meshes: the lines (resp. columns) are the unknowns of mesh1 (resp. mesh2), i.e. its
+        /// vertices then its triangles (unless it is a current barrier). The blocks of a mesh with itself are symmetric.
+
+        struct PairBlocks {
+            std::string name1;
+            std::string name2;
+            Matrix      blocks;
+            SymMatrix   diagonal_blocks;
+
+            bool diagonal() const { return name1==name2; }
+        };
+
+        unsigned                 size = 0;
+        std::vector<PairBlocks>  pairs;
+        std::vector<std::string> null_conductivity_domains;
+    };
+
+    inline SymMatrix HeadMat(const Geometry& geo,const HeadMatComponents& components) {
+        return components.head_matrix(geo);
+    }
+
+    /// Head matrix as an operator, whose blocks between distinct meshes are hierarchical matrices: far-field interactions
+    /// are approximated at the relative accuracy hparams.tolerance, and the matrix is never formed. The blocks of each
+    /// mesh with itself (deflated) are dense, the blocks N between distinct meshes are applied as C1'*S*C2 from the
+    /// compressed blocks S (C1 and C2 are the surface curls of the P1 functions, see BlocksBase::N). Only the products
+    /// with vectors and the entries of the blocks of a mesh with itself (those used by the preconditioners) are available,
+    /// so the head system is solved with an iterative solver (see linsolve). Meshes must not share vertices.
+    /// The operator only saves memory: applying N through S makes its products slower than those of the dense matrix.
+
+    class OPENMEEG_EXPORT CompressedHeadMat {
+    public:
+
+        CompressedHeadMat(const Geometry& geo,const HMatrixParameters& hparams,const Integrator& integrator=Integrator(3,0,0.005));
+        CompressedHeadMat(const std::string& filename) { load(filename); }
+        CompressedHeadMat(const char* filename): CompressedHeadMat(std::string(filename)) { }
+
+        Dimension nlin() const { return dimension; }
+        Dimension ncol() const { return dimension; }
+
+        /// \return the number of stored coefficients.
+
+        std::size_t size() const;
+
+        /// \return the ratio between the number of stored coefficients and the size of the (symmetric) head matrix.
+
+        double compression_ratio() const { return size()/(0.5*dimension*(dimension+1.0)); }
+
+        Vector operator*(const Vector& x) const;
+
+        /// \return the entry (i,j), which must belong to the block of a mesh with itself.
+
+        double operator()(const Index i,const Index j) const;
+
+        /// Save/load the operator in/from the binary file filename.
+
+        void save(const std::string& filename) const;
+        void load(const std::string& filename);
+
+        /// \return true if filename is a file written by save.
+
+        static bool is_compressed_file(const std::string& filename);
+
+    private:
+
+        /// Surface curls of the P1 functions of a mesh: the curl of the function of vertex (position in the mesh) on
+        /// triangle (position in the mesh) is curl.
+
+        struct Curl {
+            unsigned vertex;
+            unsigned triangle;
+            Vect3    curl;
+        };
+
+        /// Block of a mesh with itself, for its unknowns (vertices then triangles, unless it is a current barrier).
+
+        struct MeshBlocks {
+            std::vector<unsigned> unknowns;
+            SymMatrix             blocks;
+        };
+
+        /// Blocks of a pair of distinct meshes: S (triangles1 x triangles2, also used for N), D (triangles1 x vertices2)
+        /// and D* (triangles2 x vertices1), with their coefficients. S, D or D* are not applied when they involve the
+        /// triangles of a current barrier (which are not unknowns): D and D* are then empty.
+
+        struct PairBlocks {
+            std::vector<unsigned> triangles1;
+            std::vector<unsigned> vertices1;
+            std::vector<unsigned> triangles2;
+            std::vector<unsigned> vertices2;
+            std::vector<Curl>     curls1;
+            std::vector<Curl>     curls2;
+            double                coeffs[3];
+            bool                  S_applied;
+            HMatrix               S;
+            HMatrix               D;
+            HMatrix               Dstar;
+        };
+
+        static void   apply_curls(const std::vector<Curl>& curls,const Vector& x,Matrix& X);
+        static Vector apply_transposed_curls(const std::vector<Curl>& curls,const Matrix& Y,const unsigned nb_vertices);
+
+        Dimension                              dimension = 0;
+        std::vector<MeshBlocks>                meshes;
+        std::vector<PairBlocks>                pairs;
+        std::vector<std::pair<int,unsigned>>   locations; ///< Mesh block and position of each unknown.
+    };
+
     OPENMEEG_EXPORT Matrix SurfSourceMat(const Geometry& geo,Mesh& sources,const Integrator& integrator=Integrator(3,0,0.005));
 
+    /// Columns of the dipole source matrix (see DipSourceMat) computed by blocks of dipoles, e.g. to form gains without
+    /// storing the full source matrix (see compute_gain). The domains containing the dipoles (or the domain domain_name
+    /// if not empty) are determined once for all the dipoles (in parallel) at construction.
+
+    class OPENMEEG_EXPORT DipSourceMatBlocks {
+    public:
+
+        DipSourceMatBlocks(const Geometry& geo,const Matrix& dipoles,const Integrator& integrator,const std::string& domain_name);
+        DipSourceMatBlocks(const Geometry& geo,const Matrix& dipoles,const std::string& domain_name):
+            DipSourceMatBlocks(geo,dipoles,Integrator(3,10,0.001),domain_name)
+        { }
+
+        Dimension nb_dipoles() const { return dipoles.nlin(); }
+
+        /// \return the columns [first,first+n[ of the source matrix, i.e. those of the dipoles [first,first+n[.
+
+        Matrix operator()(const Index first,const Dimension n) const;
+
+    private:
+
+        const Geometry&            geo;
+        const Matrix               dipoles;
+        const Integrator           integrator;
+        std::vector<const Domain*> domains;
+    };
+
     OPENMEEG_EXPORT Matrix
     DipSourceMat(const Geometry& geo,const Matrix& dipoles,const Integrator& integrator,const std::string& domain_name);
     OPENMEEG_EXPORT Matrix
@@ -10,6 +10,7 @@
 #include <random>
 
 #include <vertex.h>
+#include <triangle.h>
 
 namespace OpenMEEG {
 
@@ -20,7 +21,12 @@ namespace OpenMEEG {
 
         BoundingBox() { }
 
-        void add(const Vertex& V) {
+        explicit BoundingBox(const Triangle& triangle) {
+            for (const auto& vertex : triangle)
+                add(*vertex);
+        }
+
+        void add(const Vect3& V) {
             xmin = std::min(xmin,V.x());
             ymin = std::min(ymin,V.y());
             zmin = std::min(zmin,V.z());
@@ -31,6 +37,11 @@ namespace OpenMEEG {
 
         void add(const Vertex* Vp) { add(*Vp); }
 
+        void add(const BoundingBox& box) {
+            add(box.min());
+            add(box.max());
+        }
+
         Vertex random_point() const {
             std::random_device rd;
             std::mt19937 gen(rd());
@@ -45,6 +56,39 @@ namespace OpenMEEG {
 
         Vertex center() const { return 0.5*(min()+max()); }
 
+        double diameter() const { return (max()-min()).norm(); }
+
+        /// \return the dimension (0, 1 or 2) along which the box is the largest.
+
+        unsigned largest_dimension() const {
+            const Vect3& extent = max()-min();
+            return (extent(0)>=extent(1)) ? ((extent(0)>=extent(2)) ? 0 : 2) : ((extent(1)>=extent(2)) ? 1 : 2);
+        }
+
+        /// \return the euclidean distance between a point and the box (0 if the point is inside).
+
+        double distance(const Vect3& p) const {
+            const double dx = std::max(0.0,std::max(xmin-p.x(),p.x()-xmax));
+            const double dy = std::max(0.0,std::max(ymin-p.y(),p.y()-ymax));
+            const double dz = std::max(0.0,std::max(zmin-p.z(),p.z()-zmax));
+            return sqrt(dx*dx+dy*dy+dz*dz);
+        }
+
+        /// \return true if the two boxes intersect (including when they only touch).
+
+        bool intersects(const BoundingBox& box) const {
+            return xmin<=box.xmax && box.xmin<=xmax && ymin<=box.ymax && box.ymin<=ymax && zmin<=box.zmax && box.zmin<=zmax;
+        }
+
+        /// \return the euclidean distance between two boxes (0 if they intersect).
+
+        double distance(const BoundingBox& box) const {
+            const double dx = std::max(0.0,std::max(xmin-box.xmax,box.xmin-xmax));
+            const double dy = std::max(0.0,std::max(ymin-box.ymax,box.ymin-ymax));
+            const double dz = std::max(0.0,std::max(zmin-box.zmax,box.zmin-zmax));
+            return sqrt(dx*dx+dy*dy+dz*dz);
+        }
+
     private:
 
         double xmin =  std::numeric_limits<double>::max();
@@ -7,62 +7,219 @@
 
 #pragma once
 
+#include <string>
+#include <sstream>
+#include <memory>
+#include <future>
+#include <algorithm>
+#include <cmath>
+
 #include "matrix.h"
 #include "sparse_matrix.h"
 #include "symmatrix.h"
+#include "bunch_kaufman.h"
+#include "column_blocks.h"
 #include "geometry.h"
 #include "progressbar.h"
 #include "assemble.h"
 
-#define USE_GMRES 0
-#if USE_GMRES
 #include "gmres.h"
-#endif
 
 namespace OpenMEEG {
 
-#if USE_GMRES
-
-    // Consider the GMRes solver for problems with dimension>15,000 (3,000 vertices per interface)
-
-    template <typename MATRIX>
-    Matrix linsolve(const SymMatrix& H,const MATRIX& S) {
-        Matrix res(S.nlin(),H.nlin());
-        Jacobi<SymMatrix> M(H);    // Jacobi preconditionner
-        ThreadException e;
-        #pragma omp parallel for
-        #ifdef OPENMP_UNSIGNED
-        for (unsigned i=0; i<S.nlin(); ++i) {
-        #else
-        for (int i=0; i<static_cast<int>(S.nlin()); ++i) {
-        #endif
-            e.Run([&](){
-                Vector vtemp(H.nlin());
-                GMRes(H,M,vtemp,S.getlin(i),1000,1e-7,H.nlin()); // max number of iteration=1000, and precision=1e-7 (1e-5 for faster resolution)
-                res.setlin(i,vtemp);
-                #pragma omp critical
-                PROGRESSBAR(i,S.nlin());
-            });
-        }
-        e.Rethrow();
-        return res
-    }
-#else
+    /// Solution of the head system for the lines of S (i.e. S*HeadMat^{-1}), given the factorization of HeadMat.
+    /// The solutions are computed as the columns of HeadMat^{-1}*S' and returned as a transposed view of them.
+
     template <typename SelectionMatrix>
-    Matrix linsolve(const SymMatrix& H,const SelectionMatrix& S) {
+    TransposedMatrix linsolve(const BunchKaufman& HeadMatFactorization,const SelectionMatrix& S) {
         Matrix res(S.transpose());
-        H.solveLin(res); // solving the system AX=B with LAPACK
-        return res.transpose();
+        HeadMatFactorization.solve(res);
+        return TransposedMatrix(res);
+    }
+
+    template <typename SelectionMatrix>
+    TransposedMatrix linsolve(const SymMatrix& H,const SelectionMatrix& S) {
+        return linsolve(BunchKaufman(H),S);
+    }
+
+    /// Sets of unknowns of the diagonal blocks of the block Jacobi preconditioners of the head matrix: the vertices and
+    /// triangles of each mesh (BLOCK_JACOBI) or only its triangles (S_BLOCKS). Shared vertices belong to the first mesh.
+
+    inline BlockJacobi::Blocks preconditioner_blocks(const Geometry& geo,const SolverParameters::Preconditioner preconditioner) {
+        BlockJacobi::Blocks blocks;
+        if (preconditioner!=SolverParameters::BLOCK_JACOBI && preconditioner!=SolverParameters::S_BLOCKS)
+            return blocks;
+
+        std::vector<bool> assigned(geo.nb_parameters(),false);
+        for (const auto& mesh : geo.meshes()) {
+            std::vector<unsigned> block;
+            if (preconditioner==SolverParameters::BLOCK_JACOBI)
+                for (const auto& vertex : mesh.vertices())
+                    if (!assigned[vertex->index()]) {
+                        assigned[vertex->index()] = true;
+                        block.push_back(vertex->index());
+                    }
+            if (!mesh.current_barrier())
+                for (const auto& triangle : mesh.triangles())
+                    block.push_back(triangle.index());
+            if (!block.empty())
+                blocks.push_back(block);
+        }
+        return blocks;
+    }
+
+    namespace Details {
+
+        // Iterative solution of the head system for the lines of S, for any operator H exposing the products with vectors
+        // and the entries of its preconditioner blocks.
+
+        template <typename Operator,typename SelectionMatrix>
+        TransposedMatrix iterative_linsolve(const Operator& H,const SelectionMatrix& S,const Geometry& geo,const SolverParameters& solver) {
+
+            const bool minres = solver.method==SolverParameters::MINRES;
+            const SolverParameters::Preconditioner preconditioner = solver.effective_preconditioner();
+            if (minres && preconditioner!=SolverParameters::NONE && preconditioner!=SolverParameters::JACOBI)
+                throw GenericError("MINRES requires a symmetric positive definite preconditioner (none or jacobi).");
+
+            const Matrix B(S.transpose());
+            if (preconditioner==SolverParameters::NONE) {
+                const IdentityPreconditioner P;
+                const Matrix& X = (minres) ? MinRes(H,P,B,solver) : GMRes(H,P,B,solver);
+                return TransposedMatrix(X);
+            }
+
+            const BlockJacobi P(H,preconditioner_blocks(geo,preconditioner),minres);
+            const Matrix& X = (minres) ? MinRes(H,P,B,solver) : GMRes(H,P,B,solver);
+            return TransposedMatrix(X);
+        }
+    }
+
+    /// Solution of the head system for the lines of S with the given solver (see SolverParameters).
+    /// The iterative solvers avoid the factorization of the head matrix, which is prohibitive for large meshes.
+
+    template <typename SelectionMatrix>
+    TransposedMatrix linsolve(const SymMatrix& H,const SelectionMatrix& S,const Geometry& geo,const SolverParameters& solver) {
+        if (solver.method==SolverParameters::DIRECT)
+            return linsolve(H,S);
+        return Details::iterative_linsolve(H,S,geo,solver);
+    }
+
+    /// Same as above for the compressed head matrix, which only provides the products with vectors: an iterative solver
+    /// is required.
+
+    template <typename SelectionMatrix>
+    TransposedMatrix linsolve(const CompressedHeadMat& H,const SelectionMatrix& S,const Geometry& geo,const SolverParameters& solver) {
+        if (solver.method==SolverParameters::DIRECT)
+            throw GenericError("The compressed head matrix requires an iterative solver (gmres or minres).");
+        return Details::iterative_linsolve(H,S,geo,solver);
+    }
+
+    /// \brief Out of core computation of the gain matrix HeadOperator*SourceMat (+Source2SensorsMat).
+    ///
+    /// HeadOperator is the product of the head to sensors matrix with the inverse of the head matrix (sensors x unknowns),
+    /// either as a Matrix or as the TransposedMatrix returned by linsolve.
+    /// SourceMat and Source2SensorsMat (if source2sensors_file is not empty) are read from raw binary files by blocks of
+    /// columns (i.e. of sources), and the corresponding columns of the gain matrix are appended to output_file. Only
+    /// HeadOperator and a few blocks are thus in memory: the size of the blocks is the largest one fitting in
+    /// memory_budget (in bytes). The next blocks are read and the previous gain block is written while the current
+    /// gain block is computed.
+
+    template <typename HeadOperatorMatrix>
+    void blockwise_gain(const HeadOperatorMatrix& HeadOperator,const std::string& source_file,const std::string& source2sensors_file,
+                               const std::string& output_file,const double memory_budget)
+    {
+        ColumnBlocksReader sources(source_file);
+        std::unique_ptr<ColumnBlocksReader> source2sensors;
+        if (!source2sensors_file.empty())
+            source2sensors = std::make_unique<ColumnBlocksReader>(source2sensors_file);
+
+        const Dimension nsensors = HeadOperator.nlin();
+        const Dimension nsources = sources.ncol();
+        if (sources.nlin()!=HeadOperator.ncol() ||
+            (source2sensors && (source2sensors->nlin()!=nsensors || source2sensors->ncol()!=nsources)))
+            throw GenericError("Incompatible sizes of the matrices of the gain computation.");
+
+        //  Two blocks of each input (the current one and the one being read) and of the gain (the current one and the one
+        //  being written) are in memory.
+
+        const double column_size = sizeof(double)*(2.0*sources.nlin()+((source2sensors) ? 4.0 : 2.0)*nsensors);
+        const double available   = memory_budget-sizeof(double)*static_cast<double>(HeadOperator.size());
+        if (available<column_size) {
+            std::ostringstream oss;
+            oss << "The memory budget is too small for the blockwise gain computation (at least "
+                << (memory_budget-available+column_size)/(1024*1024) << " MB are needed).";
+            throw GenericError(oss.str());
+        }
+        const Dimension block_size = std::max(1.0,std::min(static_cast<double>(nsources),std::floor(available/column_size)));
+
+        struct Blocks {
+            Matrix sources;
+            Matrix source2sensors;
+        };
+
+        const auto& read = [&](const Index first) {
+            const Dimension n = std::min(block_size,nsources-first);
+            Blocks blocks;
+            blocks.sources = sources.read(first,n);
+            if (source2sensors)
+                blocks.source2sensors = source2sensors->read(first,n);
+            return blocks;
+        };
+
+        ColumnBlocksWriter gain(output_file,nsensors,nsources);
+        std::future<Blocks> next = std::async(std::launch::async,read,0);
+        std::future<void>   written;
+        ProgressBar pb((nsources+block_size-1)/block_size);
+        for (Index first=0; first<nsources; first+=block_size,++pb) {
+            const Blocks& blocks = next.get();
+            if (first+block_size<nsources)
+                next = std::async(std::launch::async,read,first+block_size);
+
+            Matrix G = (source2sensors) ? blocks.source2sensors : Matrix(HeadOperator.nlin(),blocks.sources.ncol());
+            gemm(1.0,HeadOperator,blocks.sources,(source2sensors) ? 1.0 : 0.0,G);
+
+            if (written.valid())
+                written.get();
+            written = std::async(std::launch::async,[&gain,G]() { gain.write(G); });
+        }
+        if (written.valid())
+            written.get();
+    }
+
+    /// \brief Gain matrix adjoint_rows*DipSourceMat(geo,dipoles,""), computed without forming the source matrix.
+    ///
+    /// adjoint_rows is the product of the head to sensors matrix with the inverse of the head matrix (sensors x unknowns),
+    /// as returned by linsolve.
+    /// The columns of the source matrix are assembled (in parallel) for blocks of chunk dipoles, which are multiplied by
+    /// adjoint_rows (a single product per block) and discarded. The memory needed is thus O(sensors x unknowns + unknowns x chunk) instead of
+    /// O(unknowns x dipoles).
+
+    inline Matrix compute_gain(const Geometry& geo,const Matrix& dipoles,const TransposedMatrix& adjoint_rows,const unsigned chunk=256) {
+        const DipSourceMatBlocks sources(geo,dipoles,"");
+        const Dimension n_dipoles = sources.nb_dipoles();
+        Matrix gain(adjoint_rows.nlin(),n_dipoles);
+        for (Index first=0; first<n_dipoles; first+=chunk) {
+            const Dimension n = std::min(chunk,n_dipoles-first);
+            const Matrix& block = adjoint_rows*sources(first,n);
+            std::copy(block.data(),block.data()+block.size(),gain.data()+static_cast<std::size_t>(first)*gain.nlin());
+        }
+        return gain;
     }
-#endif
 
     class GainMEG: public Matrix {
     public:
         using Matrix::operator=;
         GainMEG (const Matrix& GainMat): Matrix(GainMat) {}
         GainMEG(const SymMatrix& HeadMatInv,const Matrix& SourceMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
-            Matrix(Source2MEGMat+(Head2MEGMat*HeadMatInv)*SourceMat)
-        { }
+            Matrix(Source2MEGMat,DEEP_COPY)
+        {
+            gemm(1.0,Head2MEGMat*HeadMatInv,SourceMat,1.0,*this);
+        }
+        GainMEG(const BunchKaufman& HeadMatFactorization,const Matrix& SourceMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
+            Matrix(Source2MEGMat,DEEP_COPY)
+        {
+            gemm(1.0,linsolve(HeadMatFactorization,Head2MEGMat),SourceMat,1.0,*this);
+        }
     };
 
     class GainEEG: public Matrix {
@@ -72,6 +229,9 @@ namespace OpenMEEG {
         GainEEG (const SymMatrix& HeadMatInv,const Matrix& SourceMat,const SparseMatrix& Head2EEGMat):
             Matrix((Head2EEGMat*HeadMatInv)*SourceMat)
         { }
+        GainEEG (const BunchKaufman& HeadMatFactorization,const Matrix& SourceMat,const SparseMatrix& Head2EEGMat):
+            Matrix(linsolve(HeadMatFactorization,Head2EEGMat)*SourceMat)
+        { }
     };
 
     class GainEEGadjoint: public Matrix {
@@ -79,12 +239,19 @@ namespace OpenMEEG {
 
         using Matrix::operator=;
 
-        GainEEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const SparseMatrix& Head2EEGMat): Matrix(Head2EEGMat.nlin(),dipoles.nlin()) {
-            const Matrix& Hinv = linsolve(HeadMat,Head2EEGMat);
-            ProgressBar pb(ncol());
-            for (unsigned i=0; i<ncol(); ++i,++pb)
-                setcol(i,Hinv*DipSourceMat(geo,dipoles.submat(i,1,0,dipoles.ncol()),"").getcol(0)); // TODO ugly
-        }
+        GainEEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const SparseMatrix& Head2EEGMat,
+                       const SolverParameters& solver=SolverParameters()):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMat,Head2EEGMat,geo,solver)))
+        { }
+
+        GainEEGadjoint(const Geometry& geo,const Matrix& dipoles,const BunchKaufman& HeadMatFactorization,const SparseMatrix& Head2EEGMat):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMatFactorization,Head2EEGMat)))
+        { }
+
+        GainEEGadjoint(const Geometry& geo,const Matrix& dipoles,const CompressedHeadMat& HeadMat,const SparseMatrix& Head2EEGMat,
+                       const SolverParameters& solver):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMat,Head2EEGMat,geo,solver)))
+        { }
     };
 
     class GainMEGadjoint: public Matrix {
@@ -92,35 +259,47 @@ namespace OpenMEEG {
 
         using Matrix::operator=;
 
-        GainMEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
-            Matrix(Head2MEGMat.nlin(),dipoles.nlin())
+        GainMEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat,
+                       const SolverParameters& solver=SolverParameters()):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMat,Head2MEGMat,geo,solver)))
+        {
+            *this += Source2MEGMat;
+        }
+
+        GainMEGadjoint(const Geometry& geo,const Matrix& dipoles,const BunchKaufman& HeadMatFactorization,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMatFactorization,Head2MEGMat)))
+        {
+            *this += Source2MEGMat;
+        }
+
+        GainMEGadjoint(const Geometry& geo,const Matrix& dipoles,const CompressedHeadMat& HeadMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat,
+                       const SolverParameters& solver):
+            Matrix(compute_gain(geo,dipoles,linsolve(HeadMat,Head2MEGMat,geo,solver)))
         {
-            const Matrix& Hinv = linsolve(HeadMat,Head2MEGMat);
-            ProgressBar pb(ncol());
-            for (unsigned i=0; i<ncol(); ++i,++pb)
-                setcol(i,Hinv*DipSourceMat(geo,dipoles.submat(i,1,0,dipoles.ncol()),"").getcol(0)+Source2MEGMat.getcol(i)); // TODO ugly
+            *this += Source2MEGMat;
         }
     };
 
     class GainEEGMEGadjoint {
     public:
-        GainEEGMEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const SparseMatrix& Head2EEGMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
+        GainEEGMEGadjoint(const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat,const SparseMatrix& Head2EEGMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat,
+                          const SolverParameters& solver=SolverParameters()):
             EEGleadfield(Head2EEGMat.nlin(),dipoles.nlin()),MEGleadfield(Head2MEGMat.nlin(),dipoles.nlin())
         {
-            Matrix RHS(Head2EEGMat.nlin()+Head2MEGMat.nlin(),HeadMat.nlin());
-            for (unsigned i=0; i<Head2EEGMat.nlin(); ++i)
-                RHS.setlin(i,Head2EEGMat.getlin(i));
-            for (unsigned i=0; i<Head2MEGMat.nlin(); ++i)
-                RHS.setlin(i+Head2EEGMat.nlin(),Head2MEGMat.getlin(i));
+            set(geo,dipoles,linsolve(HeadMat,RHS(Head2EEGMat,Head2MEGMat),geo,solver),Source2MEGMat);
+        }
 
-            const Matrix& Hinv = linsolve(HeadMat,RHS);
+        GainEEGMEGadjoint(const Geometry& geo,const Matrix& dipoles,const BunchKaufman& HeadMatFactorization,const SparseMatrix& Head2EEGMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat):
+            EEGleadfield(Head2EEGMat.nlin(),dipoles.nlin()),MEGleadfield(Head2MEGMat.nlin(),dipoles.nlin())
+        {
+            set(geo,dipoles,linsolve(HeadMatFactorization,RHS(Head2EEGMat,Head2MEGMat)),Source2MEGMat);
+        }
 
-            ProgressBar pb(dipoles.nlin());
-            for (unsigned i=0; i<dipoles.nlin(); ++i,++pb) {
-                const Vector& dsm = DipSourceMat(geo,dipoles.submat(i,1,0,dipoles.ncol()),"").getcol(0); // TODO ugly
-                EEGleadfield.setcol(i,Hinv.submat(0,Head2EEGMat.nlin(),0,HeadMat.nlin())*dsm);
-                MEGleadfield.setcol(i,Hinv.submat(Head2EEGMat.nlin(),Head2MEGMat.nlin(),0,HeadMat.nlin())*dsm+Source2MEGMat.getcol(i));
-            }
+        GainEEGMEGadjoint(const Geometry& geo,const Matrix& dipoles,const CompressedHeadMat& HeadMat,const SparseMatrix& Head2EEGMat,const Matrix& Head2MEGMat,const Matrix& Source2MEGMat,
+                          const SolverParameters& solver):
+            EEGleadfield(Head2EEGMat.nlin(),dipoles.nlin()),MEGleadfield(Head2MEGMat.nlin(),dipoles.nlin())
+        {
+            set(geo,dipoles,linsolve(HeadMat,RHS(Head2EEGMat,Head2MEGMat),geo,solver),Source2MEGMat);
         }
 
         void saveEEG( const std::string filename ) const { EEGleadfield.save(filename); }
@@ -130,6 +309,23 @@ namespace OpenMEEG {
 
     private:
 
+        static Matrix RHS(const SparseMatrix& Head2EEGMat,const Matrix& Head2MEGMat) {
+            Matrix rhs(Head2EEGMat.nlin()+Head2MEGMat.nlin(),Head2MEGMat.ncol());
+            for (unsigned i=0; i<Head2EEGMat.nlin(); ++i)
+                rhs.setlin(i,Head2EEGMat.getlin(i));
+            for (unsigned i=0; i<Head2MEGMat.nlin(); ++i)
+                rhs.setlin(i+Head2EEGMat.nlin(),Head2MEGMat.getlin(i));
+            return rhs;
+        }
+
+        void set(const Geometry& geo,const Matrix& dipoles,const TransposedMatrix& Hinv,const Matrix& Source2MEGMat) {
+            const unsigned nEEG = EEGleadfield.nlin();
+            const Matrix& gain = compute_gain(geo,dipoles,Hinv);
+            EEGleadfield = gain.submat(0,nEEG,0,gain.ncol());
+            MEGleadfield = gain.submat(nEEG,MEGleadfield.nlin(),0,gain.ncol());
+            MEGleadfield += Source2MEGMat;
+        }
+
         Matrix EEGleadfield;
         Matrix MEGleadfield;
     };
@@ -138,8 +334,15 @@ namespace OpenMEEG {
     public:
         using Matrix::operator=;
         GainInternalPot (const SymMatrix& HeadMatInv,const Matrix& SourceMat,const Matrix& Head2IPMat,const Matrix& Source2IPMat):
-            Matrix(Source2IPMat+(Head2IPMat*HeadMatInv)*SourceMat)
-        { }
+            Matrix(Source2IPMat,DEEP_COPY)
+        {
+            gemm(1.0,Head2IPMat*HeadMatInv,SourceMat,1.0,*this);
+        }
+        GainInternalPot (const BunchKaufman& HeadMatFactorization,const Matrix& SourceMat,const Matrix& Head2IPMat,const Matrix& Source2IPMat):
+            Matrix(Source2IPMat,DEEP_COPY)
+        {
+            gemm(1.0,linsolve(HeadMatFactorization,Head2IPMat),SourceMat,1.0,*this);
+        }
     };
 
     class GainEITInternalPot : public Matrix {
@@ -148,5 +351,8 @@ namespace OpenMEEG {
         GainEITInternalPot (const SymMatrix& HeadMatInv,const Matrix& SourceMat,const Matrix& Head2IPMat):
             Matrix((Head2IPMat*HeadMatInv)*SourceMat)
         { }
+        GainEITInternalPot (const BunchKaufman& HeadMatFactorization,const Matrix& SourceMat,const Matrix& Head2IPMat):
+            Matrix(linsolve(HeadMatFactorization,Head2IPMat)*SourceMat)
+        { }
     };
 }
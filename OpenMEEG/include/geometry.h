@@ -82,9 +82,9 @@ namespace OpenMEEG {
             return true;
         }
 
-        bool selfCheck()                    const; ///< \brief the geometry meshes intersect each other
-        bool check(const Mesh& m)           const; ///< \brief check if m intersect geometry meshes
-        bool check_inner(const Matrix& m)   const; ///< \brief check if dipoles are outside of geometry meshes
+        bool selfCheck(const bool report_all=false)           const; ///< \brief the geometry meshes intersect each other
+        bool check(const Mesh& m,const bool report_all=false) const; ///< \brief check if m intersect geometry meshes
+        bool check_inner(const Matrix& m)                     const; ///< \brief check if dipoles are outside of geometry meshes
 
         void check_geometry_is_nested();
 
@@ -157,6 +157,10 @@ namespace OpenMEEG {
             return result;
         }
 
+        /// \brief  Return the domains containing the points given by the lines of \param points (located in parallel).
+
+        DomainsReference domains(const Matrix& points) const;
+
         size_t nb_parameters() const { return num_params; } ///< \brief the total number of vertices + triangles
 
         /// Returns the outermost domain.
@@ -7,147 +7,465 @@
 
 #pragma once
 
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
 #include "vector.h"
 #include "matrix.h"
-#include "sparse_matrix.h"
+#include "symmatrix.h"
 
-#include <OpenMEEG_Export.h>
+#include <OMExceptions.H>
+#include <logger.h>
 
 namespace OpenMEEG {
 
-    // ===================================
-    // = Define a Jacobi preconditionner =
-    // ===================================
-    template <typename M>
-    class Jacobi {
+    /// Parameters of the solution of the head system (see linsolve in gain.h).
+    /// The direct solver factorizes the matrix. The iterative solvers only need products with the matrix: the right-hand
+    /// sides are solved by blocks of block_size, for which the products are computed together.
+
+    struct SolverParameters {
+
+        enum Method         { DIRECT, GMRES, MINRES };
+        enum Preconditioner { AUTO, NONE, JACOBI, BLOCK_JACOBI, S_BLOCKS };
+
+        SolverParameters(const Method meth=DIRECT,const Preconditioner precond=AUTO,const double tol=1e-8,
+                         const unsigned maxit=1000,const unsigned rst=100,const unsigned bsize=16):
+            method(meth),preconditioner(precond),tolerance(tol),max_iterations(maxit),restart(rst),block_size(bsize)
+        { }
+
+        /// \return the preconditioner used by the method: AUTO selects the block Jacobi preconditioner for GMRES and the
+        /// Jacobi one for MINRES (which requires a symmetric positive definite preconditioner).
+
+        Preconditioner effective_preconditioner() const {
+            if (preconditioner!=AUTO)
+                return preconditioner;
+            return (method==MINRES) ? JACOBI : BLOCK_JACOBI;
+        }
+
+        Method         method;
+        Preconditioner preconditioner; ///< Blocks are the unknowns of each mesh (BLOCK_JACOBI) or its triangles (S_BLOCKS).
+        double         tolerance;      ///< Relative residual at convergence (in the preconditioned norm for MINRES).
+        unsigned       max_iterations;
+        unsigned       restart;        ///< Dimension of the Krylov subspaces of GMRES.
+        unsigned       block_size;     ///< Number of right-hand sides solved together.
+    };
+
+    /// Products of an operator exposing a matrix-vector product with the columns of X.
+
+    template <typename Operator>
+    Matrix block_product(const Operator& A,const Matrix& X) {
+        Matrix Y(A.nlin(),X.ncol());
+        #pragma omp parallel for
+        for (int j=0; j<static_cast<int>(X.ncol()); ++j)
+            Y.setcol(j,A*X.getcol(j));
+        return Y;
+    }
+
+    class IdentityPreconditioner {
+    public:
+
+        Matrix operator()(const Matrix& R) const { return R; }
+    };
+
+    /// Block Jacobi preconditioner: the inverses of the diagonal blocks of A associated with the given sets of unknowns,
+    /// the other unknowns being scaled by the inverse of their diagonal entry (Jacobi preconditioner when there are no
+    /// blocks). Sets of unknowns must be disjoint. With absolute_diagonal, the diagonal entries are replaced by their
+    /// absolute values (a symmetric positive definite preconditioner is needed by MINRES).
+
+    class BlockJacobi {
     public:
-        Jacobi (const M& m): J(m.nlin()) { 
-            for ( unsigned i = 0; i < m.nlin(); ++i) {
-                J(i, i) = 1.0 / m(i,i);
+
+        typedef std::vector<std::vector<unsigned>> Blocks;
+
+        template <typename Operator>
+        BlockJacobi(const Operator& A,const Blocks& blks=Blocks(),const bool absolute_diagonal=false):
+            blocks(blks),inverses(blks.size()),diagonal(A.nlin())
+        {
+            for (unsigned i=0; i<A.nlin(); ++i)
+                diagonal(i) = 1.0/((absolute_diagonal) ? std::abs(A(i,i)) : A(i,i));
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int b=0; b<static_cast<int>(blocks.size()); ++b) {
+                const std::vector<unsigned>& indices = blocks[b];
+                SymMatrix block(indices.size());
+                for (unsigned j=0; j<indices.size(); ++j)
+                    for (unsigned i=0; i<=j; ++i)
+                        block(i,j) = A(indices[i],indices[j]);
+                inverses[b] = Matrix(block.inverse());
             }
         }
 
-        Vector operator()(const Vector& g) const {
-            return J*g;
+        Matrix operator()(const Matrix& R) const {
+            Matrix Z(R.nlin(),R.ncol());
+            for (unsigned j=0; j<R.ncol(); ++j)
+                for (unsigned i=0; i<R.nlin(); ++i)
+                    Z(i,j) = diagonal(i)*R(i,j);
+
+            for (unsigned b=0; b<blocks.size(); ++b) {
+                const std::vector<unsigned>& indices = blocks[b];
+                Matrix RB(indices.size(),R.ncol());
+                for (unsigned j=0; j<R.ncol(); ++j)
+                    for (unsigned i=0; i<indices.size(); ++i)
+                        RB(i,j) = R(indices[i],j);
+                const Matrix& ZB = inverses[b]*RB;
+                for (unsigned j=0; j<R.ncol(); ++j)
+                    for (unsigned i=0; i<indices.size(); ++i)
+                        Z(indices[i],j) = ZB(i,j);
+            }
+            return Z;
         }
-    
-        ~Jacobi () {};
+
     private:
-        SparseMatrix J; // diagonal
+
+        const Blocks        blocks;
+        std::vector<Matrix> inverses;
+        Vector              diagonal;
     };
 
-    // =========================
-    // = Define a GMRes solver =
-    // =========================
-
-    void GeneratePlaneRotation(double &dx, double &dy, double &cs, double &sn)
-    {
-        if (dy == 0.0) {
-            cs = 1.0;
-            sn = 0.0;
-        } else if (std::abs(dy) > std::abs(dx)) {
-            double temp = dx / dy;
-            sn = 1.0 / sqrt( 1.0 + temp*temp );
-            cs = temp * sn;
-        } else {
-            double temp = dy / dx;
-            cs = 1.0 / sqrt( 1.0 + temp*temp );
-            sn = temp * cs;
+    namespace Details {
+
+        inline void GeneratePlaneRotation(const double dx,const double dy,double& cs,double& sn) {
+            if (dy==0.0) {
+                cs = 1.0;
+                sn = 0.0;
+            } else if (std::abs(dy)>std::abs(dx)) {
+                const double temp = dx/dy;
+                sn = 1.0/sqrt(1.0+temp*temp);
+                cs = temp*sn;
+            } else {
+                const double temp = dy/dx;
+                cs = 1.0/sqrt(1.0+temp*temp);
+                sn = temp*cs;
+            }
+        }
+
+        inline void ApplyPlaneRotation(double& dx,double& dy,const double cs,const double sn) {
+            const double temp = cs*dx+sn*dy;
+            dy = -sn*dx+cs*dy;
+            dx = temp;
         }
-    }
 
-    void ApplyPlaneRotation(double &dx, double &dy, double &cs, double &sn)
-    {
-        double temp  =  cs * dx + sn * dy;
-        dy = -sn * dx + cs * dy;
-        dx = temp;
+        inline void axpy(const double a,const Vector& x,Vector& y) {
+            for (unsigned i=0; i<y.size(); ++i)
+                y(i) += a*x(i);
+        }
+
+        inline Matrix columns(const std::vector<const Vector*>& vectors) {
+            Matrix M(vectors.front()->size(),vectors.size());
+            for (unsigned j=0; j<vectors.size(); ++j)
+                M.setcol(j,*vectors[j]);
+            return M;
+        }
+
+        inline void report_convergence(const char* name,const unsigned iterations,const double residual,const double tolerance) {
+            if (residual>tolerance) {
+                log_stream(WARNING) << name << " did not converge in " << iterations << " iterations (relative residual "
+                                    << residual << ")." << std::endl;
+            } else {
+                log_stream(INFORMATION) << name << " converged in " << iterations << " iterations (relative residual "
+                                        << residual << ")." << std::endl;
+            }
+        }
     }
 
-    template<class T>
-    void Update(Vector &x, int k, T &h, Vector &s, Vector v[])
-    {
-            Vector y(s);
-            // Backsolve:  
-            for (int i = k; i >= 0; i--) {
-                    y(i) /= h(i,i);
-                    for (int j = i - 1; j >= 0; j--)
-                            y(j) -= h(j,i) * y(i);
+    /// Solves A X = B with the restarted GMRES method, right preconditioned by P (which approximates the inverse of A).
+    /// The columns of B are solved by blocks of parameters.block_size: each column has its own Krylov subspace, but the
+    /// products with A and P are computed for all the columns of the block at once.
+    /// Based on http://www.netlib.org/templates/cpp/gmres.h
+
+    template <typename Operator,typename Preconditioner>
+    Matrix GMRes(const Operator& A,const Preconditioner& P,const Matrix& B,const SolverParameters& parameters) {
+
+        const unsigned n = B.nlin();
+        const unsigned m = std::max(1U,std::min(parameters.restart,n));
+        const double   tol = parameters.tolerance;
+
+        Matrix X(n,B.ncol());
+        X.set(0.0);
+
+        unsigned max_iterations = 0;
+        double   max_residual   = 0.0;
+
+        for (unsigned first=0; first<B.ncol(); first+=parameters.block_size) {
+
+            const unsigned nb = std::min(parameters.block_size,B.ncol()-first);
+
+            struct System {
+                Vector              x;
+                Vector              r;
+                double              normb;
+                double              residual;
+                std::vector<Vector> V;
+                Matrix              H;
+                Vector              s, cs, sn;
+                unsigned            steps;
+                bool                active;
+            };
+
+            std::vector<System> systems(nb);
+            std::vector<unsigned> remaining;
+            for (unsigned c=0; c<nb; ++c) {
+                System& sys = systems[c];
+                sys.x = Vector(n);
+                sys.x.set(0.0);
+                sys.r = B.getcol(first+c);
+                sys.normb = sys.r.norm();
+                sys.residual = 0.0;
+                if (sys.normb!=0.0) {
+                    sys.residual = 1.0;
+                    sys.V.resize(m+1);
+                    sys.H = Matrix(m+1,m);
+                    sys.s  = Vector(m+1);
+                    sys.cs = Vector(m+1);
+                    sys.sn = Vector(m+1);
+                    remaining.push_back(c);
+                }
             }
-            for (int j = 0; j <= k; j++) {
-                    x += v[j] * y(j);
+
+            unsigned iterations = 0;
+            while (!remaining.empty() && iterations<parameters.max_iterations) {
+
+                //  Start a cycle for all the remaining systems.
+
+                for (const unsigned c : remaining) {
+                    System& sys = systems[c];
+                    const double beta = sys.r.norm();
+                    sys.V[0] = sys.r/beta;
+                    sys.s.set(0.0);
+                    sys.s(0) = beta;
+                    sys.steps  = 0;
+                    sys.active = true;
+                }
+
+                std::vector<unsigned> active = remaining;
+                for (unsigned i=0; i<m && !active.empty() && iterations<parameters.max_iterations; ++i,++iterations) {
+
+                    std::vector<const Vector*> vectors;
+                    for (const unsigned c : active)
+                        vectors.push_back(&systems[c].V[i]);
+                    const Matrix& W = block_product(A,P(Details::columns(vectors)));
+
+                    #pragma omp parallel for
+                    for (int k=0; k<static_cast<int>(active.size()); ++k) {
+                        System& sys = systems[active[k]];
+                        Vector w = W.getcol(k);
+
+                        //  Arnoldi step (modified Gram-Schmidt).
+
+                        for (unsigned l=0; l<=i; ++l) {
+                            sys.H(l,i) = w*sys.V[l];
+                            Details::axpy(-sys.H(l,i),sys.V[l],w);
+                        }
+                        sys.H(i+1,i) = w.norm();
+
+                        for (unsigned l=0; l<i; ++l)
+                            Details::ApplyPlaneRotation(sys.H(l,i),sys.H(l+1,i),sys.cs(l),sys.sn(l));
+
+                        Details::GeneratePlaneRotation(sys.H(i,i),sys.H(i+1,i),sys.cs(i),sys.sn(i));
+                        const bool breakdown = sys.H(i+1,i)==0.0;
+                        if (!breakdown)
+                            sys.V[i+1] = w/sys.H(i+1,i);
+                        Details::ApplyPlaneRotation(sys.H(i,i),sys.H(i+1,i),sys.cs(i),sys.sn(i));
+                        Details::ApplyPlaneRotation(sys.s(i),sys.s(i+1),sys.cs(i),sys.sn(i));
+
+                        sys.steps = i+1;
+                        if (breakdown || std::abs(sys.s(i+1))/sys.normb<tol)
+                            sys.active = false;
+                    }
+
+                    active.erase(std::remove_if(active.begin(),active.end(),[&](const unsigned c) { return !systems[c].active; }),active.end());
+                }
+
+                //  End of the cycle: update the solutions (x += P V y with H y = s) and compute the true residuals.
+
+                Matrix U(n,remaining.size());
+                for (unsigned k=0; k<remaining.size(); ++k) {
+                    System& sys = systems[remaining[k]];
+                    Vector y(sys.steps);
+                    for (int i=sys.steps-1; i>=0; --i) {
+                        y(i) = sys.s(i);
+                        for (unsigned j=i+1; j<sys.steps; ++j)
+                            y(i) -= sys.H(i,j)*y(j);
+                        y(i) /= sys.H(i,i);
+                    }
+                    Vector u(n);
+                    u.set(0.0);
+                    for (unsigned j=0; j<sys.steps; ++j)
+                        Details::axpy(y(j),sys.V[j],u);
+                    U.setcol(k,u);
+                }
+
+                const Matrix& Z = P(U);
+                for (unsigned k=0; k<remaining.size(); ++k)
+                    systems[remaining[k]].x += Z.getcol(k);
+
+                std::vector<const Vector*> solutions;
+                for (const unsigned c : remaining)
+                    solutions.push_back(&systems[c].x);
+                const Matrix& AX = block_product(A,Details::columns(solutions));
+
+                std::vector<unsigned> unconverged;
+                for (unsigned k=0; k<remaining.size(); ++k) {
+                    System& sys = systems[remaining[k]];
+                    sys.r = B.getcol(first+remaining[k])-AX.getcol(k);
+                    sys.residual = sys.r.norm()/sys.normb;
+                    if (sys.residual>=tol)
+                        unconverged.push_back(remaining[k]);
+                }
+                remaining = unconverged;
+            }
+
+            for (unsigned c=0; c<nb; ++c) {
+                X.setcol(first+c,systems[c].x);
+                max_residual = std::max(max_residual,systems[c].residual);
             }
+            max_iterations = std::max(max_iterations,iterations);
+        }
+
+        Details::report_convergence("GMRES",max_iterations,max_residual,tol);
+        return X;
     }
 
-    // code taken from http://www.netlib.org/templates/cpp/gmres.h and modified
-    template<class T,class P> // T should be a linear operator, and P a preconditionner
-    unsigned GMRes(const T& A, const P& M, Vector &x, const Vector& b, int max_iter, double tol,unsigned m) {
+    /// Solves A X = B for a symmetric A with the MINRES method, preconditioned by a symmetric positive definite P.
+    /// The columns of B are solved by blocks of parameters.block_size, the products with A and P being computed for all
+    /// the columns of the block at once. Convergence is measured by the preconditioned residual.
+    /// Based on the algorithm of C. C. Paige and M. A. Saunders, "Solution of sparse indefinite systems of linear equations".
 
-        // m is the size of the Krylov subspace, if m<A.nlin(), it is a restarted GMRes (for saving memory)
-        Matrix H(m+1,m);
-        x.set(0.0);
+    template <typename Operator,typename Preconditioner>
+    Matrix MinRes(const Operator& A,const Preconditioner& P,const Matrix& B,const SolverParameters& parameters) {
 
-        double resid;
-        int i, j = 1, k;
-        Vector s(m+1), cs(m+1), sn(m+1), w;
+        const unsigned n = B.nlin();
+        const double   tol = parameters.tolerance;
 
-        double normb = (M(b)).norm();//(M*b).norm()
-        Vector r = M(b-A*x);//M.solve(b - A * x);
-        double beta = r.norm();
+        Matrix X(n,B.ncol());
+        X.set(0.0);
 
-        if (normb == 0.0)
-            normb = 1;
+        unsigned max_iterations = 0;
+        double   max_residual   = 0.0;
 
-        if ((resid = r.norm() / normb) <= tol) {
-            tol = resid;
-            max_iter = 0;
-            return 0;
-        }
-        Vector *v = new Vector[m+1];
-
-        while (j <= max_iter) {
-            v[0] = r * (1.0 / beta);
-            s.set(0.0);
-            s(0) = beta;
-
-            for (i = 0; i < m && j <= max_iter; i++, j++) {
-                w = M(A*v[i]); //M.solve(A * v[i]);
-                for (k = 0; k <= i; k++) {
-                    H(k, i) = w*v[k];
-                    w -= H(k, i) * v[k];
+        for (unsigned first=0; first<B.ncol(); first+=parameters.block_size) {
+
+            const unsigned nb = std::min(parameters.block_size,B.ncol()-first);
+
+            struct System {
+                Vector x, r1, r2, y, w, w2;
+                double beta1, beta, oldb, alfa, dbar, epsln, phibar, cs, sn;
+                double residual;
+            };
+
+            std::vector<System> systems(nb);
+            std::vector<unsigned> active;
+            std::vector<const Vector*> vectors;
+            for (unsigned c=0; c<nb; ++c) {
+                System& sys = systems[c];
+                sys.x = Vector(n);
+                sys.x.set(0.0);
+                sys.r1 = B.getcol(first+c);
+                vectors.push_back(&sys.r1);
+            }
+
+            const Matrix& Y = P(Details::columns(vectors));
+            for (unsigned c=0; c<nb; ++c) {
+                System& sys = systems[c];
+                sys.y  = Y.getcol(c);
+                sys.r2 = Vector(sys.r1,DEEP_COPY);
+                sys.beta1 = sqrt(sys.r1*sys.y);
+                sys.beta   = sys.beta1;
+                sys.oldb   = 0.0;
+                sys.dbar   = 0.0;
+                sys.epsln  = 0.0;
+                sys.phibar = sys.beta1;
+                sys.cs     = -1.0;
+                sys.sn     = 0.0;
+                sys.residual = 0.0;
+                sys.w  = Vector(n);
+                sys.w2 = Vector(n);
+                sys.w.set(0.0);
+                sys.w2.set(0.0);
+                if (sys.beta1!=0.0) {
+                    sys.residual = 1.0;
+                    active.push_back(c);
                 }
-                H(i+1, i) = w.norm();
-                v[i+1] = (w / H(i+1, i));
-
-                for (k = 0; k < i; k++)
-                    ApplyPlaneRotation(H(k,i), H(k+1,i), cs(k), sn(k));
-
-                GeneratePlaneRotation(H(i,i), H(i+1,i), cs(i), sn(i));
-                ApplyPlaneRotation(H(i,i), H(i+1,i), cs(i), sn(i));
-                ApplyPlaneRotation(s(i), s(i+1), cs(i), sn(i));
-
-                if ((resid = std::abs(s(i+1)) / normb) < tol) {
-                    Update(x, i, H, s, v);
-                    tol = resid;
-                    max_iter = j;
-                    // std::cout<<max_iter <<std::endl;
-                    delete [] v;
-                    return 0;
+            }
+
+            unsigned iterations = 0;
+            for (; !active.empty() && iterations<parameters.max_iterations; ++iterations) {
+
+                std::vector<Vector> V(active.size());
+                for (unsigned k=0; k<active.size(); ++k) {
+                    const System& sys = systems[active[k]];
+                    V[k] = sys.y/sys.beta;
                 }
+
+                std::vector<const Vector*> lanczos;
+                for (const auto& v : V)
+                    lanczos.push_back(&v);
+                const Matrix& AV = block_product(A,Details::columns(lanczos));
+
+                //  Lanczos step.
+
+                std::vector<const Vector*> residuals;
+                for (unsigned k=0; k<active.size(); ++k) {
+                    System& sys = systems[active[k]];
+                    Vector y = AV.getcol(k);
+                    if (iterations>0)
+                        Details::axpy(-sys.beta/sys.oldb,sys.r1,y);
+                    sys.alfa = V[k]*y;
+                    Details::axpy(-sys.alfa/sys.beta,sys.r2,y);
+                    sys.r1 = sys.r2;
+                    sys.r2 = y;
+                    residuals.push_back(&sys.r2);
+                }
+
+                const Matrix& PR = P(Details::columns(residuals));
+
+                //  Update of the QR factorization of the tridiagonal matrix and of the solution.
+
+                #pragma omp parallel for
+                for (int k=0; k<static_cast<int>(active.size()); ++k) {
+                    System& sys = systems[active[k]];
+                    const double alfa = sys.alfa;
+                    sys.y    = PR.getcol(k);
+                    sys.oldb = sys.beta;
+                    sys.beta = sqrt(sys.r2*sys.y);
+
+                    const double oldeps = sys.epsln;
+                    const double delta  = sys.cs*sys.dbar+sys.sn*alfa;
+                    const double gbar   = sys.sn*sys.dbar-sys.cs*alfa;
+                    sys.epsln = sys.sn*sys.beta;
+                    sys.dbar  = -sys.cs*sys.beta;
+
+                    const double gamma = std::max(std::hypot(gbar,sys.beta),std::numeric_limits<double>::epsilon());
+                    sys.cs = gbar/gamma;
+                    sys.sn = sys.beta/gamma;
+                    const double phi = sys.cs*sys.phibar;
+                    sys.phibar *= sys.sn;
+
+                    Vector w(V[k],DEEP_COPY);
+                    Details::axpy(-oldeps,sys.w2,w);
+                    Details::axpy(-delta,sys.w,w);
+                    w /= gamma;
+                    sys.w2 = sys.w;
+                    sys.w  = w;
+                    Details::axpy(phi,sys.w,sys.x);
+
+                    sys.residual = sys.phibar/sys.beta1;
+                }
+
+                active.erase(std::remove_if(active.begin(),active.end(),
+                                            [&](const unsigned c) { return systems[c].residual<tol || systems[c].beta==0.0; }),active.end());
             }
-            Update(x, i - 1, H, s, v);
-            r = M(b-A*x);//M.solve(b - A * x);
-            beta = r.norm();
-            if ((resid = beta / normb) < tol) {
-                tol = resid;
-                max_iter = j;
-                // std::cout<<max_iter <<std::endl;
-                delete [] v;
-                return 0;
+
+            for (unsigned c=0; c<nb; ++c) {
+                X.setcol(first+c,systems[c].x);
+                max_residual = std::max(max_residual,systems[c].residual);
             }
+            max_iterations = std::max(max_iterations,iterations);
         }
 
-        tol = resid;
-        delete [] v;
-        return 1;
+        Details::report_convergence("MINRES",max_iterations,max_residual,tol);
+        return X;
     }
 }
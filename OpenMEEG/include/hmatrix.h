@@ -0,0 +1,520 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#pragma once
+
+/// \file
+/// \brief Hierarchical matrices: cluster trees and adaptive cross approximation of far-field blocks.
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include <vector.h>
+#include <matrix.h>
+#include <boundingbox.h>
+#include <OMExceptions.H>
+
+namespace OpenMEEG {
+
+    namespace Details {
+
+        // Binary (de)serialization of a list of indices (as 32 bits integers). The indices read must be lower than bound.
+        // They are read by chunks, so that a corrupted size does not allocate more memory than the stream provides.
+
+        inline void write_indices(std::ostream& os,const std::vector<unsigned>& indices) {
+            const std::uint64_t n = indices.size();
+            const std::vector<std::uint32_t> values(indices.begin(),indices.end());
+            os.write(reinterpret_cast<const char*>(&n),sizeof(n));
+            os.write(reinterpret_cast<const char*>(values.data()),n*sizeof(std::uint32_t));
+        }
+
+        inline std::vector<unsigned> read_indices(std::istream& is,const unsigned bound) {
+            std::uint64_t n = 0;
+            is.read(reinterpret_cast<char*>(&n),sizeof(n));
+            std::vector<unsigned> indices;
+            std::uint32_t chunk[1024];
+            while (is && indices.size()<n) {
+                const unsigned nb = std::min<std::uint64_t>(n-indices.size(),1024);
+                is.read(reinterpret_cast<char*>(chunk),nb*sizeof(std::uint32_t));
+                if (!is || std::any_of(chunk,chunk+nb,[bound](const std::uint32_t i) { return i>=bound; }))
+                    throw BadData(is,"indices");
+                indices.insert(indices.end(),chunk,chunk+nb);
+            }
+            if (!is)
+                throw BadData(is,"indices");
+            return indices;
+        }
+    }
+
+    /// Parameters of the hierarchical compression of interaction blocks between two distinct meshes.
+    /// A zero tolerance (the default) disables the compression: blocks are then computed densely.
+
+    struct HMatrixParameters {
+
+        HMatrixParameters(const double tol=0.0,const double admissibility=2.0,const unsigned lsize=32):
+            tolerance(tol),eta(admissibility),leaf_size(lsize)
+        { }
+
+        bool enabled() const { return tolerance>0.0; }
+
+        double   tolerance; ///< Relative accuracy of the adaptive cross approximation of admissible blocks.
+        double   eta;       ///< A pair of clusters is admissible if min(diam1,diam2)<=eta*dist(cluster1,cluster2).
+        unsigned leaf_size; ///< Clusters with at most leaf_size elements are not split further.
+    };
+
+    /// Binary space partition of a set of elements (triangles or vertices) described by the bounding boxes of their supports.
+    /// Each node covers a contiguous range of the permutation of the element indices.
+
+    class ClusterTree {
+    public:
+
+        struct Node {
+            BoundingBox box;
+            unsigned    begin;
+            unsigned    end;
+            int         children[2] = { -1, -1 };
+
+            bool     leaf() const { return children[0]<0; }
+            unsigned size() const { return end-begin; }
+        };
+
+        ClusterTree(const std::vector<BoundingBox>& supports,const unsigned leaf_size): boxes(supports),perm(supports.size()) {
+            std::iota(perm.begin(),perm.end(),0);
+            if (supports.size()!=0)
+                build(0,supports.size(),std::max(leaf_size,1U));
+        }
+
+        unsigned size() const { return perm.size(); }
+
+        const Node& node(const unsigned i) const { return nodes[i]; }
+        const Node& root()                 const { return nodes.front(); }
+
+        /// \return the index of the element at position i in the tree ordering.
+
+        unsigned element(const unsigned i) const { return perm[i]; }
+
+    private:
+
+        unsigned build(const unsigned begin,const unsigned end,const unsigned leaf_size) {
+            const unsigned id = nodes.size();
+            nodes.push_back(Node());
+            nodes[id].begin = begin;
+            nodes[id].end   = end;
+
+            BoundingBox box;
+            BoundingBox centers;
+            for (unsigned i=begin; i<end; ++i) {
+                box.add(boxes[perm[i]]);
+                centers.add(boxes[perm[i]].center());
+            }
+            nodes[id].box = box;
+
+            if (end-begin<=leaf_size)
+                return id;
+
+            // Split along the largest extent of the element centers.
+
+            const Vect3& extent = centers.max()-centers.min();
+            const unsigned axis = (extent.x()>=extent.y()) ? ((extent.x()>=extent.z()) ? 0 : 2) : ((extent.y()>=extent.z()) ? 1 : 2);
+            const unsigned middle = begin+(end-begin)/2;
+            std::nth_element(perm.begin()+begin,perm.begin()+middle,perm.begin()+end,
+                             [this,axis](const unsigned i,const unsigned j) { return boxes[i].center()(axis)<boxes[j].center()(axis); });
+
+            const unsigned child0 = build(begin,middle,leaf_size);
+            const unsigned child1 = build(middle,end,leaf_size);
+            nodes[id].children[0] = child0;
+            nodes[id].children[1] = child1;
+            return id;
+        }
+
+        std::vector<BoundingBox> boxes;
+        std::vector<unsigned>    perm;
+        std::vector<Node>        nodes;
+    };
+
+    /// Hierarchical matrix approximating a matrix given by a function of its (row,column) element indices.
+    /// Admissible (far-field) blocks are stored as low rank products U.V^T computed by adaptive cross approximation
+    /// (partial pivoting), the other ones are stored densely. Only the products with vectors are available: the matrix is
+    /// never expanded.
+
+    class HMatrix {
+    public:
+
+        /// Sets values (rows.size() x cols.size()) to the entries (rows[i],cols[j]) of the matrix. Entries are requested by
+        /// whole rows, columns or dense blocks so that they can be evaluated by batches (see the analytical kernels).
+
+        typedef std::function<void(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values)> Entries;
+
+        HMatrix() { }
+
+        HMatrix(const ClusterTree& rtree,const ClusterTree& ctree,const Entries& entries,const HMatrixParameters& parameters):
+            row_elements(rtree.size()),col_elements(ctree.size()),tolerance(parameters.tolerance),eta(parameters.eta)
+        {
+            for (unsigned i=0; i<rtree.size(); ++i)
+                row_elements[i] = rtree.element(i);
+            for (unsigned j=0; j<ctree.size(); ++j)
+                col_elements[j] = ctree.element(j);
+
+            if (rtree.size()==0 || ctree.size()==0)
+                return;
+
+            partition(rtree,ctree,0,0);
+
+            ThreadException e;
+            #pragma omp parallel for schedule(dynamic)
+            for (int i=0; i<static_cast<int>(blocks.size()); ++i)
+                e.Run([&](){
+                    Block& block = blocks[i];
+                    if (!block.low_rank || !cross_approximation(block,entries))
+                        dense(block,entries);
+                });
+            e.Rethrow();
+        }
+
+        unsigned nlin() const { return row_elements.size(); }
+        unsigned ncol() const { return col_elements.size(); }
+
+        /// \return the number of stored coefficients.
+
+        std::size_t size() const {
+            std::size_t res = 0;
+            for (const auto& block : blocks)
+                res += block.U.size()+block.V.size();
+            return res;
+        }
+
+        double compression_ratio() const { return static_cast<double>(size())/(static_cast<double>(nlin())*ncol()); }
+
+        /// Products Y=H*X and Z=H'*W, computed with a single traversal of the blocks (for all the columns of X and W).
+        /// The blocks are applied concurrently, each thread accumulating its contributions before they are summed.
+
+        void products(const Matrix& X,Matrix& Y,const Matrix& W,Matrix& Z) const {
+            om_assert(X.nlin()==ncol() && W.nlin()==nlin());
+            Y = Matrix(nlin(),X.ncol());
+            Z = Matrix(ncol(),W.ncol());
+            Y.set(0.0);
+            Z.set(0.0);
+
+            ThreadException e;
+            #pragma omp parallel
+            {
+                Matrix Yt(Y.nlin(),Y.ncol());
+                Matrix Zt(Z.nlin(),Z.ncol());
+                Yt.set(0.0);
+                Zt.set(0.0);
+
+                #pragma omp for schedule(dynamic) nowait
+                for (int b=0; b<static_cast<int>(blocks.size()); ++b)
+                    e.Run([&](){
+                        const Block& block = blocks[b];
+                        if (block.U.ncol()==0) // Null low rank block.
+                            return;
+                        if (X.ncol()!=0) {
+                            const Matrix& Xb = gather(X,col_elements,block.cbegin,block.ncol());
+                            scatter((block.low_rank) ? block.U*block.V.tmult(Xb) : block.U*Xb,row_elements,block.rbegin,Yt);
+                        }
+                        if (W.ncol()!=0) {
+                            const Matrix& Wb = gather(W,row_elements,block.rbegin,block.nlin());
+                            scatter((block.low_rank) ? block.V*block.U.tmult(Wb) : block.U.tmult(Wb),col_elements,block.cbegin,Zt);
+                        }
+                    });
+
+                #pragma omp critical (hmatrix_products)
+                {
+                    if (Y.size()!=0)
+                        Y += Yt;
+                    if (Z.size()!=0)
+                        Z += Zt;
+                }
+            }
+            e.Rethrow();
+        }
+
+        Matrix operator*(const Matrix& X) const {
+            Matrix Y, Z;
+            products(X,Y,Matrix(nlin(),0),Z);
+            return Y;
+        }
+
+        Matrix tmult(const Matrix& W) const {
+            Matrix Y, Z;
+            products(Matrix(ncol(),0),Y,W,Z);
+            return Z;
+        }
+
+        Vector operator*(const Vector& x) const { return column(*this*Matrix(x,x.size(),1)); }
+        Vector tmult(const Vector& x)     const { return column(tmult(Matrix(x,x.size(),1))); }
+
+        /// Binary (de)serialization of the blocks.
+
+        void write(std::ostream& os) const {
+            Details::write_indices(os,row_elements);
+            Details::write_indices(os,col_elements);
+            const std::uint64_t nb = blocks.size();
+            os.write(reinterpret_cast<const char*>(&nb),sizeof(nb));
+            for (const auto& block : blocks) {
+                const std::uint32_t header[5] = { block.rbegin, block.rend, block.cbegin, block.cend, block.low_rank };
+                os.write(reinterpret_cast<const char*>(header),sizeof(header));
+                write_matrix(os,block.U);
+                if (block.low_rank)
+                    write_matrix(os,block.V);
+            }
+        }
+
+        /// The elements must be permutations and the blocks must fit in the matrix: the products index their vectors
+        /// with them.
+
+        void read(std::istream& is) {
+            row_elements = Details::read_indices(is,std::numeric_limits<unsigned>::max());
+            col_elements = Details::read_indices(is,std::numeric_limits<unsigned>::max());
+            if (!is_permutation(row_elements) || !is_permutation(col_elements))
+                throw BadData(is,"hierarchical matrix");
+            std::uint64_t nb = 0;
+            is.read(reinterpret_cast<char*>(&nb),sizeof(nb));
+            blocks.clear();
+            for (std::uint64_t b=0; is && b<nb; ++b) {
+                std::uint32_t header[5];
+                is.read(reinterpret_cast<char*>(header),sizeof(header));
+                if (!is || header[0]>header[1] || header[1]>nlin() || header[2]>header[3] || header[3]>ncol())
+                    throw BadData(is,"hierarchical matrix");
+                blocks.push_back(Block(header[0],header[1],header[2],header[3],header[4]!=0));
+                Block& block = blocks.back();
+                block.U = read_matrix(is,block.nlin(),block.ncol());
+                if (block.low_rank)
+                    block.V = read_matrix(is,block.ncol(),block.nlin());
+                const bool consistent = (block.low_rank) ?
+                    block.U.nlin()==block.nlin() && block.V.nlin()==block.ncol() && block.U.ncol()==block.V.ncol() :
+                    block.U.nlin()==block.nlin() && block.U.ncol()==block.ncol();
+                if (!is || !consistent)
+                    throw BadData(is,"hierarchical matrix");
+            }
+        }
+
+    private:
+
+        // Blocks cover the positions [rbegin,rend[ x [cbegin,cend[ of the (permuted) elements.
+
+        struct Block {
+            Block(const unsigned rb,const unsigned re,const unsigned cb,const unsigned ce,const bool lr):
+                rbegin(rb),rend(re),cbegin(cb),cend(ce),low_rank(lr)
+            { }
+
+            unsigned nlin() const { return rend-rbegin; }
+            unsigned ncol() const { return cend-cbegin; }
+
+            unsigned rbegin;
+            unsigned rend;
+            unsigned cbegin;
+            unsigned cend;
+            bool     low_rank;
+            Matrix   U;         // Low rank blocks are U.V^T, dense blocks are stored in U.
+            Matrix   V;
+        };
+
+        bool admissible(const ClusterTree::Node& rnode,const ClusterTree::Node& cnode) const {
+            const double dist = rnode.box.distance(cnode.box);
+            return dist>0.0 && std::min(rnode.box.diameter(),cnode.box.diameter())<=eta*dist;
+        }
+
+        void partition(const ClusterTree& rtree,const ClusterTree& ctree,const unsigned r,const unsigned c) {
+            const ClusterTree::Node& rnode = rtree.node(r);
+            const ClusterTree::Node& cnode = ctree.node(c);
+            if (admissible(rnode,cnode)) {
+                blocks.push_back(Block(rnode.begin,rnode.end,cnode.begin,cnode.end,true));
+            } else if (rnode.leaf() && cnode.leaf()) {
+                blocks.push_back(Block(rnode.begin,rnode.end,cnode.begin,cnode.end,false));
+            } else if (cnode.leaf() || (!rnode.leaf() && rnode.size()>=cnode.size())) {
+                partition(rtree,ctree,rnode.children[0],c);
+                partition(rtree,ctree,rnode.children[1],c);
+            } else {
+                partition(rtree,ctree,r,cnode.children[0]);
+                partition(rtree,ctree,r,cnode.children[1]);
+            }
+        }
+
+        std::vector<unsigned> rows(const Block& block) const {
+            return std::vector<unsigned>(row_elements.begin()+block.rbegin,row_elements.begin()+block.rend);
+        }
+
+        std::vector<unsigned> cols(const Block& block) const {
+            return std::vector<unsigned>(col_elements.begin()+block.cbegin,col_elements.begin()+block.cend);
+        }
+
+        void dense(Block& block,const Entries& entries) const {
+            block.low_rank = false;
+            block.U = Matrix(block.nlin(),block.ncol());
+            block.V = Matrix();
+            entries(rows(block),cols(block),block.U);
+        }
+
+        // Adaptive cross approximation with partial pivoting. The residual rows and columns are computed from whole rows
+        // and columns of the block.
+        // Returns false when the approximation does not pay off (the block is then computed densely).
+
+        bool cross_approximation(Block& block,const Entries& entries) const {
+            const std::vector<unsigned>& block_rows = rows(block);
+            const std::vector<unsigned>& block_cols = cols(block);
+            const unsigned m = block_rows.size();
+            const unsigned n = block_cols.size();
+            const unsigned max_rank = (m*n)/(m+n);
+
+            std::vector<std::vector<double>> us;
+            std::vector<std::vector<double>> vs;
+            std::vector<bool> used_rows(m,false);
+
+            Matrix row(1,n);
+            Matrix col(m,1);
+
+            double   norm2     = 0.0; // Squared Frobenius norm of the current approximation.
+            unsigned i         = 0;
+            unsigned nused     = 0;
+            unsigned converged = 0;
+            while (nused<m) {
+                if (us.size()>=max_rank)
+                    return false;
+
+                // Residual row i.
+
+                used_rows[i] = true;
+                ++nused;
+                entries({ block_rows[i] },block_cols,row);
+                std::vector<double> v(n);
+                for (unsigned j=0; j<n; ++j) {
+                    v[j] = row(0,j);
+                    for (unsigned k=0; k<us.size(); ++k)
+                        v[j] -= us[k][i]*vs[k][j];
+                }
+
+                const unsigned jmax = std::max_element(v.begin(),v.end(),[](const double a,const double b) { return std::abs(a)<std::abs(b); })-v.begin();
+                const double pivot = v[jmax];
+                if (std::abs(pivot)<=std::numeric_limits<double>::min()) {
+                    const auto next = std::find(used_rows.begin(),used_rows.end(),false);
+                    if (next==used_rows.end())
+                        break;
+                    i = next-used_rows.begin();
+                    continue;
+                }
+                for (auto& vj : v)
+                    vj /= pivot;
+
+                // Residual column jmax.
+
+                entries(block_rows,{ block_cols[jmax] },col);
+                std::vector<double> u(m);
+                for (unsigned l=0; l<m; ++l) {
+                    u[l] = col(l,0);
+                    for (unsigned k=0; k<us.size(); ++k)
+                        u[l] -= us[k][l]*vs[k][jmax];
+                }
+
+                // Update the norm of the approximation and check convergence.
+
+                const double unorm2 = std::inner_product(u.begin(),u.end(),u.begin(),0.0);
+                const double vnorm2 = std::inner_product(v.begin(),v.end(),v.begin(),0.0);
+                for (unsigned k=0; k<us.size(); ++k)
+                    norm2 += 2.0*std::inner_product(u.begin(),u.end(),us[k].begin(),0.0)*std::inner_product(v.begin(),v.end(),vs[k].begin(),0.0);
+                norm2 += unorm2*vnorm2;
+
+                us.push_back(u);
+                vs.push_back(v);
+
+                // The convergence test is based on the last update only: require it twice in a row to avoid
+                // stopping on an accidentally small update.
+
+                converged = (unorm2*vnorm2<=sqr(tolerance)*norm2) ? converged+1 : 0;
+                if (converged==2)
+                    break;
+
+                // Next pivot row: largest entry of the column among the rows not used yet.
+
+                double umax = -1.0;
+                for (unsigned l=0; l<m; ++l)
+                    if (!used_rows[l] && std::abs(u[l])>umax) {
+                        umax = std::abs(u[l]);
+                        i = l;
+                    }
+            }
+
+            const unsigned rank = us.size();
+            block.U = Matrix(m,rank);
+            block.V = Matrix(n,rank);
+            for (unsigned k=0; k<rank; ++k) {
+                for (unsigned l=0; l<m; ++l)
+                    block.U(l,k) = us[k][l];
+                for (unsigned j=0; j<n; ++j)
+                    block.V(j,k) = vs[k][j];
+            }
+            return true;
+        }
+
+        // Lines of M of the elements [begin,begin+n[ of the ordering elements, and addition of Mb to these lines of M.
+
+        static Matrix gather(const Matrix& M,const std::vector<unsigned>& elements,const unsigned begin,const unsigned n) {
+            Matrix Mb(n,M.ncol());
+            for (unsigned j=0; j<M.ncol(); ++j)
+                for (unsigned i=0; i<n; ++i)
+                    Mb(i,j) = M(elements[begin+i],j);
+            return Mb;
+        }
+
+        static void scatter(const Matrix& Mb,const std::vector<unsigned>& elements,const unsigned begin,Matrix& M) {
+            for (unsigned j=0; j<M.ncol(); ++j)
+                for (unsigned i=0; i<Mb.nlin(); ++i)
+                    M(elements[begin+i],j) += Mb(i,j);
+        }
+
+        static Vector column(const Matrix& M) {
+            Vector v(M.nlin());
+            for (unsigned i=0; i<M.nlin(); ++i)
+                v(i) = M(i,0);
+            return v;
+        }
+
+        static bool is_permutation(const std::vector<unsigned>& elements) {
+            std::vector<bool> found(elements.size(),false);
+            for (const unsigned i : elements) {
+                if (i>=elements.size() || found[i])
+                    return false;
+                found[i] = true;
+            }
+            return true;
+        }
+
+        static void write_matrix(std::ostream& os,const Matrix& M) {
+            const std::uint32_t dims[2] = { M.nlin(), M.ncol() };
+            os.write(reinterpret_cast<const char*>(dims),sizeof(dims));
+            if (M.size()!=0)
+                os.write(reinterpret_cast<const char*>(M.data()),M.size()*sizeof(double));
+        }
+
+        // Matrices of a block have nlin lines and at most max_ncol columns (the rank of a low rank block is lower than the
+        // dimensions of the block): the dimensions are checked before the allocation.
+
+        static Matrix read_matrix(std::istream& is,const unsigned nlin,const unsigned max_ncol) {
+            std::uint32_t dims[2] = { 0, 0 };
+            is.read(reinterpret_cast<char*>(dims),sizeof(dims));
+            if (!is || dims[0]!=nlin || dims[1]>max_ncol)
+                throw BadData(is,"hierarchical matrix");
+            Matrix M(dims[0],dims[1]);
+            if (M.size()!=0)
+                is.read(reinterpret_cast<char*>(M.data()),M.size()*sizeof(double));
+            return M;
+        }
+
+        std::vector<unsigned> row_elements;
+        std::vector<unsigned> col_elements;
+        double                tolerance = 0.0;
+        double                eta       = 0.0;
+        std::vector<Block>    blocks;
+    };
+}
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <cmath>
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include <vertex.h>
 #include <triangle.h>
@@ -16,8 +18,58 @@
 
 namespace OpenMEEG {
 
+    class Integrator;
+
+    #ifndef SWIGPYTHON
+
+    /// Quadrature points of a set of triangles for the rule of an integrator, computed once for all.
+    /// Points are stored as structures of arrays (the points of triangle t are at positions t*nb_points to
+    /// (t+1)*nb_points-1) along with the quadrature weights multiplied by the jacobian (twice the area of the triangle).
+    /// For adaptive integrators, the points of the first level of subdivision (4 triangles per triangle) are also stored.
+    /// For integrators with a far field ratio, the points of the low order rule used for far pairs are also stored.
+
+    class QuadratureTable {
+    public:
+
+        struct Points {
+
+            void add(const Vect3& point,const double weight) {
+                x.push_back(point.x());
+                y.push_back(point.y());
+                z.push_back(point.z());
+                weights.push_back(weight);
+            }
+
+            Vect3 operator()(const unsigned i) const { return Vect3(x[i],y[i],z[i]); }
+
+            std::vector<double> x;
+            std::vector<double> y;
+            std::vector<double> z;
+            std::vector<double> weights;
+        };
+
+        QuadratureTable(const Integrator& integrator,const Triangles& triangles);
+
+        /// \return the position of the triangle in the table (the triangle must belong to the triangles of the table).
+
+        unsigned position(const Triangle& triangle) const { return &triangle-triangles.data(); }
+
+        const Triangles& triangles;
+        const unsigned   nb_points;     //!< Number of quadrature points per triangle.
+        const unsigned   nb_far_points; //!< Number of quadrature points per triangle of the low order rule.
+        Points           points;        //!< Quadrature points of the triangles.
+        Points           subdivision;   //!< Quadrature points of the 4 subtriangles of each triangle (adaptive rules only).
+        Points           far_points;    //!< Quadrature points of the low order rule for far pairs (far field ratio only).
+    };
+
+    #endif /* not SWIGPYTHON */
+
     class OPENMEEG_EXPORT Integrator {
 
+        #ifndef SWIGPYTHON
+        friend class QuadratureTable;
+        #endif
+
         typedef Vect3 Point;
         typedef Point TrianglePoints[3];
 
@@ -30,12 +82,45 @@ namespace OpenMEEG {
 
     public:
 
+        // The optional parameter far_ratio enables a cheaper integration of well separated triangle pairs:
+        // when the distance between the two triangles is larger than far_ratio times their size, the 3 points
+        // rule is used without adaptive refinement. A zero value (the default) disables this classification.
+
         Integrator(const unsigned ord): Integrator(ord,0,0.0) { }
         Integrator(const unsigned ord,const double tol): Integrator(ord,10,tol) { }
-        Integrator(const unsigned ord,const unsigned levels,const double tol=0.0001):
-            order(safe_order(ord)),tolerance(tol),max_depth(levels)
+        Integrator(const unsigned ord,const unsigned levels,const double tol=0.0001,const double far_ratio=0.0):
+            order(safe_order(ord)),tolerance(tol),max_depth(levels),far_field_ratio(far_ratio)
         { }
 
+        /// \return true if the integration over a triangle is a plain quadrature rule (no adaptive refinement). Quadrature
+        /// points can then be computed once for all (see QuadratureTable), including those of the low order rule used for
+        /// the far pairs when there is a far field ratio.
+
+        bool fixed_rule() const { return max_depth==0; }
+
+        /// \return true if the far pairs of triangles (see far_pair) are integrated with the low order rule.
+
+        bool far_field() const { return far_field_ratio!=0.0; }
+
+        unsigned nb_points()                const { return nbPts[order];             }
+        unsigned nb_far_points()            const { return nbPts[0];                 }
+        double   weight(const unsigned i) const { return rules[order][i].weight; }
+
+        /// \return the ith quadrature point of the triangle.
+
+        Vect3 point(const Triangle& triangle,const unsigned i) const {
+            Vect3 v(0.0,0.0,0.0);
+            for (unsigned j=0; j<3; ++j)
+                v.multadd(rules[order][i].barycentric_coordinates[j],triangle.vertex(j));
+            return v;
+        }
+
+        /// \return the jacobian of the quadrature rule (twice the area of the triangle).
+
+        static double jacobian(const Triangle& triangle) {
+            return crossprod(triangle.vertex(1)-triangle.vertex(0),triangle.vertex(2)-triangle.vertex(0)).norm();
+        }
+
         double norm(const double a) const { return fabs(a);  }
         double norm(const Vect3& a) const { return a.norm(); }
 
@@ -48,20 +133,77 @@ namespace OpenMEEG {
             const auto& coarse = triangle_integration(function,tripts);
             return (max_depth==0) ? coarse : adaptive_integration(function,tripts,coarse,max_depth);
         }
+
+        // Integration over triangle of a function defined by (an analytic integration over) the triangle source.
+        // Far pairs are integrated with the lowest order rule.
+
+        template <typename Function>
+        decltype(auto) integrate(const Function& function,const Triangle& triangle,const Triangle& source) const {
+            const TrianglePoints tripts = { triangle.vertex(0), triangle.vertex(1), triangle.vertex(2) };
+            const bool  far    = far_pair(triangle,source);
+            const auto& coarse = triangle_integration(function,tripts,(far) ? 0 : order);
+            return (max_depth==0 || far) ? coarse : adaptive_integration(function,tripts,coarse,max_depth);
+        }
+
+        // Same integrals with precomputed quadrature points (see QuadratureTable), triangle being one of the triangles of
+        // the table.
+
+        template <typename Function>
+        auto integrate(const Function& function,const QuadratureTable& table,const Triangle& triangle) const {
+            using T = decltype(function(Vect3()));
+            const unsigned t = table.position(triangle);
+            const T coarse = table_integration<T>(function,table.points,t*table.nb_points,table.nb_points);
+            if (max_depth==0)
+                return coarse;
+
+            TrianglePoints new_triangles[4];
+            subdivide({ triangle.vertex(0), triangle.vertex(1), triangle.vertex(2) },new_triangles);
+            T integrals[4];
+            for (unsigned i=0; i<4; ++i)
+                integrals[i] = table_integration<T>(function,table.subdivision,(4*t+i)*table.nb_points,table.nb_points);
+            return refine(function,new_triangles,coarse,integrals,max_depth);
+        }
+
+        template <typename Function>
+        auto integrate(const Function& function,const QuadratureTable& table,const Triangle& triangle,const Triangle& source) const {
+            using T = decltype(function(Vect3()));
+            if (!far_pair(triangle,source))
+                return integrate(function,table,triangle);
+            const unsigned np = table.nb_far_points;
+            return table_integration<T>(function,table.far_points,table.position(triangle)*np,np);
+        }
         #endif /* not SWIGPYTHON */
 
+        /// \return true if the triangles are far enough apart (relatively to their sizes) to use the low order rule.
+
+        bool far_pair(const Triangle& triangle1,const Triangle& triangle2) const {
+            if (far_field_ratio==0.0)
+                return false;
+            const Vect3& center1 = triangle1.center();
+            const Vect3& center2 = triangle2.center();
+            double radius = 0.0;
+            for (unsigned i=0; i<3; ++i)
+                radius = std::max(radius,std::max((triangle1.vertex(i)-center1).norm(),(triangle2.vertex(i)-center2).norm()));
+            return (center1-center2).norm()>2*far_field_ratio*radius;
+        }
+
     private:
 
         #ifndef SWIGPYTHON  // SWIG sees the triangle_integration def as a syntax error
         template <typename Function>
         decltype(auto) triangle_integration(const Function& function,const TrianglePoints& triangle) const {
+            return triangle_integration(function,triangle,order);
+        }
+
+        template <typename Function>
+        decltype(auto) triangle_integration(const Function& function,const TrianglePoints& triangle,const unsigned ord) const {
             using T = decltype(function(Vect3()));
             T result = 0.0;
-            for (unsigned i=0;i<nbPts[order];++i) {
+            for (unsigned i=0;i<nbPts[ord];++i) {
                 Vect3 v(0.0,0.0,0.0);
                 for (unsigned j=0; j<3; ++j)
-                    v.multadd(rules[order][i].barycentric_coordinates[j],triangle[j]);
-                result += rules[order][i].weight*function(v);
+                    v.multadd(rules[ord][i].barycentric_coordinates[j],triangle[j]);
+                result += rules[ord][i].weight*function(v);
             }
 
             // compute double area of triangle defined by points
@@ -69,22 +211,46 @@ namespace OpenMEEG {
             const double area2 = crossprod(triangle[1]-triangle[0],triangle[2]-triangle[0]).norm();
             return result*area2;
         }
-        #endif /* not SWIGPYTHON */
 
         template <typename T,typename Function>
-        T adaptive_integration(const Function& function,const TrianglePoints& triangle,const T& coarse,const unsigned level) const {
+        T table_integration(const Function& function,const QuadratureTable::Points& points,const unsigned first,const unsigned nb) const {
+            T result = 0.0;
+            for (unsigned i=first; i<first+nb; ++i)
+                result += points.weights[i]*function(points(i));
+            return result;
+        }
+        #endif /* not SWIGPYTHON */
+
+        static void subdivide(const TrianglePoints& triangle,TrianglePoints new_triangles[4]) {
             const Point midpoints[] = { 0.5*(triangle[1]+triangle[2]), 0.5*(triangle[2]+triangle[0]), 0.5*(triangle[0]+triangle[1]) };
-            const TrianglePoints new_triangles[] = {
-                { triangle[0],  midpoints[1], midpoints[2] }, { midpoints[0], triangle[1],  midpoints[2] },
-                { midpoints[0], midpoints[1], triangle[2]  }, { midpoints[0], midpoints[1], midpoints[2] }
+            const Point* vertices[4][3] = {
+                { &triangle[0],  &midpoints[1], &midpoints[2] }, { &midpoints[0], &triangle[1],  &midpoints[2] },
+                { &midpoints[0], &midpoints[1], &triangle[2]  }, { &midpoints[0], &midpoints[1], &midpoints[2] }
             };
+            for (unsigned i=0; i<4; ++i)
+                for (unsigned j=0; j<3; ++j)
+                    new_triangles[i][j] = *vertices[i][j];
+        }
+
+        template <typename T,typename Function>
+        T adaptive_integration(const Function& function,const TrianglePoints& triangle,const T& coarse,const unsigned level) const {
+            TrianglePoints new_triangles[4];
+            subdivide(triangle,new_triangles);
 
-            T refined = 0.0;
             T integrals[4];
-            for (unsigned i=0; i<4; ++i) {
+            for (unsigned i=0; i<4; ++i)
                 integrals[i] = triangle_integration(function,new_triangles[i]);
+
+            return refine(function,new_triangles,coarse,integrals,level);
+        }
+
+        // Adaptive refinement given the integrals over the 4 subtriangles of a triangle.
+
+        template <typename T,typename Function>
+        T refine(const Function& function,const TrianglePoints new_triangles[4],const T& coarse,const T integrals[4],const unsigned level) const {
+            T refined = 0.0;
+            for (unsigned i=0; i<4; ++i)
                 refined += integrals[i];
-            }
 
             if (norm(coarse-refined)<=tolerance*norm(coarse) || level==0)
                 return refined;
@@ -100,6 +266,7 @@ namespace OpenMEEG {
         const unsigned order;
         const double   tolerance;
         const unsigned max_depth;
+        const double   far_field_ratio;
 
         // Quadrature rules are from Marc Bonnet's book: Equations integrales..., Appendix B.3
 
@@ -161,4 +328,41 @@ namespace OpenMEEG {
             }
         };
     };
+
+    #ifndef SWIGPYTHON
+    inline QuadratureTable::QuadratureTable(const Integrator& integrator,const Triangles& tris):
+        triangles(tris),nb_points(integrator.nb_points()),nb_far_points(integrator.nb_far_points())
+    {
+        const unsigned order = integrator.order;
+        for (const auto& triangle : triangles) {
+            const Integrator::TrianglePoints tripts = { triangle.vertex(0), triangle.vertex(1), triangle.vertex(2) };
+            const double area2 = Integrator::jacobian(triangle);
+            for (unsigned i=0; i<nb_points; ++i)
+                points.add(integrator.point(triangle,i),Integrator::rules[order][i].weight*area2);
+
+            if (integrator.far_field())
+                for (unsigned i=0; i<nb_far_points; ++i) {
+                    Vect3 v(0.0,0.0,0.0);
+                    for (unsigned j=0; j<3; ++j)
+                        v.multadd(Integrator::rules[0][i].barycentric_coordinates[j],tripts[j]);
+                    far_points.add(v,Integrator::rules[0][i].weight*area2);
+                }
+
+            if (integrator.max_depth==0)
+                continue;
+
+            Integrator::TrianglePoints new_triangles[4];
+            Integrator::subdivide(tripts,new_triangles);
+            for (const auto& subtriangle : new_triangles) {
+                const double subarea2 = crossprod(subtriangle[1]-subtriangle[0],subtriangle[2]-subtriangle[0]).norm();
+                for (unsigned i=0; i<nb_points; ++i) {
+                    Vect3 v(0.0,0.0,0.0);
+                    for (unsigned j=0; j<3; ++j)
+                        v.multadd(Integrator::rules[order][i].barycentric_coordinates[j],subtriangle[j]);
+                    subdivision.add(v,Integrator::rules[order][i].weight*subarea2);
+                }
+            }
+        }
+    }
+    #endif /* not SWIGPYTHON */
 }
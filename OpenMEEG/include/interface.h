@@ -12,12 +12,14 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <memory>
 #include <om_common.h>
 #include <mesh.h>
 
 namespace OpenMEEG {
 
     class Mesh;
+    class TriangleBVH;
 
     /// An Oriented Mesh is a mesh associated with a boolean stating if it is well oriented.
 
@@ -63,7 +65,7 @@ namespace OpenMEEG {
 
         const std::string& name() const { return interface_name; } ///< \return Interface name
 
-              OrientedMeshes& oriented_meshes()       { return orientedmeshes; }
+              OrientedMeshes& oriented_meshes()       { std::atomic_store(&bvh,std::shared_ptr<const TriangleBVH>()); return orientedmeshes; }
         const OrientedMeshes& oriented_meshes() const { return orientedmeshes; }
 
         bool outermost() const { return outermost_interface; } ///< \return true if it is the outermost interface.
@@ -91,6 +93,13 @@ namespace OpenMEEG {
             return nb;
         }
 
+        /// \brief Bounding volume hierarchy of the triangles of the interface, for closest triangle queries.
+        /// It is built at the first call (which is thread safe), discarded when the oriented meshes are accessed for
+        /// modification and rebuilt when one of the meshes has been updated (see Mesh::revision). The meshes must not be
+        /// modified while a reference to a tree obtained before the change is still in use.
+
+        const TriangleBVH& triangle_bvh() const;
+
         /// \return the adjacent triangles
 
         TrianglesRefs adjacent_triangles(const Triangle& t) const {
@@ -109,6 +118,8 @@ namespace OpenMEEG {
         std::string    interface_name      = "";    ///< interface name is "" by default
         bool           outermost_interface = false; ///< whether or not the interface touches the Air (outermost) domain.
         OrientedMeshes orientedmeshes;
+
+        mutable std::shared_ptr<const TriangleBVH> bvh; ///< Built on demand by triangle_bvh().
     };
 
     /// A vector of Interface is called Interfaces.
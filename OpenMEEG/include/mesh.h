@@ -8,11 +8,13 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
 
 #include <vector>
 #include <map>
 #include <string>
 #include <memory>
+#include <functional>
 
 #include <om_common.h>
 #include <triangle.h>
@@ -40,7 +42,34 @@ namespace OpenMEEG {
         friend class Geometry;
         friend class MeshIO;
 
-        typedef std::map<const Vertex*,TrianglesRefs> VertexTriangles;
+        typedef std::vector<std::pair<const Triangle*,const Triangle*>> TrianglePairs;
+
+        /// \brief Incidence of a vertex V in a triangle. The edge of the triangle opposite to V has the vertices
+        /// opposite[0] and opposite[1] (in the order given by Triangle::edge(V)) and edge is opposite[0]-opposite[1].
+
+        struct Incidence {
+            Triangle*     triangle;
+            const Vertex* opposite[2];
+            Vect3         edge;
+        };
+
+        /// \brief Contiguous range of the incidences of a vertex.
+
+        class Incidences {
+        public:
+
+            Incidences(const Incidence* f,const Incidence* l): first(f),last(l) { }
+
+            const Incidence* begin() const { return first; }
+            const Incidence* end()   const { return last;  }
+
+            size_t size() const { return last-first; }
+
+        private:
+
+            const Incidence* first;
+            const Incidence* last;
+        };
 
         /// Default constructor
         /// or constructor using a provided geometry \param geometry
@@ -96,6 +125,11 @@ namespace OpenMEEG {
         bool  isolated()        const { return isolated_;        }
         bool& isolated()              { return isolated_;        }
 
+        /// \return a counter incremented each time the vertices or the orientation of the mesh change (see update and
+        /// change_orientation), so that the structures built on the mesh can detect that they are out of date.
+
+        unsigned revision() const { return revision_; }
+
         /// \brief Add a triangle specified by its indices in the geometry.
 
         Triangle& add_triangle(const TriangleIndices inds);
@@ -123,11 +157,28 @@ namespace OpenMEEG {
         ///  \return void \sa
 
         void info(const bool verbose=false) const; ///< \brief Print mesh information.
-        bool has_self_intersection() const;        ///< \brief Check whether the mesh self-intersects.
-        bool intersection(const Mesh&) const;      ///< \brief Check whether the mesh intersects another mesh.
+
+        /// \brief Check whether the mesh self-intersects (resp. intersects another mesh) and print the intersecting
+        /// triangles (only the first pair found, unless \param report_all is true).
+
+        bool has_self_intersection(const bool report_all=false) const;
+        bool intersection(const Mesh& m,const bool report_all=false) const;
+
+        /// \brief Pairs of intersecting triangles of the mesh (triangles sharing a vertex are not tested against each
+        /// other), or of this mesh and \param m. The candidate pairs are found with bounding volume hierarchies and
+        /// tested in parallel. Unless \param all is true, the search stops as soon as one pair is found.
+
+        TrianglePairs self_intersections(const bool all=true) const;
+        TrianglePairs intersections(const Mesh& m,const bool all=true) const;
+
         bool has_correct_orientation() const;      ///< \brief Check local orientation of mesh triangles.
         void generate_indices();                   ///< \brief Generate indices (if allocate).
         void update(const bool topology_changed);  ///< \brief Recompute triangles normals, area, and vertex triangles.
+
+        /// \brief Hash of the mesh content (vertex positions of its triangles, in order).
+        /// Two meshes with the same hash yield the same operator blocks (used for incremental head matrix assembly).
+
+        std::uint64_t content_hash() const;
         void merge(const Mesh&,const Mesh&);       ///< Merge two meshes.
 
         #ifdef DEBUG
@@ -156,19 +207,42 @@ namespace OpenMEEG {
 
         Range triangles_range() const { return Range(triangles().front().index(),triangles().back().index()); }
 
+        /// \brief Get the incidences of vertex \param V in the triangles of the mesh (without any copy).
+
+        /// \brief An UnknownVertex exception is thrown if \param V is not a vertex of a triangle of the mesh.
+
+        Incidences incidences(const Vertex& V) const {
+            const Vertex* last_vertex = first_vertex+((incidence_offsets.empty()) ? 0 : incidence_offsets.size()-1);
+            if (first_vertex==nullptr || std::less<const Vertex*>()(&V,first_vertex) || !std::less<const Vertex*>()(&V,last_vertex))
+                throw UnknownVertex(unknown_vertex_message(V));
+            const size_t k = &V-first_vertex;
+            if (incidence_offsets[k]==incidence_offsets[k+1])
+                throw UnknownVertex(unknown_vertex_message(V));
+            return Incidences(incidences_.data()+incidence_offsets[k],incidences_.data()+incidence_offsets[k+1]);
+        }
+
         /// \brief Get the triangles adjacent to vertex \param V .
 
-        TrianglesRefs triangles(const Vertex& V) const { return vertex_triangles.at(&V); }
+        TrianglesRefs triangles(const Vertex& V) const {
+            TrianglesRefs result;
+            for (const auto& incidence : incidences(V))
+                result.push_back(incidence.triangle);
+            return result;
+        }
 
-        /// \brief Get the triangles adjacent to \param triangle .
+        /// \brief Get the triangles adjacent to \param triangle (i.e. sharing an edge with it, including itself).
+        /// A triangle is listed when the second of its vertices shared with \param triangle is reached.
 
         TrianglesRefs adjacent_triangles(const Triangle& triangle) const {
-            std::map<Triangle*,unsigned> mapt;
             TrianglesRefs result;
-            for (auto& vertex : triangle)
-                for (const auto& t2 : triangles(*vertex))
-                    if (++mapt[t2]==2)
-                        result.push_back(t2);
+            for (unsigned i=1; i<3; ++i)
+                for (const auto& incidence : incidences(triangle.vertex(i))) {
+                    unsigned shared = 0;
+                    for (unsigned j=0; j<i; ++j)
+                        shared += incidence.triangle->contains(triangle.vertex(j));
+                    if (shared==1)
+                        result.push_back(incidence.triangle);
+                }
             return result;
         }
 
@@ -177,6 +251,8 @@ namespace OpenMEEG {
         void change_orientation() {
             for (auto& triangle : triangles())
                 triangle.change_orientation();
+            update_incidences();
+            ++revision_;
         }
 
         void correct_local_orientation(); ///< \brief Correct the local orientation of the mesh triangles.
@@ -249,19 +325,23 @@ namespace OpenMEEG {
             return sqr(dotprod(t1.normal(),t2.normal()))/(t1.center()-t2.center()).norm2();
         }
 
-        // Create the map that for each vertex gives the triangles containing it.
+        //  Create the compressed storage of the triangles incident to each vertex. The vertices are identified by their
+        //  position in the geometry (relative to the first vertex of the mesh), so no lookup is needed.
 
-        void make_adjacencies() {
-            vertex_triangles.clear();
-            for (auto& triangle : triangles())
-                for (const auto& vertex : triangle)
-                    vertex_triangles[vertex].push_back(&triangle);
-        }
+        void make_adjacencies();
+
+        std::string unknown_vertex_message(const Vertex& V) const;
+
+        //  Compute the opposite edges of the incidences (after a change of orientation or of vertex positions).
+
+        void update_incidences();
 
         typedef std::shared_ptr<Geometry> Geom;
 
         std::string      mesh_name = "";     ///< Name of the mesh.
-        VertexTriangles  vertex_triangles;   ///< links[&v] are the triangles that contain vertex v.
+        const Vertex*    first_vertex = nullptr;  ///< Vertex of the geometry with the smallest address in the mesh.
+        std::vector<size_t>    incidence_offsets; ///< Incidences of vertex v are [offsets[&v-first_vertex],offsets[&v-first_vertex+1][.
+        std::vector<Incidence> incidences_;       ///< Incidences of all the vertices of the mesh.
         Geometry*        geom;               ///< Pointer to the geometry containing the mesh.
         VerticesRefs     mesh_vertices;      ///< Vector of pointers to the mesh vertices.
         Triangles        mesh_triangles;     ///< Vector of triangles.
@@ -271,6 +351,8 @@ namespace OpenMEEG {
 
         bool             current_barrier_ = false;
         bool             isolated_        = false;
+
+        unsigned         revision_ = 0;      ///< Incremented when the geometry of the mesh changes.
     };
 
     typedef std::vector<Mesh> Meshes;
@@ -12,6 +12,11 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include <vector.h>
 #include <matrix.h>
@@ -21,10 +26,15 @@
 #include <geometry.h>
 #include <integrator.h>
 #include <analytics.h>
+#include <hmatrix.h>
 
 #include <logger.h>
 #include <progressbar.h>
 
+#ifndef NO_OPENMP
+#include <omp.h>
+#endif
+
 namespace OpenMEEG {
 
     void operatorFerguson(const Vect3&,const Mesh&,Matrix&,const unsigned&,const double);
@@ -39,14 +49,13 @@ namespace OpenMEEG {
             //  Loop over triangles of which V is a vertex
 
             result = 0.0;
-            for (const auto& tp : m.triangles(V)) {
-                const Triangle& T    = *tp;
-                const Edge&     edge = T.edge(V);
+            for (const auto& incidence : m.incidences(V)) {
+                const Triangle& T = *incidence.triangle;
 
                 // A, B are the two opposite vertices to V (triangle A, B, V)
-                const Vertex& A = edge.vertex(0);
-                const Vertex& B = edge.vertex(1);
-                const Vect3& AB = (A-B)/(2*T.area());
+                const Vertex& A = *incidence.opposite[0];
+                const Vertex& B = *incidence.opposite[1];
+                const Vect3& AB = incidence.edge/(2*T.area());
 
                 const analyticS analyS(V,A,B);
 
@@ -55,20 +64,116 @@ namespace OpenMEEG {
 
             return result;
         }
+
+        // Parallel execution of n work items f(0),...,f(n-1). Outside of a parallel region, the items are distributed
+        // dynamically over the threads. Within a parallel region (e.g. when the blocks of several mesh pairs are assembled
+        // concurrently), they are created as tasks, which are executed by the threads of the team as they become idle.
+
+        template <typename Function>
+        void run_tasks(const unsigned n,const Function& f) {
+            ThreadException e;
+            #ifndef NO_OPENMP
+            if (omp_in_parallel()) {
+                #pragma omp taskgroup
+                {
+                    for (unsigned i=0; i<n; ++i) {
+                        #pragma omp task default(shared) firstprivate(i)
+                        e.Run([&,i](){ f(i); });
+                    }
+                }
+                e.Rethrow();
+                return;
+            }
+            #endif
+            #pragma omp parallel for schedule(dynamic)
+            for (int i=0; i<static_cast<int>(n); ++i)
+                e.Run([&,i](){ f(i); });
+            e.Rethrow();
+        }
+
+        // Bounds of tiles splitting [0,n[ into ranges of approximately equal cost (cost(i) is an estimate of the cost of
+        // item i). There are a few tiles per thread for load balancing, unless this makes them smaller than min_size items
+        // (the batched kernels need enough points to be efficient).
+
+        template <typename Cost>
+        std::vector<unsigned> tiles(const unsigned n,const Cost& cost,const unsigned min_size=32) {
+            #ifndef NO_OPENMP
+            const unsigned nb_threads = omp_get_max_threads();
+            #else
+            const unsigned nb_threads = 1;
+            #endif
+            const unsigned nb_tiles = std::max(1U,std::min(4*nb_threads,n/min_size));
+
+            double total = 0.0;
+            for (unsigned i=0; i<n; ++i)
+                total += cost(i);
+
+            std::vector<unsigned> bounds = { 0 };
+            double cumulated = 0.0;
+            for (unsigned i=0; i<n; ++i) {
+                cumulated += cost(i);
+                if (cumulated*nb_tiles>=total*bounds.size() || i+1==n)
+                    bounds.push_back(i+1);
+            }
+            return bounds;
+        }
+
+        inline std::vector<unsigned> tiles(const unsigned n) { return tiles(n,[](const unsigned) { return 1.0; }); }
+
+        // Computes body(first,last) for all the tiles [first,last[ defined by bounds, in parallel.
+
+        template <typename Body>
+        void tiled(const std::vector<unsigned>& bounds,const Body& body) {
+            ProgressBar pb(bounds.size()-1);
+            run_tasks(bounds.size()-1,[&](const unsigned i) {
+                body(bounds[i],bounds[i+1]);
+                #pragma omp critical (progress)
+                ++pb;
+            });
+        }
     }
 
+    // Quadrature tables of sets of triangles (see QuadratureTable), built on demand for an integrator. They can be shared
+    // by all the blocks of an assembly so that the quadrature points of each mesh are computed only once.
+
+    class QuadratureTables {
+    public:
+
+        QuadratureTables(const Integrator& intg): integrator(intg) { }
+
+        const QuadratureTable& operator()(const Triangles& triangles) {
+            std::lock_guard<std::mutex> guard(lock);
+            std::unique_ptr<QuadratureTable>& table = tables[&triangles];
+            if (!table)
+                table = std::make_unique<QuadratureTable>(integrator,triangles);
+            return *table;
+        }
+
+    private:
+
+        const Integrator integrator;
+        std::mutex       lock;
+        std::map<const Triangles*,std::unique_ptr<QuadratureTable>> tables;
+    };
+
     class BlocksBase {
     public:
 
-        BlocksBase(const Integrator& intg): integrator(intg) { }
+        // The quadrature tables must have been built for the same integrator. By default, the block uses its own tables.
+
+        BlocksBase(const Integrator& intg,const std::shared_ptr<QuadratureTables>& qtables=nullptr):
+            integrator(intg),tables((qtables) ? qtables : std::make_shared<QuadratureTables>(intg))
+        { }
 
         void message(const char* op_name,const Mesh& mesh) const {
+            #pragma omp critical (log)
             log_stream(INFORMATION) << std::endl
                                     << "OPERATOR " << std::left << std::setw(2) << op_name
                                     << "... (arg : mesh " << mesh.name() << " )" << std::endl;
         }
 
         void message(const char* op_name,const Mesh& mesh1,const Mesh& mesh2) const {
+            #pragma omp critical (log)
             log_stream(INFORMATION) << "OPERATOR " << std::left << std::setw(2) << op_name
                                     << "... (arg : mesh " << mesh1.name() << " , mesh " << mesh2.name() << " )"
                                     << std::endl;
@@ -76,76 +181,273 @@ namespace OpenMEEG {
 
     protected:
 
-        template <typename T>
-        void D(const Triangles& triangles1,const Triangles& triangles2,const double coeff,T& mat) const {
-            // This function (OPTIMIZED VERSION) has the following arguments:
-            //    - 2 interacting meshes (as sets of triangles).
-            //    - coefficient to be applied to each matrix element (depending on conductivities, ...)
-            //    - storage Matrix for the result.
+        const QuadratureTable& table(const Triangles& triangles) const { return (*tables)(triangles); }
 
-            ThreadException e;
-            ProgressBar pb(triangles1.size());
-            #pragma omp parallel for
-            #if defined NO_OPENMP || defined OPENMP_RANGEFOR
-            for (const auto& triangle1 : triangles1) {
-            #elif defined OPENMP_ITERATOR
-            for (Triangles::const_iterator tit1=triangles1.begin(); tit1<triangles1.end(); ++tit1) {
-                const Triangle& triangle1 = *tit1;
-            #else
-            for (int i1=0; i1<static_cast<int>(triangles1.size()); ++i1) {
-                const Triangle& triangle1 = *(triangles1.begin()+i1);
-            #endif
-                e.Run([&](){
-                    for (const auto& triangle2 : triangles2) {
-                        const analyticD3 analyD(triangle2);
-                        const auto&  Dfunc = [&analyD](const Vect3& r) { return analyD.f(r); };
-                        const Vect3& total = integrator.integrate(Dfunc,triangle1);
-
-                        for (unsigned i=0; i<3; ++i)
-                            mat(triangle1.index(),triangle2.vertex(i).index()) += total(i)*coeff;
+        // Quadrature points of a batch of triangles of a table (a range [first,last[ or a list of positions), for the
+        // integrals whose inner integral is over a given triangle. When the integrator has a far field ratio, the triangles
+        // far from this triangle use the points of the low order rule. The points are gathered into contiguous arrays,
+        // except for a range without far field ratio (they are then those of the table). The points of the kth triangle
+        // of the batch are at positions begin(k) to end(k)-1.
+
+        class BatchPoints {
+        public:
+
+            BatchPoints(const Integrator& intg,const QuadratureTable& qtable,const unsigned batch):
+                integrator(intg),table(qtable),offsets(batch+1)
+            {
+                if (integrator.far_field())
+                    resize(batch);
+            }
+
+            void set(const Triangle& triangle,const unsigned first,const unsigned last) {
+                nb = last-first;
+                if (!integrator.far_field()) {
+                    const unsigned np = table.nb_points;
+                    for (unsigned k=0; k<=nb; ++k)
+                        offsets[k] = k*np;
+                    x = &table.points.x[first*np];
+                    y = &table.points.y[first*np];
+                    z = &table.points.z[first*np];
+                    weights = &table.points.weights[first*np];
+                    return;
+                }
+                gather(triangle,[first](const unsigned k) { return first+k; });
+            }
+
+            void set(const Triangle& triangle,const std::vector<unsigned>& positions) {
+                nb = positions.size();
+                resize(nb);
+                gather(triangle,[&positions](const unsigned k) { return positions[k]; });
+            }
+
+            unsigned size()                  const { return offsets[nb];  }
+            unsigned begin(const unsigned k) const { return offsets[k];   }
+            unsigned end(const unsigned k)   const { return offsets[k+1]; }
+
+            const double* x;
+            const double* y;
+            const double* z;
+            const double* weights;
+
+        private:
+
+            void resize(const unsigned n) {
+                if (offsets.size()<n+1)
+                    offsets.resize(n+1);
+                if (gathered.x.size()<n*table.nb_points)
+                    for (auto* coords : { &gathered.x, &gathered.y, &gathered.z, &gathered.weights })
+                        coords->resize(n*table.nb_points);
+            }
+
+            template <typename Position>
+            void gather(const Triangle& triangle,const Position& position) {
+                unsigned n = 0;
+                for (unsigned k=0; k<nb; ++k) {
+                    offsets[k] = n;
+                    const unsigned t   = position(k);
+                    const bool     far = integrator.far_pair(table.triangles[t],triangle);
+                    const QuadratureTable::Points& points = (far) ? table.far_points : table.points;
+                    const unsigned np = (far) ? table.nb_far_points : table.nb_points;
+                    for (unsigned i=t*np; i<(t+1)*np; ++i,++n) {
+                        gathered.x[n]       = points.x[i];
+                        gathered.y[n]       = points.y[i];
+                        gathered.z[n]       = points.z[i];
+                        gathered.weights[n] = points.weights[i];
                     }
-                    ++pb;
-                });
+                }
+                offsets[nb] = n;
+                x = gathered.x.data();
+                y = gathered.y.data();
+                z = gathered.z.data();
+                weights = gathered.weights.data();
             }
-            e.Rethrow();
-        }
 
-        // Operator N for two vertices of the same mesh.
+            const Integrator&       integrator;
+            const QuadratureTable&  table;
+            std::vector<unsigned>   offsets;
+            QuadratureTable::Points gathered;
+            unsigned                nb = 0;
+        };
+
+        // The following functions compute the interactions of one triangle with the triangles [first,end[ of the table
+        // qtable, sequentially (parallelism is obtained by splitting the tables into tiles). When the integrator is a
+        // fixed quadrature rule, the inner integrals are evaluated by batches of quadrature points (see analytics.h),
+        // with the low order rule for the far pairs of triangles (see BatchPoints).
+
+        // Operator S between triangle1 and the triangles [first,end[ of qtable.
 
         template <typename T>
-        static double N(const Vertex& V1,const Vertex& V2,const Mesh& m,const T& matrix) {
-            return N(0.25,V1,V2,m,m,matrix);
+        void S(const Triangle& triangle1,const QuadratureTable& qtable,const unsigned first,const unsigned end,
+               const double coeff,T& matrix) const
+        {
+            const Triangles& triangles2 = qtable.triangles;
+            const analyticS  analyS(triangle1);
+
+            if (!integrator.fixed_rule()) {
+                const auto& Sfunc = [&analyS](const Vect3& r) { return analyS.f(r); };
+                for (unsigned t=first; t<end; ++t)
+                    matrix(triangle1.index(),triangles2[t].index()) = integrator.integrate(Sfunc,qtable,triangles2[t],triangle1)*coeff;
+                return;
+            }
+
+            constexpr unsigned batch = 32; // Number of triangles per batch.
+
+            BatchPoints qpoints(integrator,qtable,batch);
+            std::vector<double> values(batch*qtable.nb_points);
+            for (unsigned b=first; b<end; b+=batch) {
+                const unsigned last = std::min(b+batch,end);
+                qpoints.set(triangle1,b,last);
+                analyS.f(qpoints.size(),qpoints.x,qpoints.y,qpoints.z,values.data());
+                for (unsigned t=b; t<last; ++t) {
+                    double result = 0.0;
+                    for (unsigned i=qpoints.begin(t-b); i<qpoints.end(t-b); ++i)
+                        result += qpoints.weights[i]*values[i];
+                    matrix(triangle1.index(),triangles2[t].index()) = result*coeff;
+                }
+            }
         }
 
-        // This function assumes that the two meshes are different.
+        // Operator D between the triangles [first,end[ of qtable and triangle2.
 
         template <typename T>
-        static double N(const Vertex& V1,const Vertex& V2,const Mesh& m1,const Mesh& m2,const T& matrix) {
-            const double coeff = (V1==V2) ? 0.5 : 0.25;
-            return N(coeff,V1,V2,m1,m2,matrix);
+        void D(const Triangle& triangle2,const QuadratureTable& qtable,const unsigned first,const unsigned end,
+               const double coeff,T& mat) const
+        {
+            const Triangles&  triangles1 = qtable.triangles;
+            const analyticD3 analyD(triangle2);
+
+            if (!integrator.fixed_rule()) {
+                const auto& Dfunc = [&analyD](const Vect3& r) { return analyD.f(r); };
+                for (unsigned t=first; t<end; ++t) {
+                    const Vect3& total = integrator.integrate(Dfunc,qtable,triangles1[t],triangle2);
+                    for (unsigned i=0; i<3; ++i)
+                        mat(triangles1[t].index(),triangle2.vertex(i).index()) += total(i)*coeff;
+                }
+                return;
+            }
+
+            constexpr unsigned batch = 32; // Number of triangles per batch.
+
+            BatchPoints qpoints(integrator,qtable,batch);
+            std::vector<double> values(3*batch*qtable.nb_points);
+            for (unsigned b=first; b<end; b+=batch) {
+                const unsigned last = std::min(b+batch,end);
+                qpoints.set(triangle2,b,last);
+                const unsigned size = qpoints.size();
+                analyD.f(size,qpoints.x,qpoints.y,qpoints.z,&values[0],&values[size],&values[2*size]);
+                for (unsigned t=b; t<last; ++t) {
+                    Vect3 total(0.0);
+                    for (unsigned i=qpoints.begin(t-b); i<qpoints.end(t-b); ++i)
+                        total += qpoints.weights[i]*Vect3(values[i],values[size+i],values[2*size+i]);
+                    for (unsigned i=0; i<3; ++i)
+                        mat(triangles1[t].index(),triangle2.vertex(i).index()) += total(i)*coeff;
+                }
+            }
         }
 
-    private:
+        // Operators S between triangle1 and the triangles [first,end[ of qtable, and D between these same triangles and
+        // triangle1, when the integrator is a fixed quadrature rule. Both integrate the inner integrals over triangle1 at
+        // the quadrature points of qtable, which are evaluated together (see analyticSD::f).
 
         template <typename T>
-        static double N(const double factor,const Vertex& V1,const Vertex& V2,const Mesh& m1,const Mesh& m2,const T& matrix) {
-
-            double result = 0.0;
-            for (const auto& tp1 : m1.triangles(V1)) {
-                const Edge& edge1 = tp1->edge(V1);
-                const Vect3& CB1 = edge1.vertex(0)-edge1.vertex(1);
-                for (const auto& tp2 : m2.triangles(V2)) {
-                    const Edge& edge2 = tp2->edge(V2);
-                    const Vect3& CB2 = edge2.vertex(0)-edge2.vertex(1);
-                    result -= factor*dotprod(CB1,CB2)*matrix(tp1->index(),tp2->index())/(tp1->area()*tp2->area());
+        void SD(const Triangle& triangle1,const QuadratureTable& qtable,const unsigned first,const unsigned end,
+                const double Scoeff,const double Dcoeff,T& matrix) const
+        {
+            constexpr unsigned batch = 32; // Number of triangles per batch.
+
+            const Triangles& triangles2 = qtable.triangles;
+            const analyticSD analySD(triangle1);
+            BatchPoints qpoints(integrator,qtable,batch);
+            std::vector<double> values(4*batch*qtable.nb_points);
+            for (unsigned b=first; b<end; b+=batch) {
+                const unsigned last = std::min(b+batch,end);
+                qpoints.set(triangle1,b,last);
+                const unsigned size = qpoints.size();
+                analySD.f(size,qpoints.x,qpoints.y,qpoints.z,&values[0],&values[size],&values[2*size],&values[3*size]);
+                for (unsigned t=b; t<last; ++t) {
+                    double result = 0.0;
+                    Vect3  total(0.0);
+                    for (unsigned i=qpoints.begin(t-b); i<qpoints.end(t-b); ++i) {
+                        result += qpoints.weights[i]*values[i];
+                        total  += qpoints.weights[i]*Vect3(values[size+i],values[2*size+i],values[3*size+i]);
+                    }
+                    matrix(triangle1.index(),triangles2[t].index()) = result*Scoeff;
+                    for (unsigned i=0; i<3; ++i)
+                        matrix(triangles2[t].index(),triangle1.vertex(i).index()) += total(i)*Dcoeff;
                 }
             }
-            return result;
         }
 
+        // Operator D between two meshes (as sets of triangles). The entries (triangle1,vertex of triangle2) accumulate
+        // the contributions of all the triangles2 sharing the vertex, so the work is split into tiles of triangles1.
+
+        template <typename T>
+        void D(const Triangles& triangles1,const Triangles& triangles2,const double coeff,T& mat) const {
+            const QuadratureTable& qtable = table(triangles1);
+            Details::tiled(Details::tiles(triangles1.size()),[&](const unsigned first,const unsigned last) {
+                for (const auto& triangle2 : triangles2)
+                    D(triangle2,qtable,first,last,coeff,mat);
+            });
+        }
+
+        // Operator N between the P1 functions of m1 and m2, obtained from the block S between their triangles.
+        // The surface curl of the P1 function of a vertex V on a triangle T containing V is CB/|T|, where CB is the edge
+        // of T opposite to V (see Mesh::Incidence). With C1 and C2 the (sparse) matrices of these curls, N=-factor*C1'*S*C2
+        // (factor is 0.5 for the pairs of identical vertices of distinct meshes and 0.25 otherwise). The product is
+        // computed by columns: the column of S*C2 associated to a vertex of m2 combines the (few) columns of S of its
+        // triangles, and the entries of N are then combinations of the (few) lines of this column given by the
+        // vertices of m1. For the block of a mesh with itself (symmetric), only the lower half is computed.
+
+        template <typename T1,typename T2>
+        void N(const Mesh& m1,const Mesh& m2,const bool symmetric,const double coeff,const T1& S,T2& matrix) const {
+            const Triangles&    triangles1 = m1.triangles();
+            const VerticesRefs& vertices1  = m1.vertices();
+            const VerticesRefs& vertices2  = m2.vertices();
+            const unsigned      n1         = triangles1.size();
+
+            std::vector<unsigned> indices1(n1);
+            for (unsigned i=0; i<n1; ++i)
+                indices1[i] = triangles1[i].index();
+
+            const auto& cost = [&](const unsigned j) { return n1+((symmetric) ? vertices1.size()-j : vertices1.size()); };
+            Details::tiled(Details::tiles(vertices2.size(),cost,1),[&](const unsigned first,const unsigned last) {
+                std::vector<Vect3> SC(n1);
+                for (unsigned j=first; j<last; ++j) {
+                    const Vertex& V2 = *vertices2[j];
+
+                    // Column of S*C2 associated to V2, divided by the areas of the triangles of m1.
+
+                    std::fill(SC.begin(),SC.end(),Vect3(0.0));
+                    for (const auto& incidence2 : m2.incidences(V2)) {
+                        const Triangle& triangle2 = *incidence2.triangle;
+                        const Vect3&    curl      = incidence2.edge/triangle2.area();
+                        for (unsigned i=0; i<n1; ++i)
+                            SC[i] += S(indices1[i],triangle2.index())*curl;
+                    }
+                    for (unsigned i=0; i<n1; ++i)
+                        SC[i] /= triangles1[i].area();
+
+                    for (unsigned i=(symmetric) ? j : 0; i<vertices1.size(); ++i) {
+                        const Vertex& V1 = *vertices1[i];
+                        double result = 0.0;
+                        for (const auto& incidence1 : m1.incidences(V1))
+                            result += dotprod(incidence1.edge,SC[incidence1.triangle-triangles1.data()]);
+                        const double factor = (!symmetric && V1==V2) ? 0.5 : 0.25;
+                        matrix(V1.index(),V2.index()) -= factor*coeff*result;
+                    }
+                }
+            });
+        }
+
+    private:
+
     protected:
 
         const Integrator integrator;
+
+    private:
+
+        std::shared_ptr<QuadratureTables> tables;
     };
 
     class DiagonalBlock: public BlocksBase {
@@ -170,7 +472,9 @@ namespace OpenMEEG {
 
     public:
 
-        DiagonalBlock(const Mesh& m,const Integrator& intg): base(intg),mesh(m) { }
+        DiagonalBlock(const Mesh& m,const Integrator& intg,const std::shared_ptr<QuadratureTables>& qtables=nullptr):
+            base(intg,qtables),mesh(m)
+        { }
 
         template <typename T>
         void set_S_block(const double coeff,T& matrix) {
@@ -192,6 +496,37 @@ namespace OpenMEEG {
         template <typename T>
         void set_Dstar_block(const double /* coeff */,T& /* matrix */) const { }
 
+        // Blocks S and D (D* is included in D), computed together when the integrator is a fixed quadrature rule.
+
+        template <typename T>
+        void set_SD_blocks(const double SCondCoeff,const double DCondCoeff,T& matrix) {
+            if (mesh.current_barrier())
+                return;
+
+            if (!base::integrator.fixed_rule()) {
+                set_S_block(SCondCoeff,matrix);
+                set_D_block(DCondCoeff,matrix);
+                return;
+            }
+
+            base::message("S+D",mesh,mesh);
+            const Triangles& triangles = mesh.triangles();
+            const QuadratureTable& qtable = base::table(triangles);
+
+            // The work is split into tiles of quadrature triangles (all the entries of a D row are then computed by the
+            // same tile). For each triangle1, S is computed for the triangles following it (the block is symmetric) and
+            // the D terms associated to these triangles are obtained along. The remaining D terms are computed separately.
+
+            Details::tiled(Details::tiles(triangles.size()),[&](const unsigned first,const unsigned last) {
+                for (unsigned i1=0; i1<triangles.size(); ++i1) {
+                    const unsigned middle = std::clamp(i1,first,last);
+                    base::D(triangles[i1],qtable,first,middle,DCondCoeff,matrix);
+                    base::SD(triangles[i1],qtable,middle,last,SCondCoeff,DCondCoeff,matrix);
+                }
+            });
+            Scoeff = SCondCoeff;
+        }
+
         template <typename T>
         void addIdentity(const double coeff,T& matrix) const {
             // The Matrix is incremented by the identity P1P0 operator
@@ -204,32 +539,19 @@ namespace OpenMEEG {
         template <typename T>
         void S(const double coeff,T& matrix) const {
             base::message("S",mesh,mesh);
-            ProgressBar pb(mesh.triangles().size());
 
             // Operator S is given by Sij=\Int G*PSI(I,i)*Psi(J,j) with PSI(l,t) a P0 test function on layer l and triangle t.
-            // When meshes are equal, optimized computation for a symmetric matrix.
+            // When meshes are equal, optimized computation for a symmetric matrix: only the triangles1 preceding a
+            // triangle2 are considered, so the tiles of triangles2 are balanced with a cost growing with the index.
 
-            ThreadException e;
-            const Triangles& triangles = mesh.triangles();
-            for (Triangles::const_iterator tit1=triangles.begin(); tit1!=triangles.end(); ++tit1,++pb) {
-                const Triangle& triangle1 = *tit1;
-                const analyticS analyS(triangle1);
-                const auto& Sfunc = [&analyS](const Vect3& r) { return analyS.f(r); };
+            const Triangles&       triangles = mesh.triangles();
+            const QuadratureTable& qtable    = base::table(triangles);
 
-                #pragma omp parallel for
-                #if defined NO_OPENMP || defined OPENMP_ITERATOR
-                for (Triangles::const_iterator tit2=tit1; tit2!=triangles.end(); ++tit2) {
-                    const Triangle& triangle2 = *tit2;
-                #else
-                for (int i2=tit1-triangles.begin(); i2<static_cast<int>(triangles.size()); ++i2) {
-                    const Triangle& triangle2 = *(triangles.begin()+i2);
-                #endif
-                    e.Run([&](){
-                        matrix(triangle1.index(),triangle2.index()) = base::integrator.integrate(Sfunc,triangle2)*coeff;
-                    });
-                }
-                e.Rethrow();
-            }
+            const auto& cost = [](const unsigned i) { return i+1.0; };
+            Details::tiled(Details::tiles(triangles.size(),cost),[&](const unsigned first,const unsigned last) {
+                for (unsigned i1=0; i1<last; ++i1)
+                    base::S(triangles[i1],qtable,std::max(i1,first),last,coeff,matrix);
+            });
         }
 
         template <typename T>
@@ -266,29 +588,8 @@ namespace OpenMEEG {
 
         template <typename T1,typename T2>
         void N(const double coeff,const T1& S,T2& matrix) const {
-
             base::message("N",mesh,mesh);
-
-            ThreadException e;
-            ProgressBar pb(mesh.vertices().size());
-
-            // When meshes are equal, optimized computation for a symmetric matrix.
-
-            for (auto vit1=mesh.vertices().begin(); vit1!=mesh.vertices().end(); ++vit1) {
-                #pragma omp parallel for
-                #if defined NO_OPENMP || defined OPENMP_ITERATOR
-                for (auto vit2=vit1; vit2<mesh.vertices().end(); ++vit2) {
-                #else
-                for (int i2=0;i2<=vit1-mesh.vertices().begin();++i2) {
-                    const auto vit2 = mesh.vertices().begin()+i2;
-                #endif
-                    e.Run([&](){
-                        matrix((*vit1)->index(),(*vit2)->index()) += base::N(**vit1,**vit2,mesh,S)*coeff;
-                    });
-                }
-                e.Rethrow();
-                ++pb;
-            }
+            base::N(mesh,mesh,true,coeff,S,matrix);
         }
 
         const Mesh&  mesh;
@@ -352,9 +653,12 @@ namespace OpenMEEG {
         // This constructor takes the following arguments:
         //  - The 2 interacting meshes.
         //  - The gauss order parameter (for adaptive integration).
-        //  - A verbosity parameters (for printing the action on the terminal).
+        //  - The hierarchical compression parameters (only used by the compressed blocks).
 
-        NonDiagonalBlock(const Mesh& m1,const Mesh& m2,const Integrator& intg): base(intg),mesh1(m1),mesh2(m2) { }
+        NonDiagonalBlock(const Mesh& m1,const Mesh& m2,const Integrator& intg,const HMatrixParameters& hparams=HMatrixParameters(),
+                         const std::shared_ptr<QuadratureTables>& qtables=nullptr):
+            base(intg,qtables),mesh1(m1),mesh2(m2),compression(hparams)
+        { }
 
         template <typename T>
         void set_S_block(const double coeff,T& matrix) {
@@ -379,6 +683,28 @@ namespace OpenMEEG {
                 Dstar(coeff,matrix);
         }
 
+        // Blocks S, D and D*. S and D* are computed together when both are needed and the integrator is a fixed quadrature
+        // rule.
+
+        template <typename T>
+        void set_SD_blocks(const double SCondCoeff,const double DCondCoeff,T& matrix) {
+            const bool S_needed     = !mesh1.current_barrier() && !mesh2.current_barrier();
+            const bool Dstar_needed = mesh1!=mesh2 && !mesh2.current_barrier();
+            if (S_needed && Dstar_needed && base::integrator.fixed_rule()) {
+                base::message("S+D*",mesh1,mesh2);
+                const QuadratureTable& qtable = base::table(mesh2.triangles());
+                Details::tiled(Details::tiles(mesh2.triangles().size()),[&](const unsigned first,const unsigned last) {
+                    for (const auto& triangle1 : mesh1.triangles())
+                        base::SD(triangle1,qtable,first,last,SCondCoeff,DCondCoeff,matrix);
+                });
+                Scoeff = SCondCoeff;
+            } else {
+                set_S_block(SCondCoeff,matrix);
+                set_Dstar_block(DCondCoeff,matrix);
+            }
+            set_D_block(DCondCoeff,matrix);
+        }
+
         // Various operators take the following arguments:
         //  - The coefficient to be applied to each matrix element (depending on conductivities, ...)
         //  - The storage Matrix for the result
@@ -386,8 +712,8 @@ namespace OpenMEEG {
         template <typename T>
         void S(const double coeff,T& matrix) const {
             base::message("S",mesh1,mesh2);
-            ThreadException e;
-            ProgressBar pb(mesh1.triangles().size());
+
+            const QuadratureTable& qtable = base::table(mesh2.triangles());
 
             // Operator S is given by Sij=\Int G*PSI(I,i)*Psi(J,j) with PSI(l,t) a P0 test function on layer l and triangle t.
 
@@ -395,29 +721,10 @@ namespace OpenMEEG {
             // if we invert tit1 with tit2: results in HeadMat differs at 4.e-5 which is too big.
             // using ADAPT_LHS with tolerance at 0.000005 (for S) drops this at 6.e-6 (but increase the computation time).
 
-            for (const auto& triangle1 : mesh1.triangles()) {
-
-                const analyticS analyS(triangle1);
-                const auto& Sfunc = [&analyS](const Vect3& r) { return analyS.f(r); };
-
-                const Triangles& m2_triangles = mesh2.triangles();
-                #pragma omp parallel for
-                #if defined NO_OPENMP || defined OPENMP_RANGEFOR
-                for (const auto& triangle2 : m2_triangles) {
-                #elif defined OPENMP_ITERATOR
-                for (Triangles::const_iterator tit2=m2_triangles.begin();tit2<m2_triangles.end();++tit2) {
-                    const Triangle& triangle2 = *tit2;
-                #else
-                for (int i2=0;i2<static_cast<int>(m2_triangles.size());++i2) {
-                    const Triangle& triangle2 = *(m2_triangles.begin()+i2);
-                #endif
-                    e.Run([&](){
-                        matrix(triangle1.index(),triangle2.index()) = base::integrator.integrate(Sfunc,triangle2)*coeff;
-                    });
-                }
-                e.Rethrow();
-                ++pb;
-            }
+            Details::tiled(Details::tiles(mesh2.triangles().size()),[&](const unsigned first,const unsigned last) {
+                for (const auto& triangle1 : mesh1.triangles())
+                    base::S(triangle1,qtable,first,last,coeff,matrix);
+            });
         }
 
         template <typename T>
@@ -443,41 +750,135 @@ namespace OpenMEEG {
             base::D(mesh2.triangles(),mesh1.triangles(),coeff,matrix);
         }
 
+        // Blocks S (triangles of mesh1 x triangles of mesh2), D (triangles of mesh1 x vertices of mesh2) and D* (triangles
+        // of mesh2 x vertices of mesh1) with unit coefficients, as hierarchical matrices whose elements are the positions
+        // of the triangles and vertices in their meshes. Their entries are those of the dense blocks.
+
+        HMatrix compressed_S() const {
+            base::message("S (compressed)",mesh1,mesh2);
+            const Triangles&       triangles1 = mesh1.triangles();
+            const QuadratureTable& qtable     = base::table(mesh2.triangles());
+            const auto& entries = [&](const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) {
+                BatchPoints qpoints(base::integrator,qtable,cols.size());
+                std::vector<double> kernel(cols.size()*qtable.nb_points);
+                for (unsigned i=0; i<rows.size(); ++i) {
+                    const Triangle& triangle1 = triangles1[rows[i]];
+                    const analyticS analyS(triangle1);
+                    if (!base::integrator.fixed_rule()) {
+                        const auto& Sfunc = [&analyS](const Vect3& r) { return analyS.f(r); };
+                        for (unsigned j=0; j<cols.size(); ++j)
+                            values(i,j) = base::integrator.integrate(Sfunc,qtable,qtable.triangles[cols[j]],triangle1);
+                        continue;
+                    }
+                    qpoints.set(triangle1,cols);
+                    analyS.f(qpoints.size(),qpoints.x,qpoints.y,qpoints.z,kernel.data());
+                    for (unsigned j=0; j<cols.size(); ++j) {
+                        double result = 0.0;
+                        for (unsigned k=qpoints.begin(j); k<qpoints.end(j); ++k)
+                            result += qpoints.weights[k]*kernel[k];
+                        values(i,j) = result;
+                    }
+                }
+            };
+            return compress(triangle_supports(mesh1),triangle_supports(mesh2),entries);
+        }
+
+        HMatrix compressed_D()     const { base::message("D (compressed)",mesh1,mesh2);  return compressed_D(mesh1,mesh2); }
+        HMatrix compressed_Dstar() const { base::message("D* (compressed)",mesh1,mesh2); return compressed_D(mesh2,mesh1); }
+
     private:
 
         bool S_block_is_computed() const { return Scoeff!=0.0; }
 
-        template <typename T1,typename T2>
-        void N(const double coeff,const T1& S,T2& matrix) const {
+        // Helpers for the hierarchical compression of the blocks.
+        // The support of a P0 function is its triangle, the support of a P1 function is the union of the triangles
+        // sharing its vertex.
 
-            base::message("N",mesh1,mesh2);
+        static std::vector<BoundingBox> triangle_supports(const Mesh& m) {
+            std::vector<BoundingBox> supports(m.triangles().size());
+            for (unsigned i=0; i<m.triangles().size(); ++i)
+                for (const auto& vertex : m.triangles()[i])
+                    supports[i].add(vertex);
+            return supports;
+        }
 
-            ThreadException e;
-            ProgressBar pb(mesh1.vertices().size());
-            const VerticesRefs& m2_vertices = mesh2.vertices();
-            for (const auto& vertex1 : mesh1.vertices()) {
-                #pragma omp parallel for
-                #if defined NO_OPENMP || defined OPENMP_RANGEFOR
-                for (const auto& vertex2 : m2_vertices) {
-                #elif defined OPENMP_ITERATOR
-                for (auto vit2=m2_vertices.begin(); vit2<m2_vertices.end(); ++vit2) {
-                    const Vertex* vertex2 = *vit2;
-                #else
-                for (int i2=0; i2<static_cast<int>(m2_vertices.size()); ++i2) {
-                    const Vertex* vertex2 = *(m2_vertices.begin()+i2);
-                #endif
-                    e.Run([&](){
-                        matrix(vertex1->index(),vertex2->index()) += base::N(*vertex1,*vertex2,mesh1,mesh2,S)*coeff;
-                    });
+        static std::vector<BoundingBox> vertex_supports(const Mesh& m) {
+            std::vector<BoundingBox> supports(m.vertices().size());
+            for (unsigned i=0; i<m.vertices().size(); ++i)
+                for (const auto& incidence : m.incidences(*m.vertices()[i]))
+                    for (const auto& vertex : *incidence.triangle)
+                        supports[i].add(vertex);
+            return supports;
+        }
+
+        HMatrix compress(const std::vector<BoundingBox>& rsupports,const std::vector<BoundingBox>& csupports,const HMatrix::Entries& entries) const {
+            const HMatrix H(ClusterTree(rsupports,compression.leaf_size),ClusterTree(csupports,compression.leaf_size),entries,compression);
+            log_stream(INFORMATION) << "    compressed block (ratio " << H.compression_ratio() << ")" << std::endl;
+            return H;
+        }
+
+        // Operator D between the P0 functions of m1 and the P1 functions of m2, computed with a hierarchical matrix.
+        // An entry gathers the contributions of all the triangles of m2 sharing the vertex: the kernel of each of the
+        // triangles of the requested vertices is evaluated once at the quadrature points of all the requested triangles
+        // of m1.
+
+        HMatrix compressed_D(const Mesh& m1,const Mesh& m2) const {
+            const VerticesRefs&    vertices2 = m2.vertices();
+            const QuadratureTable& qtable    = base::table(m1.triangles());
+            const auto& entries = [&](const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) {
+                values.set(0.0);
+                std::map<const Vertex*,unsigned> columns;
+                for (unsigned j=0; j<cols.size(); ++j)
+                    columns[vertices2[cols[j]]] = j;
+
+                std::vector<const Triangle*> triangles2;
+                for (const unsigned j : cols)
+                    for (const auto& incidence : m2.incidences(*vertices2[j]))
+                        triangles2.push_back(incidence.triangle);
+                std::sort(triangles2.begin(),triangles2.end());
+                triangles2.erase(std::unique(triangles2.begin(),triangles2.end()),triangles2.end());
+
+                BatchPoints qpoints(base::integrator,qtable,rows.size());
+                std::vector<double> kernel(3*rows.size()*qtable.nb_points);
+                std::vector<Vect3>  totals(rows.size());
+                for (const Triangle* triangle2 : triangles2) {
+                    const analyticD3 analyD(*triangle2);
+                    if (base::integrator.fixed_rule()) {
+                        qpoints.set(*triangle2,rows);
+                        const unsigned size = qpoints.size();
+                        analyD.f(size,qpoints.x,qpoints.y,qpoints.z,&kernel[0],&kernel[size],&kernel[2*size]);
+                        for (unsigned i=0; i<rows.size(); ++i) {
+                            totals[i] = Vect3(0.0);
+                            for (unsigned p=qpoints.begin(i); p<qpoints.end(i); ++p)
+                                totals[i] += qpoints.weights[p]*Vect3(kernel[p],kernel[size+p],kernel[2*size+p]);
+                        }
+                    } else {
+                        const auto& Dfunc = [&analyD](const Vect3& r) { return analyD.f(r); };
+                        for (unsigned i=0; i<rows.size(); ++i)
+                            totals[i] = base::integrator.integrate(Dfunc,qtable,qtable.triangles[rows[i]],*triangle2);
+                    }
+
+                    for (unsigned k=0; k<3; ++k) {
+                        const auto it = columns.find(&triangle2->vertex(k));
+                        if (it!=columns.end())
+                            for (unsigned i=0; i<rows.size(); ++i)
+                                values(i,it->second) += totals[i](k);
+                    }
                 }
-                e.Rethrow();
-                ++pb;
-            }
+            };
+            return compress(triangle_supports(m1),vertex_supports(m2),entries);
         }
 
-        const Mesh&  mesh1;
-        const Mesh&  mesh2;
-              double Scoeff = 0.0;
+        template <typename T1,typename T2>
+        void N(const double coeff,const T1& S,T2& matrix) const {
+            base::message("N",mesh1,mesh2);
+            base::N(mesh1,mesh2,false,coeff,S,matrix);
+        }
+
+        const Mesh&             mesh1;
+        const Mesh&             mesh2;
+        const HMatrixParameters compression;
+              double            Scoeff = 0.0;
     };
 
     template <typename BlockType>
@@ -514,10 +915,8 @@ namespace OpenMEEG {
             const double SCondCoeff = coeffs[0];
             const double NCondCoeff = coeffs[1];
             const double DCondCoeff = coeffs[2];
-            block.set_S_block(SCondCoeff,matrix);
+            block.set_SD_blocks(SCondCoeff,DCondCoeff,matrix);
             block.set_N_block(NCondCoeff,matrix);
-            block.set_D_block(DCondCoeff,matrix);
-            block.set_Dstar_block(DCondCoeff,matrix);
         }
 
     private:
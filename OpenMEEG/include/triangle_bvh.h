@@ -0,0 +1,100 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <utility>
+
+#include <om_common.h>
+#include <vect3.h>
+#include <triangle.h>
+#include <boundingbox.h>
+
+namespace OpenMEEG {
+
+    class Mesh;
+    class Interface;
+
+    /// \brief Bounding volume hierarchy of the triangles of an interface (or a mesh), for closest triangle, solid angle
+    /// and intersection queries.
+    ///
+    /// The triangles are recursively split in two halves along the largest extent of their centers, and each node of the
+    /// tree stores the bounding box of its triangles. A query visits the nodes closest box first and skips the nodes whose
+    /// box is farther than the closest triangle found so far, so that only a few triangles are examined instead of all
+    /// of them. Each node also stores the dipole moment of its (oriented) triangles, which approximates their solid
+    /// angle seen from far enough points. Queries are const and can be done concurrently. The tree refers to the
+    /// triangles of the meshes, which must not be modified while it is in use. It records the revisions of the meshes
+    /// it was built from, and Interface::triangle_bvh rebuilds it when they are updated.
+
+    class OPENMEEG_EXPORT TriangleBVH {
+    public:
+
+        explicit TriangleBVH(const Interface& interface);
+        explicit TriangleBVH(const Mesh& mesh);
+
+        /// \return the distance from p to the closest triangle, this triangle and its mesh. alphas are the barycentric
+        /// coordinates of the closest point of the triangle. In case of ties, the result is the first of the closest
+        /// triangles in the order of the meshes of the interface (as for an exhaustive search).
+
+        std::tuple<double,const Triangle&,const Mesh&> closest(const Vect3& p,Vect3& alphas) const;
+
+        /// \return an approximation of the solid angle of the interface seen from p. The triangles close to p are
+        /// summed exactly (as in Interface::solid_angle), while the groups of triangles which are far from p compared
+        /// to their size are replaced by the first two terms of the Taylor expansion of their solid angle. error_bound
+        /// is set to an upper bound of the error of the approximation (the sum of the remainders of these expansions).
+
+        double solid_angle(const Vect3& p,double& error_bound) const;
+        double solid_angle(const Vect3& p) const { double error_bound; return solid_angle(p,error_bound); }
+
+        /// Appends to triangles those whose bounding box intersects box (in the order of the interface).
+
+        void overlapping(const BoundingBox& box,std::vector<const Triangle*>& triangles) const;
+
+        /// \return false if one of the meshes has been updated (vertices moved or orientation changed) since the tree
+        /// was built.
+
+        bool up_to_date() const;
+
+    private:
+
+        struct Element {
+            const Triangle* triangle;
+            const Mesh*     mesh;
+            int             orientation;
+            unsigned        rank;  ///< Position of the triangle in the interface (to break ties).
+        };
+
+        /// The children of an internal node are the next node and the node right. A leaf contains the elements
+        /// [first,last[. The moment (sum of the oriented area vectors of the triangles) is located at center, and
+        /// radius is the distance from center to the farthest vertex. spread(k,l) is the sum over the triangles of the
+        /// k-th coordinate of their center (relative to center) times the l-th one of their oriented area vector, area
+        /// is the sum of their (unsigned) areas and second the integral over them of the squared distance to center.
+
+        struct Node {
+            BoundingBox box;
+            unsigned    first;
+            unsigned    last;
+            unsigned    right = 0;
+            Vect3       center;
+            Vect3       moment;
+            double      spread[3][3];
+            double      area;
+            double      second;
+            double      radius;
+        };
+
+        void add(const Mesh& mesh,const int orientation);
+        void build();
+        void build(const std::vector<Vect3>& centers,const unsigned first,const unsigned last);
+
+        std::vector<Element> elements;
+        std::vector<Node>    nodes;
+        std::vector<std::pair<const Mesh*,unsigned>> revisions;
+    };
+}
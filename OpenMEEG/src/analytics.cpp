@@ -0,0 +1,448 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#include <analytics.h>
+
+//  Batched (SIMD) versions of the analytical kernels.
+//  The kernels are written as simple loops over points stored as structures of arrays and are vectorized by the
+//  compiler. The same source is compiled for several instruction sets and the widest one supported by the processor
+//  is selected at runtime. Since the standard log and atan2 functions are not vectorizable, branch free versions of
+//  them accurate to a few ulps are provided. This file must be compiled with -fno-math-errno -fno-trapping-math for
+//  the loops to be vectorized (these options do not change the computed values).
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define OPENMEEG_X86_DISPATCH
+#define OPENMEEG_TARGET(ISA) __attribute__((target(ISA)))
+#endif
+
+//  The kernels must be inlined in the instruction set specific functions to be compiled for those.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+namespace OpenMEEG {
+
+    namespace {
+
+        KERNEL_INLINE double as_double(const std::uint64_t u) { double d; std::memcpy(&d,&u,sizeof d); return d; }
+        KERNEL_INLINE std::uint64_t as_uint(const double d)   { std::uint64_t u; std::memcpy(&u,&d,sizeof u); return u; }
+
+        //  log(x) = e*log(2)+log(m) with x = m*2^e and m in [sqrt(2)/2,sqrt(2)[.
+        //  log(m) = 2*atanh(f) with f = (m-1)/(m+1) is computed with its series (|f|<0.172).
+
+        KERNEL_INLINE double simd_log(const double x) {
+            const std::uint64_t bits = as_uint(x);
+            const double m0  = as_double((bits&0x000fffffffffffffULL)|0x3ff0000000000000ULL);
+            const double big = (m0>M_SQRT2) ? 1.0 : 0.0;
+            const double e   = as_double((bits>>52)|0x4330000000000000ULL)-4503599627370496.0-1023.0+big;
+            const double m   = m0*(1.0-0.5*big);
+            const double f   = (m-1.0)/(m+1.0);
+            const double s   = f*f;
+
+            double p = 1.0/25;
+            p = p*s+1.0/23; p = p*s+1.0/21; p = p*s+1.0/19; p = p*s+1.0/17; p = p*s+1.0/15; p = p*s+1.0/13;
+            p = p*s+1.0/11; p = p*s+1.0/9;  p = p*s+1.0/7;  p = p*s+1.0/5;  p = p*s+1.0/3;
+
+            constexpr double ln2_hi = 6.93147180369123816490e-01;
+            constexpr double ln2_lo = 1.90821492927058770002e-10;
+            const double res = e*ln2_hi+((2.0*f+2.0*f*s*p)+e*ln2_lo);
+
+            //  Special values (0, negative, infinite or nan arguments).
+
+            const double special = (x==0.0) ? -HUGE_VAL : ((x>0.0) ? x : std::numeric_limits<double>::quiet_NaN());
+            return (x>0.0 && x<=std::numeric_limits<double>::max()) ? res : special;
+        }
+
+        //  atan(t) for t in [0,1] (rational approximation from the Cephes library).
+
+        KERNEL_INLINE double simd_atan01(const double t) {
+            const bool   big = t>0.66;
+            const double u   = big ? (t-1.0)/(t+1.0) : t;
+            const double z   = u*u;
+            const double P = (((-8.750608600031904122785e-1*z-1.615753718733365076637e1)*z-7.500855792314704667340e1)*z
+                              -1.228866684490136173410e2)*z-6.485021904942025371773e1;
+            const double Q = ((((z+2.485846490142306297962e1)*z+1.650270098316988542046e2)*z+4.328810604912902668951e2)*z
+                              +4.853903996359136964868e2)*z+1.945506571482613964425e2;
+            const double r = u+u*z*P/Q;
+            return big ? M_PI_4+(r+0.5*6.123233995736765886130e-17) : r;
+        }
+
+        KERNEL_INLINE double simd_atan2(const double y,const double x) {
+            const double ax   = std::fabs(x);
+            const double ay   = std::fabs(y);
+            const bool   swap = ay>ax;
+            const double num  = swap ? ax : ay;
+            const double den  = swap ? ay : ax;
+            double a = simd_atan01((den==0.0) ? 0.0 : num/den);
+            a = swap ? M_PI_2-a : a;
+            a = (x<0.0) ? M_PI-a : a;
+            return std::copysign(a,y);
+        }
+
+        KERNEL_INLINE double dot(const double a[3],const double bx,const double by,const double bz) { return a[0]*bx+a[1]*by+a[2]*bz; }
+
+        // Plain copy of the data of analyticS.
+
+        struct SData {
+            double p0[3], p1[3], p2[3];
+            double p1p0[3], p2p1[3], p0p2[3];
+            double nu0[3], nu1[3], nu2[3];
+            double n[3];
+            double norm2p1p0, norm2p2p1, norm2p0p2;
+        };
+
+        KERNEL_INLINE double green(const double p0x,const double p0y,const double p0z,const double norm2p0x,
+                            const double p1x,const double p1y,const double p1z,const double norm2p1x,
+                            const double p1p0[3],const double norm2p1p0)
+        {
+            // Same as integral_simplified_green.
+
+            const double arg = (norm2p0x*norm2p1p0-dot(p1p0,p0x,p0y,p0z))/(norm2p1x*norm2p1p0-dot(p1p0,p1x,p1y,p1z));
+            const bool   ok  = arg>=std::numeric_limits<double>::min() && arg<=std::numeric_limits<double>::max();
+            const double l   = simd_log(ok ? arg : norm2p1x/norm2p0x);
+            return ok ? l : std::fabs(l);
+        }
+
+        KERNEL_INLINE void S_kernel(const SData& s,const std::size_t n,const double* x,const double* y,const double* z,double* results) {
+            #pragma omp simd
+            for (std::size_t i=0; i<n; ++i) {
+                const double p0x = s.p0[0]-x[i];
+                const double p0y = s.p0[1]-y[i];
+                const double p0z = s.p0[2]-z[i];
+                const double p1x = s.p1[0]-x[i];
+                const double p1y = s.p1[1]-y[i];
+                const double p1z = s.p1[2]-z[i];
+                const double p2x = s.p2[0]-x[i];
+                const double p2y = s.p2[1]-y[i];
+                const double p2z = s.p2[2]-z[i];
+                const double norm2p0x = std::sqrt(p0x*p0x+p0y*p0y+p0z*p0z);
+                const double norm2p1x = std::sqrt(p1x*p1x+p1y*p1y+p1z*p1z);
+                const double norm2p2x = std::sqrt(p2x*p2x+p2y*p2y+p2z*p2z);
+
+                const double g0 = green(p0x,p0y,p0z,norm2p0x,p1x,p1y,p1z,norm2p1x,s.p1p0,s.norm2p1p0);
+                const double g1 = green(p1x,p1y,p1z,norm2p1x,p2x,p2y,p2z,norm2p2x,s.p2p1,s.norm2p2p1);
+                const double g2 = green(p2x,p2y,p2z,norm2p2x,p0x,p0y,p0z,norm2p0x,s.p0p2,s.norm2p0p2);
+
+                const double alpha = dot(s.n,p0x,p0y,p0z);
+
+                //  Solid angle (see Vect3::solid_angle).
+
+                const double d = p0x*(p1y*p2z-p1z*p2y)+p0y*(p1z*p2x-p1x*p2z)+p0z*(p1x*p2y-p1y*p2x);
+                const double den = norm2p0x*norm2p1x*norm2p2x+norm2p0x*(p1x*p2x+p1y*p2y+p1z*p2z)
+                                  +norm2p1x*(p2x*p0x+p2y*p0y+p2z*p0z)+norm2p2x*(p0x*p1x+p0y*p1y+p0z*p1z);
+                const double omega = (std::fabs(d)<1e-10) ? 0.0 : 2*simd_atan2(d,den);
+
+                results[i] = (dot(s.nu0,p0x,p0y,p0z)*g0+dot(s.nu1,p1x,p1y,p1z)*g1+dot(s.nu2,p2x,p2y,p2z)*g2)-alpha*omega;
+            }
+        }
+
+        // Plain copy of the data of analyticD3.
+
+        struct DData {
+            double v0[3], v1[3], v2[3];
+            double D1[3], D2[3], D3[3];
+            double U1[3], U2[3], U3[3];
+        };
+
+        KERNEL_INLINE void D_kernel(const DData& data,const std::size_t n,const double* x,const double* y,const double* z,
+                                    double* results0,double* results1,double* results2)
+        {
+            const DData s = data; // A local copy helps the vectorizer.
+
+            #pragma omp simd
+            for (std::size_t i=0; i<n; ++i) {
+                const double Y1x = s.v0[0]-x[i];
+                const double Y1y = s.v0[1]-y[i];
+                const double Y1z = s.v0[2]-z[i];
+                const double Y2x = s.v1[0]-x[i];
+                const double Y2y = s.v1[1]-y[i];
+                const double Y2z = s.v1[2]-z[i];
+                const double Y3x = s.v2[0]-x[i];
+                const double Y3y = s.v2[1]-y[i];
+                const double Y3z = s.v2[2]-z[i];
+                const double y1 = std::sqrt(Y1x*Y1x+Y1y*Y1y+Y1z*Y1z);
+                const double y2 = std::sqrt(Y2x*Y2x+Y2y*Y2y+Y2z*Y2z);
+                const double y3 = std::sqrt(Y3x*Y3x+Y3y*Y3y+Y3z*Y3z);
+
+                //  Z1 = Y2^Y3, Z2 = Y3^Y1, Z3 = Y1^Y2 and d = det(Y1,Y2,Y3).
+
+                const double Z1x = Y2y*Y3z-Y2z*Y3y;
+                const double Z1y = Y2z*Y3x-Y2x*Y3z;
+                const double Z1z = Y2x*Y3y-Y2y*Y3x;
+                const double Z2x = Y3y*Y1z-Y3z*Y1y;
+                const double Z2y = Y3z*Y1x-Y3x*Y1z;
+                const double Z2z = Y3x*Y1y-Y3y*Y1x;
+                const double Z3x = Y1y*Y2z-Y1z*Y2y;
+                const double Z3y = Y1z*Y2x-Y1x*Y2z;
+                const double Z3z = Y1x*Y2y-Y1y*Y2x;
+                const double d   = Y1x*Z1x+Y1y*Z1y+Y1z*Z1z;
+
+                const double den = y1*y2*y3+y1*(Y2x*Y3x+Y2y*Y3y+Y2z*Y3z)+y2*(Y3x*Y1x+Y3y*Y1y+Y3z*Y1z)+y3*(Y1x*Y2x+Y1y*Y2y+Y1z*Y2z);
+                const double omega = 2*simd_atan2(d,den);
+
+                const double g1 = simd_log((y2+dot(s.U1,Y2x,Y2y,Y2z))/(y1+dot(s.U1,Y1x,Y1y,Y1z)));
+                const double g2 = simd_log((y3+dot(s.U2,Y3x,Y3y,Y3z))/(y2+dot(s.U2,Y2x,Y2y,Y2z)));
+                const double g3 = simd_log((y1+dot(s.U3,Y1x,Y1y,Y1z))/(y3+dot(s.U3,Y3x,Y3y,Y3z)));
+
+                const double Nx = Z1x+Z2x+Z3x;
+                const double Ny = Z1y+Z2y+Z3y;
+                const double Nz = Z1z+Z2z+Z3z;
+                const double Sx = s.U1[0]*g1+s.U2[0]*g2+s.U3[0]*g3;
+                const double Sy = s.U1[1]*g1+s.U2[1]*g2+s.U3[1]*g3;
+                const double Sz = s.U1[2]*g1+s.U2[2]*g2+s.U3[2]*g3;
+                const double norm2N = Nx*Nx+Ny*Ny+Nz*Nz;
+
+                const bool degenerate = std::fabs(d)<1e-10;
+                results0[i] = degenerate ? 0.0 : (omega*(Z1x*Nx+Z1y*Ny+Z1z*Nz)+d*dot(s.D2,Sx,Sy,Sz))/norm2N;
+                results1[i] = degenerate ? 0.0 : (omega*(Z2x*Nx+Z2y*Ny+Z2z*Nz)+d*dot(s.D3,Sx,Sy,Sz))/norm2N;
+                results2[i] = degenerate ? 0.0 : (omega*(Z3x*Nx+Z3y*Ny+Z3z*Nz)+d*dot(s.D1,Sx,Sy,Sz))/norm2N;
+            }
+        }
+
+        // Data of the fused S and D kernel.
+
+        struct SDData {
+            double v0[3], v1[3], v2[3];
+            double D1[3], D2[3], D3[3];
+            double U1[3], U2[3], U3[3];
+            double nu0[3], nu1[3], nu2[3];
+            double n[3];
+        };
+
+        //  Logarithm associated with the edge (a,b) of unit vector U, with Ya = a-x and Yb = b-x. The expressions used in
+        //  integral_simplified_green and in analyticD3::f are equal (their product with the squared distance from x to
+        //  the edge line are the same). The one without cancellation is selected.
+
+        KERNEL_INLINE double edge_log(const double ya,const double ga,const double yb,const double gb) {
+            const double arg = (ga+gb>=0.0) ? (yb+gb)/(ya+ga) : (ya-ga)/(yb-gb);
+            const bool   ok  = arg>=std::numeric_limits<double>::min() && arg<=std::numeric_limits<double>::max();
+            const double l   = simd_log(ok ? arg : yb/ya);
+            return ok ? l : std::fabs(l);
+        }
+
+        KERNEL_INLINE void SD_kernel(const SDData& data,const std::size_t n,const double* x,const double* y,const double* z,
+                                     double* resultsS,double* resultsD0,double* resultsD1,double* resultsD2)
+        {
+            const SDData s = data; // A local copy helps the vectorizer.
+
+            #pragma omp simd
+            for (std::size_t i=0; i<n; ++i) {
+                const double Y1x = s.v0[0]-x[i];
+                const double Y1y = s.v0[1]-y[i];
+                const double Y1z = s.v0[2]-z[i];
+                const double Y2x = s.v1[0]-x[i];
+                const double Y2y = s.v1[1]-y[i];
+                const double Y2z = s.v1[2]-z[i];
+                const double Y3x = s.v2[0]-x[i];
+                const double Y3y = s.v2[1]-y[i];
+                const double Y3z = s.v2[2]-z[i];
+                const double y1 = std::sqrt(Y1x*Y1x+Y1y*Y1y+Y1z*Y1z);
+                const double y2 = std::sqrt(Y2x*Y2x+Y2y*Y2y+Y2z*Y2z);
+                const double y3 = std::sqrt(Y3x*Y3x+Y3y*Y3y+Y3z*Y3z);
+
+                const double Z1x = Y2y*Y3z-Y2z*Y3y;
+                const double Z1y = Y2z*Y3x-Y2x*Y3z;
+                const double Z1z = Y2x*Y3y-Y2y*Y3x;
+                const double Z2x = Y3y*Y1z-Y3z*Y1y;
+                const double Z2y = Y3z*Y1x-Y3x*Y1z;
+                const double Z2z = Y3x*Y1y-Y3y*Y1x;
+                const double Z3x = Y1y*Y2z-Y1z*Y2y;
+                const double Z3y = Y1z*Y2x-Y1x*Y2z;
+                const double Z3z = Y1x*Y2y-Y1y*Y2x;
+                const double d   = Y1x*Z1x+Y1y*Z1y+Y1z*Z1z;
+
+                //  Shared quantities: solid angle and edge logarithms.
+
+                const bool   degenerate = std::fabs(d)<1e-10;
+                const double den   = y1*y2*y3+y1*(Y2x*Y3x+Y2y*Y3y+Y2z*Y3z)+y2*(Y3x*Y1x+Y3y*Y1y+Y3z*Y1z)+y3*(Y1x*Y2x+Y1y*Y2y+Y1z*Y2z);
+                const double omega = degenerate ? 0.0 : 2*simd_atan2(d,den);
+
+                const double g1 = edge_log(y1,dot(s.U1,Y1x,Y1y,Y1z),y2,dot(s.U1,Y2x,Y2y,Y2z));
+                const double g2 = edge_log(y2,dot(s.U2,Y2x,Y2y,Y2z),y3,dot(s.U2,Y3x,Y3y,Y3z));
+                const double g3 = edge_log(y3,dot(s.U3,Y3x,Y3y,Y3z),y1,dot(s.U3,Y1x,Y1y,Y1z));
+
+                //  Operator S (see S_kernel).
+
+                resultsS[i] = (dot(s.nu0,Y1x,Y1y,Y1z)*g1+dot(s.nu1,Y2x,Y2y,Y2z)*g2+dot(s.nu2,Y3x,Y3y,Y3z)*g3)-dot(s.n,Y1x,Y1y,Y1z)*omega;
+
+                //  Operator D (see D_kernel).
+
+                const double Nx = Z1x+Z2x+Z3x;
+                const double Ny = Z1y+Z2y+Z3y;
+                const double Nz = Z1z+Z2z+Z3z;
+                const double Sx = s.U1[0]*g1+s.U2[0]*g2+s.U3[0]*g3;
+                const double Sy = s.U1[1]*g1+s.U2[1]*g2+s.U3[1]*g3;
+                const double Sz = s.U1[2]*g1+s.U2[2]*g2+s.U3[2]*g3;
+                const double norm2N = Nx*Nx+Ny*Ny+Nz*Nz;
+
+                resultsD0[i] = degenerate ? 0.0 : (omega*(Z1x*Nx+Z1y*Ny+Z1z*Nz)+d*dot(s.D2,Sx,Sy,Sz))/norm2N;
+                resultsD1[i] = degenerate ? 0.0 : (omega*(Z2x*Nx+Z2y*Ny+Z2z*Nz)+d*dot(s.D3,Sx,Sy,Sz))/norm2N;
+                resultsD2[i] = degenerate ? 0.0 : (omega*(Z3x*Nx+Z3y*Ny+Z3z*Nz)+d*dot(s.D1,Sx,Sy,Sz))/norm2N;
+            }
+        }
+
+        #ifdef OPENMEEG_X86_DISPATCH
+        OPENMEEG_TARGET("avx512f")
+        void D_kernel_avx512(const DData& s,const std::size_t n,const double* x,const double* y,const double* z,
+                             double* results0,double* results1,double* results2)
+        {
+            D_kernel(s,n,x,y,z,results0,results1,results2);
+        }
+
+        OPENMEEG_TARGET("avx2,fma")
+        void D_kernel_avx2(const DData& s,const std::size_t n,const double* x,const double* y,const double* z,
+                           double* results0,double* results1,double* results2)
+        {
+            D_kernel(s,n,x,y,z,results0,results1,results2);
+        }
+
+        OPENMEEG_TARGET("avx512f")
+        void S_kernel_avx512(const SData& s,const std::size_t n,const double* x,const double* y,const double* z,double* results) {
+            S_kernel(s,n,x,y,z,results);
+        }
+
+        OPENMEEG_TARGET("avx2,fma")
+        void S_kernel_avx2(const SData& s,const std::size_t n,const double* x,const double* y,const double* z,double* results) {
+            S_kernel(s,n,x,y,z,results);
+        }
+
+        OPENMEEG_TARGET("avx512f")
+        void SD_kernel_avx512(const SDData& s,const std::size_t n,const double* x,const double* y,const double* z,
+                              double* resultsS,double* resultsD0,double* resultsD1,double* resultsD2)
+        {
+            SD_kernel(s,n,x,y,z,resultsS,resultsD0,resultsD1,resultsD2);
+        }
+
+        OPENMEEG_TARGET("avx2,fma")
+        void SD_kernel_avx2(const SDData& s,const std::size_t n,const double* x,const double* y,const double* z,
+                            double* resultsS,double* resultsD0,double* resultsD1,double* resultsD2)
+        {
+            SD_kernel(s,n,x,y,z,resultsS,resultsD0,resultsD1,resultsD2);
+        }
+        #endif
+
+        InstructionSet best_instruction_set() {
+            #ifdef OPENMEEG_X86_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return InstructionSet::AVX512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return InstructionSet::AVX2;
+            #endif
+            return InstructionSet::Scalar;
+        }
+
+        InstructionSet& current_instruction_set() {
+            static InstructionSet iset = best_instruction_set();
+            return iset;
+        }
+    }
+
+    InstructionSet instruction_set() { return current_instruction_set(); }
+
+    void set_instruction_set(const InstructionSet iset) {
+        current_instruction_set() = std::min(iset,best_instruction_set());
+    }
+
+    void analyticS::f(const std::size_t npts,const double* x,const double* y,const double* z,double* results) const {
+        #ifdef OPENMEEG_X86_DISPATCH
+        const InstructionSet iset = instruction_set();
+        if (iset!=InstructionSet::Scalar) {
+            const SData data = {
+                { p0(0),   p0(1),   p0(2)   }, { p1(0),   p1(1),   p1(2)   }, { p2(0),   p2(1),   p2(2)   },
+                { p1p0(0), p1p0(1), p1p0(2) }, { p2p1(0), p2p1(1), p2p1(2) }, { p0p2(0), p0p2(1), p0p2(2) },
+                { nu0(0),  nu0(1),  nu0(2)  }, { nu1(0),  nu1(1),  nu1(2)  }, { nu2(0),  nu2(1),  nu2(2)  },
+                { n(0),    n(1),    n(2)    },
+                norm2p1p0, norm2p2p1, norm2p0p2
+            };
+            if (iset==InstructionSet::AVX512)
+                S_kernel_avx512(data,npts,x,y,z,results);
+            else
+                S_kernel_avx2(data,npts,x,y,z,results);
+            return;
+        }
+        #endif
+
+        for (std::size_t i=0; i<npts; ++i)
+            results[i] = f(Vect3(x[i],y[i],z[i]));
+    }
+
+    void analyticD3::f(const std::size_t npts,const double* x,const double* y,const double* z,
+                       double* results0,double* results1,double* results2) const
+    {
+        #ifdef OPENMEEG_X86_DISPATCH
+        const InstructionSet iset = instruction_set();
+        if (iset!=InstructionSet::Scalar) {
+            const Vect3& v0 = triangle.vertex(0);
+            const Vect3& v1 = triangle.vertex(1);
+            const Vect3& v2 = triangle.vertex(2);
+            const DData data = {
+                { v0(0), v0(1), v0(2) }, { v1(0), v1(1), v1(2) }, { v2(0), v2(1), v2(2) },
+                { D1(0), D1(1), D1(2) }, { D2(0), D2(1), D2(2) }, { D3(0), D3(1), D3(2) },
+                { U1(0), U1(1), U1(2) }, { U2(0), U2(1), U2(2) }, { U3(0), U3(1), U3(2) }
+            };
+            if (iset==InstructionSet::AVX512)
+                D_kernel_avx512(data,npts,x,y,z,results0,results1,results2);
+            else
+                D_kernel_avx2(data,npts,x,y,z,results0,results1,results2);
+            return;
+        }
+        #endif
+
+        for (std::size_t i=0; i<npts; ++i) {
+            const Vect3& res = f(Vect3(x[i],y[i],z[i]));
+            results0[i] = res(0);
+            results1[i] = res(1);
+            results2[i] = res(2);
+        }
+    }
+
+    void analyticSD::f(const std::size_t npts,const double* x,const double* y,const double* z,
+                       double* resultsS,double* resultsD0,double* resultsD1,double* resultsD2) const
+    {
+        #ifdef OPENMEEG_X86_DISPATCH
+        const InstructionSet iset = instruction_set();
+        if (iset!=InstructionSet::Scalar) {
+            const Vect3& v0 = analyD.triangle.vertex(0);
+            const Vect3& v1 = analyD.triangle.vertex(1);
+            const Vect3& v2 = analyD.triangle.vertex(2);
+            const SDData data = {
+                { v0(0), v0(1), v0(2) }, { v1(0), v1(1), v1(2) }, { v2(0), v2(1), v2(2) },
+                { analyD.D1(0), analyD.D1(1), analyD.D1(2) }, { analyD.D2(0), analyD.D2(1), analyD.D2(2) },
+                { analyD.D3(0), analyD.D3(1), analyD.D3(2) },
+                { analyD.U1(0), analyD.U1(1), analyD.U1(2) }, { analyD.U2(0), analyD.U2(1), analyD.U2(2) },
+                { analyD.U3(0), analyD.U3(1), analyD.U3(2) },
+                { analyS.nu0(0), analyS.nu0(1), analyS.nu0(2) }, { analyS.nu1(0), analyS.nu1(1), analyS.nu1(2) },
+                { analyS.nu2(0), analyS.nu2(1), analyS.nu2(2) },
+                { analyS.n(0), analyS.n(1), analyS.n(2) }
+            };
+            if (iset==InstructionSet::AVX512)
+                SD_kernel_avx512(data,npts,x,y,z,resultsS,resultsD0,resultsD1,resultsD2);
+            else
+                SD_kernel_avx2(data,npts,x,y,z,resultsS,resultsD0,resultsD1,resultsD2);
+            return;
+        }
+        #endif
+
+        for (std::size_t i=0; i<npts; ++i) {
+            const Vect3 point(x[i],y[i],z[i]);
+            const Vect3& res = analyD.f(point);
+            resultsS[i]  = analyS.f(point);
+            resultsD0[i] = res(0);
+            resultsD1[i] = res(1);
+            resultsD2[i] = res(2);
+        }
+    }
+}
@@ -9,6 +9,13 @@
 #define _USE_MATH_DEFINES
 #endif
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+
 #include <om_common.h>
 #include <logger.h>
 #include <matrix.h>
@@ -24,19 +31,26 @@ namespace OpenMEEG {
 
     namespace Details {
 
+        // Index of the vertex used for the deflation of an isolated part and number of vertices of its outermost meshes.
+
+        inline std::pair<unsigned,unsigned> deflation_vertices(const std::vector<const Mesh*>& part) {
+            unsigned nb_vertices = 0;
+            unsigned i_first = 0;
+            for (const auto& meshptr : part)
+                if (meshptr->outermost()){
+                    nb_vertices += meshptr->vertices().size();
+                    if (i_first==0)
+                        i_first = meshptr->vertices().front()->index();
+                }
+            return { i_first, nb_vertices };
+        }
+
         template <typename T>
         void deflate(T& M,const Geometry& geo) {
             //  deflate all current barriers as one
             ThreadException e;
             for (const auto& part : geo.isolated_parts()) {
-                unsigned nb_vertices = 0;
-                unsigned i_first = 0;
-                for (const auto& meshptr : part)
-                    if (meshptr->outermost()){
-                        nb_vertices += meshptr->vertices().size();
-                        if (i_first==0)
-                            i_first = meshptr->vertices().front()->index();
-                    }
+                const auto& [i_first,nb_vertices] = deflation_vertices(part);
                 const double coef = M(i_first,i_first)/nb_vertices;
                 for (const auto& meshptr : part)
                     if (meshptr->outermost()) {
@@ -70,6 +84,39 @@ namespace OpenMEEG {
             const Mesh& mesh;
         };
 
+        // Coefficients (S,N,D) of the blocks associated with a pair of communicating meshes.
+
+        inline void pair_coefficients(const Geometry& geo,const Geometry::MeshPair& mp,double coeffs[3]) {
+            const Mesh& mesh1 = mp(0);
+            const Mesh& mesh2 = mp(1);
+            const double factor = mp.relative_orientation()*K;
+            coeffs[0] =  factor*geo.sigma_inv(mesh1,mesh2);
+            coeffs[1] =  factor*geo.sigma(mesh1,mesh2);
+            coeffs[2] = -factor*geo.indicator(mesh1,mesh2);
+        }
+
+        // Set the blocks associated with the pair of meshes (mesh1,mesh2) with the given coefficients (S,N,D).
+
+        template <typename TYPE>
+        void set_mesh_pair_blocks(const Mesh& mesh1,const Mesh& mesh2,const double coeffs[3],const Integrator& integrator,
+                                  const std::shared_ptr<QuadratureTables>& qtables,TYPE& matrix)
+        {
+            if (&mesh1==&mesh2) {
+                HeadMatrixBlocks<DiagonalBlock> operators(DiagonalBlock(mesh1,integrator,qtables));
+                operators.set_blocks(coeffs,matrix);
+            } else {
+                HeadMatrixBlocks<NonDiagonalBlock> operators(NonDiagonalBlock(mesh1,mesh2,integrator,HMatrixParameters(),qtables));
+                operators.set_blocks(coeffs,matrix);
+            }
+        }
+
+        bool has_shared_vertices(const Geometry& geo) {
+            std::size_t nb_vertices = 0;
+            for (const auto& mesh : geo.meshes())
+                nb_vertices += mesh.vertices().size();
+            return nb_vertices!=geo.vertices().size();
+        }
+
         template <typename TYPE,typename Selector>
         TYPE HeadMatrix(const Geometry& geo,const Integrator& integrator,const Selector& disableBlock) {
 
@@ -77,9 +124,20 @@ namespace OpenMEEG {
             TYPE symmatrix(geo.nb_parameters()-geo.nb_current_barrier_triangles());
             HeadMatrixBlocks<TYPE>::init(symmatrix);
 
+            // The quadrature points of each mesh are computed once and shared by all the blocks.
+
+            const auto& qtables = std::make_shared<QuadratureTables>(integrator);
+
             // Iterate over pairs of communicating meshes (sharing a domains) to fill the
             // lower half of the HeadMat (since it is symmetric).
 
+            struct PairBlocks {
+                const Geometry::MeshPair* pair;
+                double                    coeffs[3];
+                double                    cost;
+            };
+
+            std::vector<PairBlocks> pairs;
             for (const auto& mp : geo.communicating_mesh_pairs()) {
                 const Mesh& mesh1 = mp(0);
                 const Mesh& mesh2 = mp(1);
@@ -89,22 +147,29 @@ namespace OpenMEEG {
                     log_stream(INFORMATION) << " (skipped)" << std::endl;
                     continue;
                 }
-                const double factor     =  mp.relative_orientation()*K;
-                const double SCondCoeff =  factor*geo.sigma_inv(mesh1,mesh2);
-                const double NCondCoeff =  factor*geo.sigma(mesh1,mesh2);
-                const double DCondCoeff = -factor*geo.indicator(mesh1,mesh2);
+                log_stream(INFORMATION) << std::endl;
 
-                const double coeffs[3] = { SCondCoeff, NCondCoeff, DCondCoeff };
+                const double size1 = mesh1.vertices().size()+mesh1.triangles().size();
+                const double size2 = mesh2.vertices().size()+mesh2.triangles().size();
+                pairs.push_back({ &mp, {}, (&mesh1==&mesh2) ? 0.5*size1*size2 : size1*size2 });
+                pair_coefficients(geo,mp,pairs.back().coeffs);
+            }
 
-                if (&mesh1==&mesh2) {
-                    log_stream(INFORMATION) << " (self) setting blocks" << std::endl;
-                    HeadMatrixBlocks<DiagonalBlock> operators(DiagonalBlock(mesh1,integrator));
-                    operators.set_blocks(coeffs,symmatrix);
-                } else {
-                    log_stream(INFORMATION) << " setting blocks" << std::endl;
-                    HeadMatrixBlocks<NonDiagonalBlock> operators(NonDiagonalBlock(mesh1,mesh2,integrator));
-                    operators.set_blocks(coeffs,symmatrix);
-                }
+            //  The blocks of distinct mesh pairs are disjoint (unless meshes share vertices) and are computed concurrently,
+            //  the most expensive ones first. Each block is itself split into tiles computed as tasks, so that the threads
+            //  left idle by the small blocks work on the large ones.
+
+            std::sort(pairs.begin(),pairs.end(),[](const PairBlocks& p1,const PairBlocks& p2) { return p1.cost>p2.cost; });
+            const auto& set_blocks = [&](const unsigned i) {
+                const Geometry::MeshPair& mp = *pairs[i].pair;
+                set_mesh_pair_blocks(mp(0),mp(1),pairs[i].coeffs,integrator,qtables,symmatrix);
+            };
+
+            if (has_shared_vertices(geo)) {
+                for (unsigned i=0; i<pairs.size(); ++i)
+                    set_blocks(i);
+            } else {
+                run_tasks(pairs.size(),set_blocks);
             }
 
             // Deflate all current barriers as one
@@ -134,6 +199,733 @@ namespace OpenMEEG {
         return Details::HeadMatrix<SymMatrix>(geo,integrator,Details::AllBlocks());
     }
 
+    namespace Details {
+
+        // Unknowns (vertices, then triangles unless the mesh is a current barrier) of a mesh, as pairs of indices
+        // (index in geo, index in old_geo) where old_mesh has the same content as mesh.
+
+        typedef std::vector<std::pair<unsigned,unsigned>> Unknowns;
+
+        Unknowns matching_unknowns(const Mesh& mesh,const Mesh& old_mesh) {
+            std::map<unsigned,unsigned> vertex_indices;
+            for (auto tit=mesh.triangles().begin(),oit=old_mesh.triangles().begin(); tit!=mesh.triangles().end(); ++tit,++oit)
+                for (unsigned i=0; i<3; ++i)
+                    vertex_indices[oit->vertex(i).index()] = tit->vertex(i).index();
+
+            Unknowns unknowns;
+            for (const auto& vertex : old_mesh.vertices())
+                unknowns.push_back({ vertex_indices.at(vertex->index()), vertex->index() });
+            if (!mesh.current_barrier())
+                for (auto tit=mesh.triangles().begin(),oit=old_mesh.triangles().begin(); tit!=mesh.triangles().end(); ++tit,++oit)
+                    unknowns.push_back({ tit->index(), oit->index() });
+            return unknowns;
+        }
+    }
+
+    SymMatrix HeadMat(const Geometry& geo,const Geometry& old_geo,const SymMatrix& old_matrix,const Integrator& integrator) {
+
+        const unsigned old_size = old_geo.nb_parameters()-old_geo.nb_current_barrier_triangles();
+        if (old_matrix.nlin()!=old_size)
+            throw GenericError("The previous head matrix does not correspond to the previous geometry.");
+
+        //  Blocks cannot be copied independently when vertices are shared between meshes (they are the sum of
+        //  the contributions of several mesh pairs).
+
+        if (Details::has_shared_vertices(geo) || Details::has_shared_vertices(old_geo)) {
+            log_stream(INFORMATION) << "Meshes with shared vertices: the head matrix is fully reassembled." << std::endl;
+            return HeadMat(geo,integrator);
+        }
+
+        log_stream(INFORMATION) << "Reassembling Head Matrix" << std::endl;
+
+        //  Find the meshes which did not change (same name, content and current barrier status).
+
+        std::map<const Mesh*,const Mesh*> old_meshes;
+        std::map<const Mesh*,Details::Unknowns> unknowns;
+        for (const auto& mesh : geo.meshes()) {
+            const std::uint64_t hash = mesh.content_hash();
+            for (const auto& old_mesh : old_geo.meshes())
+                if (old_mesh.name()==mesh.name() && old_mesh.current_barrier()==mesh.current_barrier() && old_mesh.content_hash()==hash) {
+                    old_meshes[&mesh] = &old_mesh;
+                    unknowns[&mesh] = Details::matching_unknowns(mesh,old_mesh);
+                    break;
+                }
+        }
+
+        //  Deflation coefficients of the old outermost meshes, to be removed from the copied diagonal blocks.
+
+        std::map<const Mesh*,double> old_deflation;
+        for (const auto& part : old_geo.isolated_parts()) {
+            const auto& [i_first,nb_vertices] = Details::deflation_vertices(part);
+            const double coef = old_matrix(i_first,i_first)/(nb_vertices+1);
+            for (const auto& meshptr : part)
+                if (meshptr->outermost())
+                    old_deflation[meshptr] = coef;
+        }
+
+        SymMatrix matrix(geo.nb_parameters()-geo.nb_current_barrier_triangles());
+        HeadMatrixBlocks<SymMatrix>::init(matrix);
+
+        const auto& qtables = std::make_shared<QuadratureTables>(integrator);
+        for (const auto& mp : geo.communicating_mesh_pairs()) {
+            const Mesh& mesh1 = mp(0);
+            const Mesh& mesh2 = mp(1);
+            log_stream(INFORMATION) << "Assembling " << mesh1.name() << " x " << mesh2.name();
+
+            double coeffs[3];
+            Details::pair_coefficients(geo,mp,coeffs);
+
+            //  Look for the same pair of meshes with the same coefficients in the old geometry.
+
+            bool reused = false;
+            if (old_meshes.count(&mesh1)!=0 && old_meshes.count(&mesh2)!=0) {
+                const Mesh* old_mesh1 = old_meshes.at(&mesh1);
+                const Mesh* old_mesh2 = old_meshes.at(&mesh2);
+                for (const auto& old_mp : old_geo.communicating_mesh_pairs()) {
+                    const bool same_meshes = (&old_mp(0)==old_mesh1 && &old_mp(1)==old_mesh2) ||
+                                             (&old_mp(0)==old_mesh2 && &old_mp(1)==old_mesh1);
+                    if (!same_meshes)
+                        continue;
+                    double old_coeffs[3];
+                    Details::pair_coefficients(old_geo,old_mp,old_coeffs);
+                    reused = std::equal(coeffs,coeffs+3,old_coeffs);
+                    break;
+                }
+            }
+
+            if (!reused) {
+                log_stream(INFORMATION) << std::endl;
+                Details::set_mesh_pair_blocks(mesh1,mesh2,coeffs,integrator,qtables,matrix);
+                continue;
+            }
+
+            log_stream(INFORMATION) << " (copied from the previous head matrix)" << std::endl;
+
+            const Details::Unknowns& unknowns1 = unknowns.at(&mesh1);
+            const Details::Unknowns& unknowns2 = unknowns.at(&mesh2);
+            const bool   diagonal = &mesh1==&mesh2;
+            const auto   dit      = old_deflation.find(old_meshes.at(&mesh1));
+            const double coef     = (diagonal && dit!=old_deflation.end()) ? dit->second : 0.0;
+            const unsigned nb_vertices = old_meshes.at(&mesh1)->vertices().size();
+
+            #pragma omp parallel for
+            for (int i1=0; i1<static_cast<int>(unknowns1.size()); ++i1) {
+                const auto& [new1,old1] = unknowns1[i1];
+                const bool vertex1 = static_cast<unsigned>(i1)<nb_vertices;
+                for (unsigned i2=(diagonal) ? i1 : 0; i2<unknowns2.size(); ++i2) {
+                    const auto& [new2,old2] = unknowns2[i2];
+                    const bool deflated = vertex1 && i2<nb_vertices;
+                    matrix(new1,new2) = old_matrix(old1,old2)-((deflated) ? coef : 0.0);
+                }
+            }
+        }
+
+        log_stream(INFORMATION) << "Deflating current barriers" << std::endl;
+        Details::deflate(matrix,geo);
+        log_stream(INFORMATION) << "done" << std::endl;
+        return matrix;
+    }
+
+    namespace Details {
+
+        // Unknowns of a mesh in the head matrix: its vertices, then its triangles (unless it is a current barrier).
+
+        std::vector<unsigned> mesh_unknowns(const Mesh& mesh) {
+            std::vector<unsigned> unknowns;
+            for (const auto& vertex : mesh.vertices())
+                unknowns.push_back(vertex->index());
+            if (!mesh.current_barrier())
+                for (const auto& triangle : mesh.triangles())
+                    unknowns.push_back(triangle.index());
+            return unknowns;
+        }
+
+        // The blocks of a pair of meshes (restricted to their unknowns) seen with the indices of the head matrix, so
+        // that they are filled by the operators as the head matrix. Entry (i,j) is located in the lines of mesh1 and
+        // the columns of mesh2 or, since the head matrix is symmetric, the converse.
+
+        template <typename T>
+        class PairBlocksView {
+        public:
+
+            PairBlocksView(T& b,const std::vector<unsigned>& unknowns1,const std::vector<unsigned>& unknowns2,const unsigned size):
+                blocks(b),local1(size,npos),local2(size,npos)
+            {
+                for (unsigned i=0; i<unknowns1.size(); ++i)
+                    local1[unknowns1[i]] = i;
+                for (unsigned i=0; i<unknowns2.size(); ++i)
+                    local2[unknowns2[i]] = i;
+            }
+
+            double& operator()(const unsigned i,const unsigned j)       { const auto& [i1,i2] = local(i,j); return blocks(i1,i2); }
+            double  operator()(const unsigned i,const unsigned j) const { const auto& [i1,i2] = local(i,j); return blocks(i1,i2); }
+
+        private:
+
+            static constexpr unsigned npos = std::numeric_limits<unsigned>::max();
+
+            std::pair<unsigned,unsigned> local(const unsigned i,const unsigned j) const {
+                if (local1[i]!=npos && local2[j]!=npos)
+                    return { local1[i], local2[j] };
+                om_assert(local1[j]!=npos && local2[i]!=npos);
+                return { local1[j], local2[i] };
+            }
+
+            T&                    blocks;
+            std::vector<unsigned> local1;
+            std::vector<unsigned> local2;
+        };
+
+        // Binary format of the head matrix components.
+
+        constexpr char          hmc_magic[8] = "OMHMCMP";
+        constexpr std::uint32_t hmc_version  = 1;
+
+        void write_name(std::ostream& os,const std::string& name) {
+            const std::uint32_t length = name.size();
+            os.write(reinterpret_cast<const char*>(&length),sizeof(length));
+            os.write(name.data(),length);
+        }
+
+        std::string read_name(std::istream& is) {
+            std::uint32_t length = 0;
+            is.read(reinterpret_cast<char*>(&length),sizeof(length));
+            std::string name(is ? length : 0,' ');
+            is.read(name.data(),name.size());
+            return name;
+        }
+    }
+
+    HeadMatComponents::HeadMatComponents(const Geometry& geo,const Integrator& integrator) {
+
+        log_stream(INFORMATION) << "Assembling Head Matrix components" << std::endl;
+
+        size = geo.nb_parameters()-geo.nb_current_barrier_triangles();
+        for (const auto& domain : geo.domains())
+            if (almost_equal(domain.conductivity(),0.0))
+                null_conductivity_domains.push_back(domain.name());
+
+        //  The blocks of each mesh pair are assembled with unit coefficients directly into storage restricted to the
+        //  unknowns of the two meshes.
+
+        const auto& qtables = std::make_shared<QuadratureTables>(integrator);
+        const double unit_coeffs[3] = { 1.0, 1.0, 1.0 };
+        for (const auto& mp : geo.communicating_mesh_pairs()) {
+            const Mesh& mesh1 = mp(0);
+            const Mesh& mesh2 = mp(1);
+            log_stream(INFORMATION) << "Assembling " << mesh1.name() << " x " << mesh2.name() << std::endl;
+
+            const std::vector<unsigned>& unknowns1 = Details::mesh_unknowns(mesh1);
+            const std::vector<unsigned>& unknowns2 = Details::mesh_unknowns(mesh2);
+            pairs.push_back({ mesh1.name(), mesh2.name(), Matrix(), SymMatrix() });
+            PairBlocks& pair = pairs.back();
+            if (pair.diagonal()) {
+                pair.diagonal_blocks = SymMatrix(unknowns1.size());
+                pair.diagonal_blocks.set(0.0);
+                Details::PairBlocksView<SymMatrix> view(pair.diagonal_blocks,unknowns1,unknowns2,size);
+                Details::set_mesh_pair_blocks(mesh1,mesh2,unit_coeffs,integrator,qtables,view);
+            } else {
+                pair.blocks = Matrix(unknowns1.size(),unknowns2.size());
+                pair.blocks.set(0.0);
+                Details::PairBlocksView<Matrix> view(pair.blocks,unknowns1,unknowns2,size);
+                Details::set_mesh_pair_blocks(mesh1,mesh2,unit_coeffs,integrator,qtables,view);
+            }
+        }
+    }
+
+    void HeadMatComponents::save(const std::string& filename) const {
+        std::ofstream ofs(filename,std::ios::binary);
+        if (!ofs)
+            throw OpenError(filename);
+
+        const std::uint64_t n        = size;
+        const std::uint32_t nb_null  = null_conductivity_domains.size();
+        const std::uint32_t nb_pairs = pairs.size();
+        ofs.write(Details::hmc_magic,sizeof(Details::hmc_magic));
+        ofs.write(reinterpret_cast<const char*>(&Details::hmc_version),sizeof(Details::hmc_version));
+        ofs.write(reinterpret_cast<const char*>(&n),sizeof(n));
+        ofs.write(reinterpret_cast<const char*>(&nb_null),sizeof(nb_null));
+        for (const auto& name : null_conductivity_domains)
+            Details::write_name(ofs,name);
+        ofs.write(reinterpret_cast<const char*>(&nb_pairs),sizeof(nb_pairs));
+        for (const auto& pair : pairs) {
+            Details::write_name(ofs,pair.name1);
+            Details::write_name(ofs,pair.name2);
+            const std::uint64_t dims[2] = { (pair.diagonal()) ? pair.diagonal_blocks.nlin() : pair.blocks.nlin(),
+                                            (pair.diagonal()) ? pair.diagonal_blocks.ncol() : pair.blocks.ncol() };
+            ofs.write(reinterpret_cast<const char*>(dims),sizeof(dims));
+            if (pair.diagonal()) {
+                ofs.write(reinterpret_cast<const char*>(pair.diagonal_blocks.data()),pair.diagonal_blocks.size()*sizeof(double));
+            } else {
+                ofs.write(reinterpret_cast<const char*>(pair.blocks.data()),dims[0]*dims[1]*sizeof(double));
+            }
+        }
+        if (!ofs)
+            throw OpenError(filename);
+    }
+
+    void HeadMatComponents::load(const std::string& filename) {
+        std::ifstream ifs(filename,std::ios::binary);
+        if (!ifs)
+            throw OpenError(filename);
+
+        char          header[sizeof(Details::hmc_magic)];
+        std::uint32_t file_version;
+        std::uint64_t n;
+        std::uint32_t nb_null = 0;
+        ifs.read(header,sizeof(header));
+        ifs.read(reinterpret_cast<char*>(&file_version),sizeof(file_version));
+        ifs.read(reinterpret_cast<char*>(&n),sizeof(n));
+        ifs.read(reinterpret_cast<char*>(&nb_null),sizeof(nb_null));
+        if (!ifs || std::memcmp(header,Details::hmc_magic,sizeof(header))!=0 || file_version!=Details::hmc_version)
+            throw BadHeader(ifs,"head matrix components");
+
+        size = n;
+        null_conductivity_domains.clear();
+        for (unsigned i=0; i<nb_null; ++i)
+            null_conductivity_domains.push_back(Details::read_name(ifs));
+
+        std::uint32_t nb_pairs = 0;
+        ifs.read(reinterpret_cast<char*>(&nb_pairs),sizeof(nb_pairs));
+        pairs.clear();
+        for (unsigned i=0; ifs && i<nb_pairs; ++i) {
+            const std::string& name1 = Details::read_name(ifs);
+            const std::string& name2 = Details::read_name(ifs);
+            std::uint64_t dims[2] = { 0, 0 };
+            ifs.read(reinterpret_cast<char*>(dims),sizeof(dims));
+            if (!ifs || dims[0]>size || dims[1]>size || (name1==name2 && dims[0]!=dims[1]))
+                throw BadData(ifs,"head matrix components");
+            pairs.push_back({ name1, name2, Matrix(), SymMatrix() });
+            PairBlocks& pair = pairs.back();
+            if (pair.diagonal()) {
+                pair.diagonal_blocks = SymMatrix(dims[0]);
+                ifs.read(reinterpret_cast<char*>(pair.diagonal_blocks.data()),pair.diagonal_blocks.size()*sizeof(double));
+            } else {
+                pair.blocks = Matrix(dims[0],dims[1]);
+                ifs.read(reinterpret_cast<char*>(pair.blocks.data()),dims[0]*dims[1]*sizeof(double));
+            }
+        }
+        if (!ifs)
+            throw BadData(ifs,"head matrix components");
+    }
+
+    SymMatrix HeadMatComponents::head_matrix(const Geometry& geo) const {
+
+        //  Check that the geometry has the same current barriers as the one used to compute the components.
+
+        if (geo.nb_parameters()-geo.nb_current_barrier_triangles()!=size)
+            throw GenericError("The head matrix components do not correspond to the geometry.");
+
+        for (const auto& domain : geo.domains()) {
+            const bool null_conductivity = std::find(null_conductivity_domains.begin(),null_conductivity_domains.end(),domain.name())!=null_conductivity_domains.end();
+            if (null_conductivity!=almost_equal(domain.conductivity(),0.0))
+                throw GenericError("The null conductivity domains differ from the ones of the head matrix components (domain "+domain.name()+").");
+        }
+
+        log_stream(INFORMATION) << "Combining Head Matrix components" << std::endl;
+
+        SymMatrix matrix(size);
+        matrix.set(0.0);
+        const bool shared_vertices = Details::has_shared_vertices(geo);
+        for (const auto& mp : geo.communicating_mesh_pairs()) {
+            const Mesh& mesh1 = mp(0);
+            const Mesh& mesh2 = mp(1);
+            const auto pit = std::find_if(pairs.begin(),pairs.end(),[&](const PairBlocks& pair) { return pair.name1==mesh1.name() && pair.name2==mesh2.name(); });
+
+            const std::vector<unsigned>& unknowns1 = Details::mesh_unknowns(mesh1);
+            const std::vector<unsigned>& unknowns2 = Details::mesh_unknowns(mesh2);
+            const unsigned nlin = (pit==pairs.end()) ? 0 : (pit->diagonal()) ? pit->diagonal_blocks.nlin() : pit->blocks.nlin();
+            const unsigned ncol = (pit==pairs.end()) ? 0 : (pit->diagonal()) ? pit->diagonal_blocks.ncol() : pit->blocks.ncol();
+            if (nlin!=unknowns1.size() || ncol!=unknowns2.size())
+                throw GenericError("The head matrix components do not correspond to the geometry (meshes "+mesh1.name()+" and "+mesh2.name()+").");
+
+            //  Vertex x vertex entries are N blocks, triangle x triangle entries are S blocks and the others are D blocks.
+
+            double coeffs[3];
+            Details::pair_coefficients(geo,mp,coeffs);
+            const unsigned nb_vertices1 = mesh1.vertices().size();
+            const unsigned nb_vertices2 = mesh2.vertices().size();
+            const auto& coeff = [&](const unsigned i1,const unsigned i2) {
+                const bool vertex1 = i1<nb_vertices1;
+                const bool vertex2 = i2<nb_vertices2;
+                return (vertex1!=vertex2) ? coeffs[2] : (vertex1) ? coeffs[1] : coeffs[0];
+            };
+
+            #pragma omp parallel for if(!shared_vertices)
+            for (int i2=0; i2<static_cast<int>(ncol); ++i2)
+                if (pit->diagonal()) {
+                    for (unsigned i1=0; i1<=static_cast<unsigned>(i2); ++i1)
+                        matrix(unknowns1[i1],unknowns2[i2]) += coeff(i1,i2)*pit->diagonal_blocks(i1,i2);
+                } else {
+                    for (unsigned i1=0; i1<nlin; ++i1)
+                        matrix(unknowns1[i1],unknowns2[i2]) += coeff(i1,i2)*pit->blocks(i1,i2);
+                }
+        }
+
+        log_stream(INFORMATION) << "Deflating current barriers" << std::endl;
+        Details::deflate(matrix,geo);
+        return matrix;
+    }
+
+    namespace Details {
+
+        // Binary format of the compressed head matrix.
+
+        constexpr char          chm_magic[8] = "OMHMCOP";
+        constexpr std::uint32_t chm_version  = 1;
+
+        // Entries of x for the given indices, and addition of coeff*v to the entries of y for the given indices.
+
+        Vector gather(const Vector& x,const std::vector<unsigned>& indices) {
+            Vector res(indices.size());
+            for (unsigned i=0; i<indices.size(); ++i)
+                res(i) = x(indices[i]);
+            return res;
+        }
+
+        void scatter(const double coeff,const Vector& v,const std::vector<unsigned>& indices,Vector& y) {
+            for (unsigned i=0; i<indices.size(); ++i)
+                y(indices[i]) += coeff*v(i);
+        }
+    }
+
+    CompressedHeadMat::CompressedHeadMat(const Geometry& geo,const HMatrixParameters& hparams,const Integrator& integrator) {
+
+        if (!hparams.enabled())
+            throw GenericError("The compressed head matrix requires a positive tolerance.");
+        if (Details::has_shared_vertices(geo))
+            throw GenericError("The compressed head matrix is not available for meshes sharing vertices.");
+
+        log_stream(INFORMATION) << "Assembling compressed Head Matrix" << std::endl;
+
+        dimension = geo.nb_parameters()-geo.nb_current_barrier_triangles();
+        locations.assign(dimension,{ -1, 0 });
+
+        const auto& qtables = std::make_shared<QuadratureTables>(integrator);
+        for (const auto& mp : geo.communicating_mesh_pairs()) {
+            const Mesh& mesh1 = mp(0);
+            const Mesh& mesh2 = mp(1);
+            log_stream(INFORMATION) << "Assembling " << mesh1.name() << " x " << mesh2.name() << std::endl;
+
+            double coeffs[3];
+            Details::pair_coefficients(geo,mp,coeffs);
+
+            //  The block of a mesh with itself is assembled densely, restricted to the unknowns of the mesh.
+
+            if (&mesh1==&mesh2) {
+                meshes.push_back({ Details::mesh_unknowns(mesh1), SymMatrix() });
+                MeshBlocks& mesh_blocks = meshes.back();
+                mesh_blocks.blocks = SymMatrix(mesh_blocks.unknowns.size());
+                mesh_blocks.blocks.set(0.0);
+                Details::PairBlocksView<SymMatrix> view(mesh_blocks.blocks,mesh_blocks.unknowns,mesh_blocks.unknowns,dimension);
+                Details::set_mesh_pair_blocks(mesh1,mesh2,coeffs,integrator,qtables,view);
+                for (unsigned i=0; i<mesh_blocks.unknowns.size(); ++i)
+                    locations[mesh_blocks.unknowns[i]] = { static_cast<int>(meshes.size()-1), i };
+                continue;
+            }
+
+            const auto& triangle_indices = [](const Mesh& mesh) {
+                std::vector<unsigned> indices;
+                for (const auto& triangle : mesh.triangles())
+                    indices.push_back(triangle.index());
+                return indices;
+            };
+
+            const auto& vertex_indices = [](const Mesh& mesh) {
+                std::vector<unsigned> indices;
+                for (const auto& vertex : mesh.vertices())
+                    indices.push_back(vertex->index());
+                return indices;
+            };
+
+            const auto& curls = [](const Mesh& mesh) {
+                std::vector<Curl> res;
+                const VerticesRefs& vertices = mesh.vertices();
+                for (unsigned i=0; i<vertices.size(); ++i)
+                    for (const auto& incidence : mesh.incidences(*vertices[i])) {
+                        const unsigned t = incidence.triangle-mesh.triangles().data();
+                        res.push_back({ i, t, incidence.edge/incidence.triangle->area() });
+                    }
+                return res;
+            };
+
+            pairs.push_back(PairBlocks());
+            PairBlocks& pair = pairs.back();
+            pair.triangles1 = triangle_indices(mesh1);
+            pair.vertices1  = vertex_indices(mesh1);
+            pair.triangles2 = triangle_indices(mesh2);
+            pair.vertices2  = vertex_indices(mesh2);
+            pair.curls1     = curls(mesh1);
+            pair.curls2     = curls(mesh2);
+            std::copy(coeffs,coeffs+3,pair.coeffs);
+            pair.S_applied  = !mesh1.current_barrier() && !mesh2.current_barrier();
+
+            const NonDiagonalBlock operators(mesh1,mesh2,integrator,hparams,qtables);
+            pair.S = operators.compressed_S();
+            if (!mesh1.current_barrier())
+                pair.D = operators.compressed_D();
+            if (!mesh2.current_barrier())
+                pair.Dstar = operators.compressed_Dstar();
+        }
+
+        //  Deflation (see Details::deflate): only the vertices of a same mesh are coupled.
+
+        log_stream(INFORMATION) << "Deflating current barriers" << std::endl;
+        for (const auto& part : geo.isolated_parts()) {
+            const auto& [i_first,nb_vertices] = Details::deflation_vertices(part);
+            const double coef = (*this)(i_first,i_first)/nb_vertices;
+            for (const auto& meshptr : part)
+                if (meshptr->outermost()) {
+                    SymMatrix& blocks = meshes[locations[meshptr->vertices().front()->index()].first].blocks;
+                    for (unsigned j=0; j<meshptr->vertices().size(); ++j)
+                        for (unsigned i=0; i<=j; ++i)
+                            blocks(i,j) += coef;
+                }
+        }
+
+        log_stream(INFORMATION) << "Compression ratio of the head matrix: " << compression_ratio() << std::endl;
+    }
+
+    std::size_t CompressedHeadMat::size() const {
+        std::size_t res = 0;
+        for (const auto& mesh_blocks : meshes)
+            res += mesh_blocks.blocks.size();
+        for (const auto& pair : pairs)
+            res += pair.S.size()+pair.D.size()+pair.Dstar.size();
+        return res;
+    }
+
+    double CompressedHeadMat::operator()(const Index i,const Index j) const {
+        const auto& [block1,i1] = locations[i];
+        const auto& [block2,i2] = locations[j];
+        if (block1<0 || block1!=block2)
+            throw GenericError("Only the entries of the blocks of a mesh with itself are available in the compressed head matrix.");
+        return meshes[block1].blocks(i1,i2);
+    }
+
+    // The blocks N between distinct meshes are -0.25*coeff*C1'*S*C2 (see BlocksBase::N), with C1 and C2 the curls of the
+    // P1 functions. The curls are applied componentwise: the first three columns of X are the components of C*x.
+
+    void CompressedHeadMat::apply_curls(const std::vector<Curl>& curls,const Vector& x,Matrix& X) {
+        for (const auto& c : curls)
+            for (unsigned k=0; k<3; ++k)
+                X(c.triangle,k) += c.curl(k)*x(c.vertex);
+    }
+
+    Vector CompressedHeadMat::apply_transposed_curls(const std::vector<Curl>& curls,const Matrix& Y,const unsigned nb_vertices) {
+        Vector res(nb_vertices);
+        res.set(0.0);
+        for (const auto& c : curls)
+            for (unsigned k=0; k<3; ++k)
+                res(c.vertex) += c.curl(k)*Y(c.triangle,k);
+        return res;
+    }
+
+    Vector CompressedHeadMat::operator*(const Vector& x) const {
+        om_assert(x.size()==dimension);
+
+        Vector y(dimension);
+        y.set(0.0);
+
+        //  The blocks of the meshes with themselves have disjoint unknowns (meshes do not share vertices): they are applied
+        //  concurrently.
+
+        ThreadException e;
+        #pragma omp parallel for schedule(dynamic)
+        for (int b=0; b<static_cast<int>(meshes.size()); ++b)
+            e.Run([&](){
+                const MeshBlocks& mesh_blocks = meshes[b];
+                Details::scatter(1.0,mesh_blocks.blocks*Details::gather(x,mesh_blocks.unknowns),mesh_blocks.unknowns,y);
+            });
+        e.Rethrow();
+
+        //  Each pair of distinct meshes appears once: its blocks are applied with their transposes, in a single traversal
+        //  of the blocks (whose products are computed concurrently, see HMatrix::products). The products with S for the
+        //  blocks N and S are computed together.
+
+        for (const auto& pair : pairs) {
+            const bool D_applied     = pair.D.nlin()!=0;
+            const bool Dstar_applied = pair.Dstar.nlin()!=0;
+            const Vector& xv1 = Details::gather(x,pair.vertices1);
+            const Vector& xv2 = Details::gather(x,pair.vertices2);
+            const Vector& xt1 = Details::gather(x,(pair.S_applied || D_applied)     ? pair.triangles1 : std::vector<unsigned>());
+            const Vector& xt2 = Details::gather(x,(pair.S_applied || Dstar_applied) ? pair.triangles2 : std::vector<unsigned>());
+
+            const double Scoeff = pair.coeffs[0];
+            const double Ncoeff = pair.coeffs[1];
+            const double Dcoeff = pair.coeffs[2];
+            const unsigned ncols = (pair.S_applied) ? 4 : 3;
+
+            Matrix X1(pair.triangles1.size(),ncols);
+            Matrix X2(pair.triangles2.size(),ncols);
+            X1.set(0.0);
+            X2.set(0.0);
+            apply_curls(pair.curls1,xv1,X1);
+            apply_curls(pair.curls2,xv2,X2);
+            if (pair.S_applied) {
+                X1.setcol(3,xt1);
+                X2.setcol(3,xt2);
+            }
+
+            Matrix Y1, Y2;
+            pair.S.products(X2,Y1,X1,Y2);
+            Details::scatter(-0.25*Ncoeff,apply_transposed_curls(pair.curls1,Y1,pair.vertices1.size()),pair.vertices1,y);
+            Details::scatter(-0.25*Ncoeff,apply_transposed_curls(pair.curls2,Y2,pair.vertices2.size()),pair.vertices2,y);
+            if (pair.S_applied) {
+                Details::scatter(Scoeff,Y1.getcol(3),pair.triangles1,y);
+                Details::scatter(Scoeff,Y2.getcol(3),pair.triangles2,y);
+            }
+
+            if (D_applied) {
+                Matrix Dx, Dtx;
+                pair.D.products(Matrix(xv2,xv2.size(),1),Dx,Matrix(xt1,xt1.size(),1),Dtx);
+                Details::scatter(Dcoeff,Dx.getcol(0),pair.triangles1,y);
+                Details::scatter(Dcoeff,Dtx.getcol(0),pair.vertices2,y);
+            }
+
+            if (Dstar_applied) {
+                Matrix Dx, Dtx;
+                pair.Dstar.products(Matrix(xv1,xv1.size(),1),Dx,Matrix(xt2,xt2.size(),1),Dtx);
+                Details::scatter(Dcoeff,Dx.getcol(0),pair.triangles2,y);
+                Details::scatter(Dcoeff,Dtx.getcol(0),pair.vertices1,y);
+            }
+        }
+        return y;
+    }
+
+    void CompressedHeadMat::save(const std::string& filename) const {
+        std::ofstream ofs(filename,std::ios::binary);
+        if (!ofs)
+            throw OpenError(filename);
+
+        const std::uint64_t n         = dimension;
+        const std::uint32_t nb_meshes = meshes.size();
+        const std::uint32_t nb_pairs  = pairs.size();
+        ofs.write(Details::chm_magic,sizeof(Details::chm_magic));
+        ofs.write(reinterpret_cast<const char*>(&Details::chm_version),sizeof(Details::chm_version));
+        ofs.write(reinterpret_cast<const char*>(&n),sizeof(n));
+        ofs.write(reinterpret_cast<const char*>(&nb_meshes),sizeof(nb_meshes));
+        for (const auto& mesh_blocks : meshes) {
+            Details::write_indices(ofs,mesh_blocks.unknowns);
+            ofs.write(reinterpret_cast<const char*>(mesh_blocks.blocks.data()),mesh_blocks.blocks.size()*sizeof(double));
+        }
+
+        ofs.write(reinterpret_cast<const char*>(&nb_pairs),sizeof(nb_pairs));
+        for (const auto& pair : pairs) {
+            for (const auto* indices : { &pair.triangles1, &pair.vertices1, &pair.triangles2, &pair.vertices2 })
+                Details::write_indices(ofs,*indices);
+            for (const auto* curls : { &pair.curls1, &pair.curls2 }) {
+                const std::uint64_t nb_curls = curls->size();
+                ofs.write(reinterpret_cast<const char*>(&nb_curls),sizeof(nb_curls));
+                for (const auto& c : *curls) {
+                    const std::uint32_t positions[2] = { c.vertex, c.triangle };
+                    const double        curl[3]      = { c.curl(0), c.curl(1), c.curl(2) };
+                    ofs.write(reinterpret_cast<const char*>(positions),sizeof(positions));
+                    ofs.write(reinterpret_cast<const char*>(curl),sizeof(curl));
+                }
+            }
+            const std::uint32_t S_applied = pair.S_applied;
+            ofs.write(reinterpret_cast<const char*>(pair.coeffs),sizeof(pair.coeffs));
+            ofs.write(reinterpret_cast<const char*>(&S_applied),sizeof(S_applied));
+            pair.S.write(ofs);
+            pair.D.write(ofs);
+            pair.Dstar.write(ofs);
+        }
+        if (!ofs)
+            throw OpenError(filename);
+    }
+
+    void CompressedHeadMat::load(const std::string& filename) {
+        std::ifstream ifs(filename,std::ios::binary);
+        if (!ifs)
+            throw OpenError(filename);
+
+        char          header[sizeof(Details::chm_magic)];
+        std::uint32_t file_version;
+        std::uint64_t n;
+        std::uint32_t nb_meshes = 0;
+        ifs.read(header,sizeof(header));
+        ifs.read(reinterpret_cast<char*>(&file_version),sizeof(file_version));
+        ifs.read(reinterpret_cast<char*>(&n),sizeof(n));
+        ifs.read(reinterpret_cast<char*>(&nb_meshes),sizeof(nb_meshes));
+        if (!ifs || std::memcmp(header,Details::chm_magic,sizeof(header))!=0 || file_version!=Details::chm_version ||
+            n>std::numeric_limits<std::uint32_t>::max())
+            throw BadHeader(ifs,"compressed head matrix");
+
+        dimension = n;
+        locations.assign(dimension,{ -1, 0 });
+        meshes.clear();
+        for (unsigned b=0; ifs && b<nb_meshes; ++b) {
+            meshes.push_back({ Details::read_indices(ifs,dimension), SymMatrix() });
+            MeshBlocks& mesh_blocks = meshes.back();
+            mesh_blocks.blocks = SymMatrix(mesh_blocks.unknowns.size());
+            ifs.read(reinterpret_cast<char*>(mesh_blocks.blocks.data()),mesh_blocks.blocks.size()*sizeof(double));
+            for (unsigned i=0; i<mesh_blocks.unknowns.size(); ++i)
+                locations[mesh_blocks.unknowns[i]] = { static_cast<int>(b), i };
+        }
+
+        //  Triangles of current barriers are not unknowns: their indices are only checked when they are used.
+
+        const unsigned nb_indices = std::numeric_limits<unsigned>::max();
+        std::uint32_t nb_pairs = 0;
+        ifs.read(reinterpret_cast<char*>(&nb_pairs),sizeof(nb_pairs));
+        pairs.clear();
+        for (unsigned p=0; ifs && p<nb_pairs; ++p) {
+            pairs.push_back(PairBlocks());
+            PairBlocks& pair = pairs.back();
+            pair.triangles1 = Details::read_indices(ifs,nb_indices);
+            pair.vertices1  = Details::read_indices(ifs,dimension);
+            pair.triangles2 = Details::read_indices(ifs,nb_indices);
+            pair.vertices2  = Details::read_indices(ifs,dimension);
+            for (auto* curls : { &pair.curls1, &pair.curls2 }) {
+                const bool     first        = curls==&pair.curls1;
+                const unsigned nb_vertices  = (first) ? pair.vertices1.size()  : pair.vertices2.size();
+                const unsigned nb_triangles = (first) ? pair.triangles1.size() : pair.triangles2.size();
+                std::uint64_t nb_curls = 0;
+                ifs.read(reinterpret_cast<char*>(&nb_curls),sizeof(nb_curls));
+                for (std::uint64_t c=0; ifs && c<nb_curls; ++c) {
+                    std::uint32_t positions[2];
+                    double        curl[3];
+                    ifs.read(reinterpret_cast<char*>(positions),sizeof(positions));
+                    ifs.read(reinterpret_cast<char*>(curl),sizeof(curl));
+                    if (!ifs || positions[0]>=nb_vertices || positions[1]>=nb_triangles)
+                        throw BadData(ifs,"compressed head matrix");
+                    curls->push_back({ positions[0], positions[1], Vect3(curl[0],curl[1],curl[2]) });
+                }
+            }
+            std::uint32_t S_applied = 0;
+            ifs.read(reinterpret_cast<char*>(pair.coeffs),sizeof(pair.coeffs));
+            ifs.read(reinterpret_cast<char*>(&S_applied),sizeof(S_applied));
+            pair.S_applied = S_applied!=0;
+            pair.S.read(ifs);
+            pair.D.read(ifs);
+            pair.Dstar.read(ifs);
+
+            const auto& unknowns = [this](const std::vector<unsigned>& indices) {
+                return std::all_of(indices.begin(),indices.end(),[this](const unsigned i) { return i<dimension; });
+            };
+            const bool D_applied     = pair.D.nlin()!=0;
+            const bool Dstar_applied = pair.Dstar.nlin()!=0;
+            const bool consistent =
+                pair.S.nlin()==pair.triangles1.size() && pair.S.ncol()==pair.triangles2.size() &&
+                (!D_applied     || (pair.D.nlin()==pair.triangles1.size() && pair.D.ncol()==pair.vertices2.size())) &&
+                (!Dstar_applied || (pair.Dstar.nlin()==pair.triangles2.size() && pair.Dstar.ncol()==pair.vertices1.size())) &&
+                (!(pair.S_applied || D_applied) || unknowns(pair.triangles1)) &&
+                (!(pair.S_applied || Dstar_applied) || unknowns(pair.triangles2));
+            if (!ifs || !consistent)
+                throw BadData(ifs,"compressed head matrix");
+        }
+        if (!ifs)
+            throw BadData(ifs,"compressed head matrix");
+    }
+
+    bool CompressedHeadMat::is_compressed_file(const std::string& filename) {
+        std::ifstream ifs(filename,std::ios::binary);
+        char header[sizeof(Details::chm_magic)];
+        ifs.read(header,sizeof(header));
+        return ifs && std::memcmp(header,Details::chm_magic,sizeof(header))==0;
+    }
+
     Matrix HeadMatrix(const Geometry& geo,const Interface& Cortex,const Integrator& integrator,const unsigned extension=0) {
 
         log_stream(INFORMATION) << "Computing HeadMatrix." << std::endl;
@@ -327,11 +1119,13 @@ namespace OpenMEEG {
         // Find the points per domain and generate the indices for the m_points
         // What happens if a point is on the boundary of a domain ? TODO
 
+        const Geometry::DomainsReference& domains = geo.domains(points);
+
         std::map<const Domain*,Vertices> m_points;
         unsigned index = 0;
         for (unsigned i=0; i<points.nlin(); ++i) {
             const Vect3 point(points(i,0),points(i,1),points(i,2));
-            const Domain& domain = geo.domain(point);
+            const Domain& domain = *domains[i];
             if (domain.conductivity()==0.0) {
                 log_stream(INFORMATION) << " Surf2Vol: Point [ " << points.getlin(i) << "]"
                                         << " is inside a non-conductive domain. Point is dropped." << std::endl;
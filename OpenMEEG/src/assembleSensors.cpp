@@ -19,23 +19,24 @@ namespace OpenMEEG {
     void assemble_ferguson(const Geometry& geo,Matrix& mat,const Matrix& pts);
 
     // EEG patches positions are reported line by line in the positions Matrix
-    // mat is supposed to be filled with zeros
     // mat is the linear application which maps x (the unknown vector in symmetric system) -> v (potential at the electrodes)
+    // The closest triangles of the electrodes are searched in parallel (see TriangleBVH).
 
     SparseMatrix Head2EEGMat(const Geometry& geo,const Sensors& electrodes) {
         const Matrix& positions = electrodes.getPositions();
-        SparseMatrix mat(positions.nlin(),(geo.nb_parameters()-geo.nb_current_barrier_triangles()));
+        SparseMatrix::Triplets triplets(3*positions.nlin());
 
-        for (unsigned i=0;i<positions.nlin();++i) {
+        #pragma omp parallel for
+        for (int i=0;i<static_cast<int>(positions.nlin());++i) {
             const Vect3 current_position(positions(i,0),positions(i,1),positions(i,2));
             Vect3 current_alphas;
             const auto& res = dist_point_geom(current_position,geo,current_alphas);
             const Triangle& current_triangle = std::get<1>(res);
             for (unsigned j=0;j<3;++j)
-                mat(i,current_triangle.vertex(j).index()) = current_alphas(j);
+                triplets[3*i+j] = { static_cast<size_t>(i), current_triangle.vertex(j).index(), current_alphas(j) };
         }
 
-        return mat;
+        return SparseMatrix(positions.nlin(),(geo.nb_parameters()-geo.nb_current_barrier_triangles()),triplets);
     }
 
     // ECoG positions are reported line by line in the positions Matrix
@@ -46,9 +47,10 @@ namespace OpenMEEG {
     SparseMatrix Head2ECoGMat(const Geometry& geo,const Sensors& electrodes,const Interface& i) {
 
         const Matrix& positions = electrodes.getPositions();
-        SparseMatrix mat(positions.nlin(),(geo.nb_parameters()-geo.nb_current_barrier_triangles()));
+        SparseMatrix::Triplets triplets(3*positions.nlin());
 
-        for (unsigned it=0;it<positions.nlin();++it) {
+        #pragma omp parallel for
+        for (int it=0;it<static_cast<int>(positions.nlin());++it) {
             Vect3 current_position;
             for (unsigned k=0;k<3;++k)
                 current_position(k) = positions(it,k);
@@ -56,10 +58,10 @@ namespace OpenMEEG {
             const auto& res = dist_point_interface(current_position,i,current_alphas);
             const Triangle& current_triangle = std::get<1>(res);
             for (unsigned j=0;j<3;++j)
-                mat(it,current_triangle.vertex(j).index()) = current_alphas(j);
+                triplets[3*it+j] = { static_cast<size_t>(it), current_triangle.vertex(j).index(), current_alphas(j) };
         }
 
-        return mat;
+        return SparseMatrix(positions.nlin(),(geo.nb_parameters()-geo.nb_current_barrier_triangles()),triplets);
     }
 
     // MEG patches positions are reported line by line in the positions Matrix (same for positions)
@@ -60,46 +60,72 @@ namespace OpenMEEG {
         return mat;
     }
 
-    Matrix
-    DipSourceMat(const Geometry& geo,const Matrix& dipoles,const Integrator& integrator,const std::string& domain_name) {
+    DipSourceMatBlocks::DipSourceMatBlocks(const Geometry& g,const Matrix& dips,const Integrator& integ,const std::string& domain_name):
+        geo(g),dipoles(dips),integrator(integ)
+    {
+        //  Locating a dipole requires inside/outside tests with all the interfaces, which is done once for all.
+
+        domains = (domain_name=="") ? geo.domains(dipoles) : Geometry::DomainsReference(nb_dipoles(),&geo.domain(domain_name));
+    }
+
+    Matrix DipSourceMatBlocks::operator()(const Index first,const Dimension n) const {
 
-        const size_t size      = geo.nb_parameters()-geo.nb_current_barrier_triangles();
-        const size_t n_dipoles = dipoles.nlin();
+        const size_t size = geo.nb_parameters()-geo.nb_current_barrier_triangles();
 
-        Matrix rhs(size,n_dipoles);
+        Matrix rhs(size,n);
         rhs.set(0.0);
 
-        ProgressBar pb(n_dipoles);
-        Vector rhs_col(rhs.nlin());
-        for (unsigned s=0; s<n_dipoles; ++s,++pb) {
-            const Dipole dipole(s,dipoles);
-            const Domain domain = (domain_name=="") ? geo.domain(dipole.position()) : geo.domain(domain_name);
-
-            //  Only consider dipoles in non-zero conductivity domain.
-
-            const double cond = domain.conductivity();
-            if (cond!=0.0) {
-                rhs_col.set(0.0);
-                for (const auto& boundary : domain.boundaries()) {
-                    const double factorD = (boundary.inside()) ? K : -K;
-                    for (const auto& oriented_mesh : boundary.interface().oriented_meshes()) {
-                        //  Treat the mesh.
-                        const double coeffD = factorD*oriented_mesh.orientation();
-                        const Mesh&  mesh   = oriented_mesh.mesh();
-                        operatorDipolePotDer(dipole,mesh,rhs_col,coeffD,integrator);
-
-                        if (!oriented_mesh.mesh().current_barrier()) {
-                            const double coeff = -coeffD/cond;;
-                            operatorDipolePot(dipole,mesh,rhs_col,coeff,integrator);
+        //  The columns are computed in parallel when there are enough dipoles to keep all the threads busy. Otherwise,
+        //  the integrals over the triangles of each mesh are computed in parallel (see operatorDipolePotDer).
+
+        #ifndef NO_OPENMP
+        const bool parallel_dipoles = n>=static_cast<Dimension>(omp_get_max_threads());
+        #endif
+
+        ThreadException e;
+        ProgressBar pb(n);
+        #pragma omp parallel for schedule(dynamic) if(parallel_dipoles)
+        for (int s=0; s<static_cast<int>(n); ++s) {
+            e.Run([&,s](){
+                const Dipole  dipole(first+s,dipoles);
+                const Domain& domain = *domains[first+s];
+
+                //  Only consider dipoles in non-zero conductivity domain.
+
+                const double cond = domain.conductivity();
+                if (cond!=0.0) {
+                    Vector rhs_col(size);
+                    rhs_col.set(0.0);
+                    for (const auto& boundary : domain.boundaries()) {
+                        const double factorD = (boundary.inside()) ? K : -K;
+                        for (const auto& oriented_mesh : boundary.interface().oriented_meshes()) {
+                            //  Treat the mesh.
+                            const double coeffD = factorD*oriented_mesh.orientation();
+                            const Mesh&  mesh   = oriented_mesh.mesh();
+                            operatorDipolePotDer(dipole,mesh,rhs_col,coeffD,integrator);
+
+                            if (!oriented_mesh.mesh().current_barrier()) {
+                                const double coeff = -coeffD/cond;;
+                                operatorDipolePot(dipole,mesh,rhs_col,coeff,integrator);
+                            }
                         }
                     }
+                    rhs.setcol(s,rhs_col);
                 }
-                rhs.setcol(s,rhs_col);
-            }
+            });
+            #pragma omp critical (progress)
+            ++pb;
         }
+        e.Rethrow();
         return rhs;
     }
 
+    Matrix
+    DipSourceMat(const Geometry& geo,const Matrix& dipoles,const Integrator& integrator,const std::string& domain_name) {
+        const DipSourceMatBlocks sources(geo,dipoles,integrator,domain_name);
+        return sources(0,sources.nb_dipoles());
+    }
+
     Matrix
     DipSourceMat(const Geometry& geo,const Matrix& dipoles,const std::string& domain_name) {
         return DipSourceMat(geo,dipoles,Integrator(3,10,0.001),domain_name);
@@ -154,11 +180,13 @@ namespace OpenMEEG {
 
         // Points with one more column for the index of the domain they belong
 
+        const Geometry::DomainsReference& domains = geo.domains(points);
+
         std::vector<const Domain*> points_domain;
         std::vector<Vect3>         pts;
         for (unsigned i=0; i<points.nlin(); ++i) {
             const Vect3   point(points(i,0),points(i,1),points(i,2));
-            const Domain& domain = geo.domain(point);
+            const Domain& domain = *domains[i];
             if (domain.conductivity()!=0.0) {
                 points_domain.push_back(&domain);
                 pts.push_back(point);
@@ -168,13 +196,16 @@ namespace OpenMEEG {
             }
         }
 
+        const Geometry::DomainsReference& dipoles_domain =
+            (domain_name=="") ? geo.domains(dipoles) : Geometry::DomainsReference(dipoles.nlin(),&geo.domain(domain_name));
+
         Matrix mat(pts.size(),dipoles.nlin());
         mat.set(0.0);
 
         for (unsigned iDIP=0; iDIP<dipoles.nlin(); ++iDIP) {
             const Dipole dipole(iDIP,dipoles);
 
-            const Domain& domain = (domain_name=="") ? geo.domain(dipole.position()) : geo.domain(domain_name);
+            const Domain& domain = *dipoles_domain[iDIP];
             const double  coeff  = K/domain.conductivity();
 
             for (unsigned iPTS=0; iPTS<pts.size(); ++iPTS)
@@ -6,6 +6,7 @@
 // - replace this header by the LICENSE.txt content.
 
 #include <danielsson.h>
+#include <triangle_bvh.h>
 #include <OMExceptions.H>
 
 // Implement an algorithm  proposed in Danielsson, P.-E.
@@ -78,24 +79,11 @@ namespace OpenMEEG {
         return dpc(p,triangle,alphas,3,idx,inside);
     }
 
+    // Closest triangle of an interface (see TriangleBVH).
+
     std::tuple<double,const Triangle&,const Mesh&>
     dist_point_interface(const Vect3& p,const Interface& interface,Vect3& alphas) {
-        double distmin = std::numeric_limits<double>::max();
-        const Mesh*     nearest_mesh     = nullptr;
-        const Triangle* nearest_triangle = nullptr;
-        for (const auto& omesh : interface.oriented_meshes())
-            for (const auto& triangle : omesh.mesh().triangles()) {
-                bool  inside;
-                Vect3 alphasLoop;
-                const double distance = dist_point_triangle(p,triangle,alphasLoop,inside);
-                if (distance<distmin) {
-                    distmin = distance;
-                    alphas  = alphasLoop;
-                    nearest_triangle = &triangle;
-                    nearest_mesh = &omesh.mesh();
-                }
-            }
-        return { distmin, *nearest_triangle, *nearest_mesh };;
+        return interface.triangle_bvh().closest(p,alphas);
     }
 
     // Find the closest triangle on the interfaces that touches 0 conductivity
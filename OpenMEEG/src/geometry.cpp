@@ -5,6 +5,8 @@
 // - provide also LICENSE.txt and modify this header to refer to it.
 // - replace this header by the LICENSE.txt content.
 
+#include <map>
+
 #include <geometry.h>
 #include <MeshIO.h>
 #include <GeometryIO.h>
@@ -140,15 +142,40 @@ namespace OpenMEEG {
     }
 
     const Domain& Geometry::domain(const Vect3& p) const {
-        for (const auto& domain : domains())
-            if (domain.contains(p))
+
+        //  An interface bounds several domains, but its inside/outside test is done only once.
+
+        std::map<const Interface*,bool> inside;
+        for (const auto& domain : domains()) {
+            bool contained = true;
+            for (const auto& boundary : domain.boundaries()) {
+                const Interface& interface = boundary.interface();
+                const auto it = inside.find(&interface);
+                const bool in = (it!=inside.end()) ? it->second : (inside[&interface] = interface.contains(p));
+                if (in!=boundary.inside()) {
+                    contained = false;
+                    break;
+                }
+            }
+            if (contained)
                 return domain;
+        }
 
         // Should never append
 
         throw OpenMEEG::BadDomain("Impossible");
     }
 
+    Geometry::DomainsReference Geometry::domains(const Matrix& points) const {
+        DomainsReference result(points.nlin());
+        ThreadException e;
+        #pragma omp parallel for schedule(dynamic)
+        for (int i=0; i<static_cast<int>(points.nlin()); ++i)
+            e.Run([&,i](){ result[i] = &domain(Vect3(points(i,0),points(i,1),points(i,2))); });
+        e.Rethrow();
+        return result;
+    }
+
     const Domain& Geometry::domain(const std::string& name) const {
         for (const auto& domain : domains())
             if (domain.name()==name)
@@ -290,7 +317,7 @@ namespace OpenMEEG {
         num_params = index;
     }
 
-    bool Geometry::selfCheck() const {
+    bool Geometry::selfCheck(const bool report_all) const {
 
         bool OK = true;
 
@@ -301,7 +328,7 @@ namespace OpenMEEG {
             if (!mesh1.has_correct_orientation())
                 log_stream(WARNING) << "A mesh does not seem to be properly oriented";
 
-            if (mesh1.has_self_intersection()) {
+            if (mesh1.has_self_intersection(report_all)) {
                 log_stream(WARNING) << "Mesh is self intersecting !";
                 mesh1.info();
                 OK = false;
@@ -310,7 +337,7 @@ namespace OpenMEEG {
             if (is_nested()) {
                 for (Meshes::const_iterator mit2=mit1+1;mit2!=meshes().end();++mit2) {
                     const Mesh& mesh2 = *mit2;
-                    if (mesh1.intersection(mesh2)) {
+                    if (mesh1.intersection(mesh2,report_all)) {
                         log_stream(WARNING) << "2 meshes are intersecting !";
                         mesh1.info();
                         mesh2.info();
@@ -322,15 +349,15 @@ namespace OpenMEEG {
         return OK;
     }
 
-    bool Geometry::check(const Mesh& m) const {
+    bool Geometry::check(const Mesh& m,const bool report_all) const {
         bool OK = true;
-        if (m.has_self_intersection()) {
+        if (m.has_self_intersection(report_all)) {
             log_stream(WARNING) << "Mesh is self intersecting !";
             m.info();
             OK = false;
         }
         for (const auto& mesh : meshes())
-            if (mesh.intersection(m)) {
+            if (mesh.intersection(m,report_all)) {
                 log_stream(WARNING) << "Mesh is intersecting with one of the mesh in geom file !";
                 mesh.info();
                 OK = false;
@@ -350,7 +377,8 @@ namespace OpenMEEG {
 
         const Interface& interface = innermost_interface();
         unsigned n_outside = 0;
-        for (unsigned i=0; i<mat.nlin(); ++i)
+        #pragma omp parallel for reduction(+:n_outside)
+        for (int i=0; i<static_cast<int>(mat.nlin()); ++i)
             if (!interface.contains(Vect3(mat(i,0),mat(i,1),mat(i,2))))
                 ++n_outside;
         if (n_outside!=0) {
@@ -6,16 +6,29 @@
 // - replace this header by the LICENSE.txt content.
 
 #include <algorithm>
+#include <mutex>
 
 #include <constants.h>
 #include <boundingbox.h>
 #include <interface.h>
+#include <triangle_bvh.h>
 
 namespace OpenMEEG {
 
     /// Computes the total solid angle of a surface for a point p and tells whether p is inside the mesh or not.
+    /// The solid angle is first estimated with the bounding volume hierarchy. Its exact value is only computed when
+    /// the estimate, together with its error bound, is not guaranteed to be within Pi of 0 or -4*Pi.
 
     bool Interface::contains(const Vect3& p) const {
+        double error_bound;
+        const double estimate = triangle_bvh().solid_angle(p,error_bound);
+
+        if (std::abs(estimate+4*Pi)+error_bound<Pi)
+            return true;
+
+        if (std::abs(estimate)+error_bound<Pi)
+            return false;
+
         const double solangle = solid_angle(p);
 
         if (almost_equal(solangle,-4*Pi))
@@ -44,6 +57,20 @@ namespace OpenMEEG {
         return solangle;
     }
 
+    const TriangleBVH& Interface::triangle_bvh() const {
+        std::shared_ptr<const TriangleBVH> tree = std::atomic_load(&bvh);
+        if (!tree || !tree->up_to_date()) {
+            static std::mutex mutex;
+            const std::lock_guard<std::mutex> lock(mutex);
+            tree = std::atomic_load(&bvh);
+            if (!tree || !tree->up_to_date()) {
+                tree = std::make_shared<const TriangleBVH>(*this);
+                std::atomic_store(&bvh,tree);
+            }
+        }
+        return *tree;
+    }
+
     void Interface::set_to_outermost() {
         for (auto& omesh : oriented_meshes())
             omesh.mesh().outermost() = true;
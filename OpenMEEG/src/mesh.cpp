@@ -8,12 +8,16 @@
 #include <sstream>
 #include <stack>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 
 #include <constants.h>
 #include <mesh.h>
 #include <MeshIO.h>
 #include <geometry.h>
 #include <logger.h>
+#include <boundingbox.h>
+#include <triangle_bvh.h>
 
 namespace OpenMEEG {
 
@@ -82,7 +86,9 @@ namespace OpenMEEG {
         vertices().clear();
         triangles().clear();
         mesh_name.clear();
-        vertex_triangles.clear();
+        first_vertex = nullptr;
+        incidence_offsets.clear();
+        incidences_.clear();
         outermost_ = false;
     }
 
@@ -105,14 +111,67 @@ namespace OpenMEEG {
             triangle.area()   = normaldir.norm()/2.0;
             triangle.normal() = normaldir.normalize();
         }
+
+        update_incidences();
+        ++revision_;
+    }
+
+    void Mesh::make_adjacencies() {
+        first_vertex = nullptr;
+        incidence_offsets.clear();
+        incidences_.clear();
+        if (triangles().empty())
+            return;
+
+        //  All the vertices belong to the vector of vertices of the geometry, so their positions in this vector (relative
+        //  to the first one of the mesh) index the incidences.
+
+        const Vertex* last_vertex = nullptr;
+        for (const auto& triangle : triangles())
+            for (const auto& vertex : triangle) {
+                if (first_vertex==nullptr || std::less<const Vertex*>()(vertex,first_vertex))
+                    first_vertex = vertex;
+                if (last_vertex==nullptr || std::less<const Vertex*>()(last_vertex,vertex))
+                    last_vertex = vertex;
+            }
+
+        incidence_offsets.assign(last_vertex-first_vertex+2,0);
+        for (const auto& triangle : triangles())
+            for (const auto& vertex : triangle)
+                ++incidence_offsets[vertex-first_vertex+1];
+        for (size_t k=1; k<incidence_offsets.size(); ++k)
+            incidence_offsets[k] += incidence_offsets[k-1];
+
+        incidences_.resize(incidence_offsets.back());
+        std::vector<size_t> next(incidence_offsets.begin(),incidence_offsets.end()-1);
+        for (auto& triangle : triangles())
+            for (const auto& vertex : triangle)
+                incidences_[next[vertex-first_vertex]++].triangle = &triangle;
+    }
+
+    std::string Mesh::unknown_vertex_message(const Vertex& V) const {
+        std::ostringstream oss;
+        oss << "vertex " << V << " (" << &V << ") does not belong to a triangle of mesh \"" << name() << "\".";
+        return oss.str();
+    }
+
+    void Mesh::update_incidences() {
+        for (size_t k=0; k+1<incidence_offsets.size(); ++k)
+            for (size_t l=incidence_offsets[k]; l<incidence_offsets[k+1]; ++l) {
+                Incidence& incidence = incidences_[l];
+                const Edge& edge = incidence.triangle->edge(first_vertex[k]);
+                incidence.opposite[0] = &edge.vertex(0);
+                incidence.opposite[1] = &edge.vertex(1);
+                incidence.edge        = edge.vertex(0)-edge.vertex(1);
+            }
     }
 
     /// Compute normals at vertices.
 
     Normal Mesh::normal(const Vertex& v) const {
         Normal N(0);
-        for (const auto& triangle : triangles(v))
-            N += triangle->normal();
+        for (const auto& incidence : incidences(v))
+            N += incidence.triangle->normal();
         N.normalize();
         return N;
     }
@@ -145,10 +204,9 @@ namespace OpenMEEG {
         typedef std::map<const Vertex*,std::set<Vertex>> Neighbors;
         Neighbors neighbors;
         for (const auto& vertex : vertices())
-            for (const auto& triangle : triangles(*vertex))
-                for (unsigned k=0;k<3;++k)
-                    if (&triangle->vertex(k)!=vertex)
-                        neighbors[vertex].insert(triangle->vertex(k));
+            for (const auto& incidence : incidences(*vertex))
+                for (const auto& neighbor : incidence.opposite)
+                    neighbors[vertex].insert(*neighbor);
 
 
         for (unsigned n=0; n<niter; ++n) {
@@ -176,11 +234,10 @@ namespace OpenMEEG {
         for (const auto& vp : vertices()) {
             const Vertex& v1 = *vp;
             const unsigned index = v1.index();
-            for (const auto& t : triangles(v1)) {
-                const Edge& edge = t->edge(v1);
-                const Vertex& v2 = edge.vertex(0);
-                const Vertex& v3 = edge.vertex(1);
-                A(index,index) += P1gradient(v1,v2,v3).norm2()*sqr(t->area());
+            for (const auto& incidence : incidences(v1)) {
+                const Vertex& v2 = *incidence.opposite[0];
+                const Vertex& v3 = *incidence.opposite[1];
+                A(index,index) += P1gradient(v1,v2,v3).norm2()*sqr(incidence.triangle->area());
             }
         }
 
@@ -236,16 +293,72 @@ namespace OpenMEEG {
             A(vertex->index(),vertex->index()) = -A.getlin(vertex->index()).sum();
     }
 
-    bool Mesh::has_self_intersection() const {
-        bool selfIntersects = false;
-        for (auto tit1=triangles().begin();tit1!=triangles().end();++tit1)
-            for (auto tit2=tit1;tit2!=triangles().end();++tit2)
-                if (!tit1->contains(tit2->vertex(0)) && !tit1->contains(tit2->vertex(1)) && !tit1->contains(tit1->vertex(2)))
-                    if (tit1->intersects(*tit2)) {
-                        selfIntersects = true;
-                        std::cout << "Triangles " << tit1->index() << " and " << tit2->index() << " are intersecting." << std::endl;
+    namespace {
+
+        bool share_vertex(const Triangle& t1,const Triangle& t2) {
+            return t1.contains(t2.vertex(0)) || t1.contains(t2.vertex(1)) || t1.contains(t2.vertex(2));
+        }
+
+        //  Each triangle of mesh1 is tested against the triangles of mesh2 whose bounding boxes intersect its own.
+        //  For a self intersection test, only the pairs (t1,t2) with t1 before t2 which do not share a vertex are kept.
+
+        Mesh::TrianglePairs intersecting_triangles(const Mesh& mesh1,const Mesh& mesh2,const bool all) {
+            const bool        self = &mesh1==&mesh2;
+            const TriangleBVH tree(mesh2);
+            const Triangles&  triangles = mesh1.triangles();
+
+            Mesh::TrianglePairs pairs;
+            std::atomic<bool>   found(false);
+
+            #pragma omp parallel
+            {
+                std::vector<const Triangle*> candidates;
+                #pragma omp for schedule(dynamic,64)
+                for (int i=0; i<static_cast<int>(triangles.size()); ++i) {
+                    if (!all && found)
+                        continue;
+                    const Triangle& triangle1 = triangles[i];
+                    candidates.clear();
+                    tree.overlapping(BoundingBox(triangle1),candidates);
+                    for (const auto& triangle2 : candidates) {
+                        if (self && (triangle2<=&triangle1 || share_vertex(triangle1,*triangle2)))
+                            continue;
+                        if (triangle1.intersects(*triangle2)) {
+                            #pragma omp critical
+                            pairs.push_back(std::make_pair(&triangle1,triangle2));
+                            found = true;
+                            if (!all)
+                                break;
+                        }
                     }
-        return selfIntersects;
+                }
+            }
+
+            //  Report the pairs in a deterministic order.
+
+            std::sort(pairs.begin(),pairs.end());
+            if (!all && pairs.size()>1)
+                pairs.resize(1);
+            return pairs;
+        }
+
+        bool report(const Mesh::TrianglePairs& pairs) {
+            for (const auto& pair : pairs)
+                std::cout << "Triangles " << pair.first->index() << " and " << pair.second->index() << " are intersecting." << std::endl;
+            return !pairs.empty();
+        }
+    }
+
+    Mesh::TrianglePairs Mesh::self_intersections(const bool all) const {
+        return intersecting_triangles(*this,*this,all);
+    }
+
+    Mesh::TrianglePairs Mesh::intersections(const Mesh& m,const bool all) const {
+        return intersecting_triangles(*this,m,all);
+    }
+
+    bool Mesh::has_self_intersection(const bool report_all) const {
+        return report(self_intersections(report_all));
     }
 
     double Mesh::solid_angle(const Vect3& p) const {
@@ -255,12 +368,8 @@ namespace OpenMEEG {
         return solangle;
     }
 
-    bool Mesh::intersection(const Mesh& m) const {
-        bool intersects = false;
-        for (const auto& triangle1 : triangles())
-            for (const auto& triangle2 : m.triangles())
-                intersects = intersects | triangle1.intersects(triangle2);
-        return intersects;
+    bool Mesh::intersection(const Mesh& m,const bool report_all) const {
+        return report(intersections(m,report_all));
     }
 
     void Mesh::load(const std::string& filename,const bool verbose) {
@@ -283,6 +392,30 @@ namespace OpenMEEG {
             triangle.index() = index++;
     }
 
+    std::uint64_t Mesh::content_hash() const {
+
+        //  FNV-1a hash of the number of triangles and of the coordinates of their vertices.
+
+        std::uint64_t hash = 14695981039346656037ULL;
+        const auto& add = [&hash](const void* data,const std::size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (std::size_t i=0; i<size; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+
+        const std::uint64_t nb_triangles = triangles().size();
+        add(&nb_triangles,sizeof(nb_triangles));
+        for (const auto& triangle : triangles())
+            for (unsigned i=0; i<3; ++i) {
+                const Vertex& V = triangle.vertex(i);
+                const double coords[3] = { V.x(), V.y(), V.z() };
+                add(coords,sizeof(coords));
+            }
+        return hash;
+    }
+
     void Mesh::save(const std::string& filename) const {
         MeshIO* io = MeshIO::create(filename);
         io->save(*this);
@@ -393,13 +526,13 @@ namespace OpenMEEG {
         // check that all vertices lead to triangles whose edges are defined
         log_stream(DEBUG) << "Vertices range: " << &(*vertices().begin()) << " -- " << &(*vertices().end()) << std::endl;
         for (const auto& V1 : vertices()) {
-            for (const auto& tp1 : triangles(*V1)) try {
-                tp1->edge(*V1);
+            for (const auto& incidence : incidences(*V1)) try {
+                incidence.triangle->edge(*V1);
             } catch (const OpenMEEG::UnknownVertex&) {
                 std::ostringstream oss;
                 oss << "Mesh " << name() << " invalid    during " << when << ", requested triangle vertex address:" << std::endl << "  " << V1 << std::endl << "but valid triangle vertex addresses are:" << std::endl;
                 for (unsigned i=0;i<3;++i)
-                    oss << "  " << &(tp1->vertex(i)) << std::endl;
+                    oss << "  " << &(incidence.triangle->vertex(i)) << std::endl;
                 throw OpenMEEG::UnknownVertex(oss.str());
             }
         }
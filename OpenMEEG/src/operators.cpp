@@ -36,33 +36,27 @@ namespace OpenMEEG {
     }
 
     void operatorDipolePotDer(const Dipole& dipole,const Mesh& m,Vector& rhs,const double coeff,const Integrator& integrator) {
+
+        // The integrals over the triangles are computed in parallel and accumulated on the vertices afterwards, to avoid
+        // synchronizing the threads (which also contend with those computing other dipoles, see DipSourceMat).
+
+        const Triangles& triangles = m.triangles();
+        std::vector<Vect3> values(triangles.size());
+
         ThreadException e;
         #pragma omp parallel for
-        #if defined NO_OPENMP || defined OPENMP_RANGEFOR
-        for (const auto& triangle : m.triangles()) {
-        #elif defined OPENMP_ITERATOR
-        for (Triangles::const_iterator tit=m.triangles().begin(); tit<m.triangles().end(); ++tit) {
-            const Triangle& triangle = *tit;
-        #else
-        for (int i=0; i<static_cast<int>(m.triangles().size()); ++i) {
-            const Triangle& triangle = *(m.triangles().begin()+i);
-        #endif
-            e.Run([&](){
-                const analyticDipPotDer anaDPD(dipole,triangle);
+        for (int i=0; i<static_cast<int>(triangles.size()); ++i) {
+            e.Run([&,i](){
+                const analyticDipPotDer anaDPD(dipole,triangles[i]);
                 const auto dipder = [&](const Vect3& r) { return anaDPD.f(r); };
-
-                const Vect3& v = integrator.integrate(dipder,triangle);
-                // On clang/macOS we hit https://stackoverflow.com/questions/66362932/re-throwing-exception-from-openmp-block-with-the-main-thread-with-rcpp
-                #ifndef __APPLE__
-                #pragma omp critical
-                #endif
-                {
-                    for (unsigned j=0; j<3; ++j)
-                        rhs(triangle.vertex(j).index()) += v(j)*coeff;
-                }
+                values[i] = integrator.integrate(dipder,triangles[i]);
             });
         }
         e.Rethrow();
+
+        for (unsigned i=0; i<triangles.size(); ++i)
+            for (unsigned j=0; j<3; ++j)
+                rhs(triangles[i].vertex(j).index()) += values[i](j)*coeff;
     }
 
     void operatorDipolePot(const Dipole& dipole,const Mesh& m,Vector& rhs,const double coeff,const Integrator& integrator) {
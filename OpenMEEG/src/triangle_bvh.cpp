@@ -0,0 +1,262 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <triangle_bvh.h>
+#include <interface.h>
+#include <danielsson.h>
+#include <constants.h>
+
+namespace OpenMEEG {
+
+    //  Maximal number of triangles in a leaf.
+
+    constexpr unsigned leaf_size = 4;
+
+    //  A node is replaced by the Taylor expansion of its solid angle for the points farther than far_field times its
+    //  radius from its center, provided that the bound of the error of this expansion is at most error_budget times the
+    //  fraction of the total area covered by the node. The nodes replaced being disjoint, the total error is thus at
+    //  most error_budget.
+
+    constexpr double far_field    = 3.0;
+    constexpr double error_budget = Pi/2;
+
+    TriangleBVH::TriangleBVH(const Interface& interface) {
+        for (const auto& omesh : interface.oriented_meshes())
+            add(omesh.mesh(),omesh.orientation());
+        build();
+    }
+
+    TriangleBVH::TriangleBVH(const Mesh& mesh) {
+        add(mesh,1);
+        build();
+    }
+
+    void TriangleBVH::add(const Mesh& mesh,const int orientation) {
+        revisions.push_back({ &mesh, mesh.revision() });
+        for (const auto& triangle : mesh.triangles())
+            elements.push_back({ &triangle, &mesh, orientation, static_cast<unsigned>(elements.size()) });
+    }
+
+    void TriangleBVH::build() {
+        std::vector<Vect3> centers;
+        centers.reserve(elements.size());
+        for (const auto& element : elements)
+            centers.push_back(element.triangle->center());
+
+        nodes.reserve(2*elements.size()/leaf_size+1);
+        if (!elements.empty())
+            build(centers,0,elements.size());
+    }
+
+    void TriangleBVH::build(const std::vector<Vect3>& centers,const unsigned first,const unsigned last) {
+        const unsigned current = nodes.size();
+        nodes.push_back(Node());
+        nodes[current].first = first;
+        nodes[current].last  = last;
+        for (unsigned i=first; i<last; ++i)
+            for (const auto& vertex : *elements[i].triangle)
+                nodes[current].box.add(*vertex);
+
+        //  Moments of the triangles, relative to their (area weighted) center.
+
+        Node&  node = nodes[current];
+        double area = 0.0;
+        Vect3  moment(0.0);
+        Vect3  center(0.0);
+        for (unsigned i=first; i<last; ++i) {
+            const Triangle& triangle = *elements[i].triangle;
+            const Vect3& area_vector = 0.5*crossprod(triangle.vertex(1)-triangle.vertex(0),triangle.vertex(2)-triangle.vertex(0));
+            const double a = area_vector.norm();
+            moment += elements[i].orientation*area_vector;
+            center += a*triangle.center();
+            area   += a;
+        }
+        if (area>0.0)
+            center /= area;
+
+        double radius = 0.0;
+        for (unsigned i=first; i<last; ++i)
+            for (const auto& vertex : *elements[i].triangle)
+                radius = std::max(radius,(*vertex-center).norm());
+
+        double second = 0.0;
+        for (unsigned k=0; k<3; ++k)
+            for (unsigned l=0; l<3; ++l)
+                node.spread[k][l] = 0.0;
+        for (unsigned i=first; i<last; ++i) {
+            const Triangle& triangle = *elements[i].triangle;
+            const Vect3& area_vector = 0.5*elements[i].orientation*crossprod(triangle.vertex(1)-triangle.vertex(0),triangle.vertex(2)-triangle.vertex(0));
+            const Vect3& offset = triangle.center()-center;
+            for (unsigned k=0; k<3; ++k)
+                for (unsigned l=0; l<3; ++l)
+                    node.spread[k][l] += offset(k)*area_vector(l);
+
+            //  Integral of |y-center|^2 over the triangle.
+
+            const Vect3& w0 = triangle.vertex(0)-center;
+            const Vect3& w1 = triangle.vertex(1)-center;
+            const Vect3& w2 = triangle.vertex(2)-center;
+            second += area_vector.norm()*(w0.norm2()+w1.norm2()+w2.norm2()+(w0+w1+w2).norm2())/12;
+        }
+
+        node.center = center;
+        node.moment = moment;
+        node.area   = area;
+        node.second = second;
+        node.radius = radius;
+
+        if (last-first<=leaf_size)
+            return;
+
+        //  Split the triangles at the median of their centers along the largest extent of the centers.
+
+        BoundingBox box;
+        for (unsigned i=first; i<last; ++i)
+            box.add(centers[elements[i].rank]);
+        const unsigned dim    = box.largest_dimension();
+        const unsigned middle = first+(last-first)/2;
+        std::nth_element(elements.begin()+first,elements.begin()+middle,elements.begin()+last,
+                         [&](const Element& e1,const Element& e2) { return centers[e1.rank](dim)<centers[e2.rank](dim); });
+
+        build(centers,first,middle);
+        nodes[current].right = nodes.size();
+        build(centers,middle,last);
+    }
+
+    bool TriangleBVH::up_to_date() const {
+        for (const auto& revision : revisions)
+            if (revision.first->revision()!=revision.second)
+                return false;
+        return true;
+    }
+
+    std::tuple<double,const Triangle&,const Mesh&> TriangleBVH::closest(const Vect3& p,Vect3& alphas) const {
+        om_error(!elements.empty());
+
+        //  The boxes are compared with a small relative tolerance, so that rounding errors in the distances to the
+        //  triangles never discard a box containing one of the closest triangles.
+
+        constexpr double tolerance = 1e-10;
+
+        double         distmin = std::numeric_limits<double>::max();
+        const Element* nearest = nullptr;
+        const auto& farther = [&](const unsigned node) { return nodes[node].box.distance(p)>distmin*(1.0+tolerance); };
+
+        std::vector<unsigned> stack = { 0 };
+        while (!stack.empty()) {
+            const unsigned node = stack.back();
+            stack.pop_back();
+            if (farther(node))
+                continue;
+
+            const Node& n = nodes[node];
+            if (n.right==0) {
+                for (unsigned i=n.first; i<n.last; ++i) {
+                    bool  inside;
+                    Vect3 alphasLoop;
+                    const double distance = dist_point_triangle(p,*elements[i].triangle,alphasLoop,inside);
+                    if (distance<distmin || (distance==distmin && elements[i].rank<nearest->rank)) {
+                        distmin = distance;
+                        alphas  = alphasLoop;
+                        nearest = &elements[i];
+                    }
+                }
+                continue;
+            }
+
+            //  Visit the closest child first (it is pushed last).
+
+            unsigned first  = node+1;
+            unsigned second = n.right;
+            if (nodes[first].box.distance(p)>nodes[second].box.distance(p))
+                std::swap(first,second);
+            stack.push_back(second);
+            stack.push_back(first);
+        }
+
+        return { distmin, *nearest->triangle, *nearest->mesh };
+    }
+
+    void TriangleBVH::overlapping(const BoundingBox& box,std::vector<const Triangle*>& triangles) const {
+        if (elements.empty())
+            return;
+
+        std::vector<unsigned> stack = { 0 };
+        while (!stack.empty()) {
+            const unsigned node = stack.back();
+            stack.pop_back();
+
+            const Node& n = nodes[node];
+            if (!n.box.intersects(box))
+                continue;
+
+            if (n.right==0) {
+                for (unsigned i=n.first; i<n.last; ++i)
+                    if (BoundingBox(*elements[i].triangle).intersects(box))
+                        triangles.push_back(elements[i].triangle);
+                continue;
+            }
+
+            stack.push_back(n.right);
+            stack.push_back(node+1);
+        }
+    }
+
+    //  The solid angle of a group of triangles seen from p is the sum of the integrals of K(y).n over the triangles, with
+    //  K(y) = (y-p)/|y-p|^3 = -grad(1/|y-p|). Its Taylor expansion around the center c of the group is:
+    //      K(c).moment+trace(J(c) spread) with J(c) = (I-3 u u^T)/|c-p|^3, u = (c-p)/|c-p|
+    //  (the first order term is exact on each triangle since the integral of y-c over a triangle is its area times its
+    //  center minus c). The remainder involves the third derivatives of 1/|y-p|, which are bounded by 3!/|y-p|^4
+    //  (the derivatives of 1/|x| along any directions are bounded by those along a single direction for symmetric forms,
+    //  which are given by Legendre polynomials bounded by 1). As |y-c|<=radius, |y-p|>=|c-p|-radius and the remainder
+    //  is bounded by 3*second/(|c-p|-radius)^4, where second is the integral of |y-c|^2 over the triangles.
+
+    double TriangleBVH::solid_angle(const Vect3& p,double& error_bound) const {
+        error_bound = 0.0;
+        if (elements.empty())
+            return 0.0;
+
+        const double budget = error_budget/nodes[0].area;
+
+        double solangle = 0.0;
+        std::vector<unsigned> stack = { 0 };
+        while (!stack.empty()) {
+            const Node& n = nodes[stack.back()];
+            stack.pop_back();
+
+            const Vect3& direction = n.center-p;
+            const double distance  = direction.norm();
+            const double gap       = distance-n.radius;
+            const double bound     = (distance>far_field*n.radius) ? 3*n.second/(gap*gap*gap*gap) : 0.0;
+            if (distance>far_field*n.radius && bound<=budget*n.area) {
+                const Vect3& u = direction/distance;
+                double trace  = 0.0;
+                double utsu   = 0.0;
+                for (unsigned k=0; k<3; ++k) {
+                    trace += n.spread[k][k];
+                    for (unsigned l=0; l<3; ++l)
+                        utsu += u(k)*n.spread[k][l]*u(l);
+                }
+                solangle    += (dotprod(direction,n.moment)+trace-3*utsu)/(distance*distance*distance);
+                error_bound += bound;
+            } else if (n.right==0) {
+                for (unsigned i=n.first; i<n.last; ++i) {
+                    const Triangle& triangle = *elements[i].triangle;
+                    solangle += elements[i].orientation*p.solid_angle(triangle.vertex(0),triangle.vertex(1),triangle.vertex(2));
+                }
+            } else {
+                stack.push_back(n.right);
+                stack.push_back(&n-nodes.data()+1);
+            }
+        }
+        return solangle;
+    }
+}
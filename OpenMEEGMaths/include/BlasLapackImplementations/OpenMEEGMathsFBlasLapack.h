@@ -12,6 +12,9 @@
         void LAPACK(dpptri,DPPTRI)(const char&,const int&,double*,int&);
         void LAPACK(dspevd,DSPEVD)(const char&,const char&,const int&,double*,double*,double*,const int&,double*,const int&,int*,const int&,int&);
         void LAPACK(dsptrs,DSPTRS)(const char&,const int&,const int&,double*,int*,double*,const int&,int&);
+        void LAPACK(dsytrf_rk,DSYTRF_RK)(const char&,const int&,double*,const int&,double*,int*,double*,const int&,int&);
+        void LAPACK(dsytrs_3,DSYTRS_3)(const char&,const int&,const int&,const double*,const int&,const double*,const int*,double*,const int&,int&);
+        void LAPACK(dsytri_3,DSYTRI_3)(const char&,const int&,double*,const int&,const double*,const int*,double*,const int&,int&);
     }
 #endif
 
@@ -27,6 +30,9 @@
 
 #define DSPTRF LAPACK(dsptrf,DSPTRF)
 #define DSPTRS LAPACK(dsptrs,DSPTRS)
+#define DSYTRF_RK LAPACK(dsytrf_rk,DSYTRF_RK)
+#define DSYTRS_3 LAPACK(dsytrs_3,DSYTRS_3)
+#define DSYTRI_3 LAPACK(dsytri_3,DSYTRI_3)
 #define DPPTRF LAPACK(dpptrf,DPPTRF)
 #define DPPTRI LAPACK(dpptri,DPPTRI)
 
@@ -9,6 +9,9 @@ extern "C" {
     void FC_GLOBAL(dsptrf,DSPTRF)(const char&,const int&,double*,int*,int&);
     void FC_GLOBAL(dsptrs,DSPTRS)(const char&,const int&,const int&,double*,int*,double*,const int&,int&);
     void FC_GLOBAL(dsptri,DSPTRI)(const char&,const int&,double*,int*,double*,int&);
+    void FC_GLOBAL(dsytrf_rk,DSYTRF_RK)(const char&,const int&,double*,const int&,double*,int*,double*,const int&,int&);
+    void FC_GLOBAL(dsytrs_3,DSYTRS_3)(const char&,const int&,const int&,const double*,const int&,const double*,const int*,double*,const int&,int&);
+    void FC_GLOBAL(dsytri_3,DSYTRI_3)(const char&,const int&,double*,const int&,const double*,const int*,double*,const int&,int&);
     void FC_GLOBAL(dpptrf,DPPTRF)(const char&,const int&,double*,int&);
     void FC_GLOBAL(dpptri,DPPTRI)(const char&,const int&,double*,int&);
 
@@ -20,6 +23,9 @@ extern "C" {
 #define DSPTRF FC_GLOBAL(dsptrf,DSPTRF)
 #define DSPTRS FC_GLOBAL(dsptrs,DSPTRS)
 #define DSPTRI FC_GLOBAL(dsptri,DSPTRI)
+#define DSYTRF_RK FC_GLOBAL(dsytrf_rk,DSYTRF_RK)
+#define DSYTRS_3 FC_GLOBAL(dsytrs_3,DSYTRS_3)
+#define DSYTRI_3 FC_GLOBAL(dsytri_3,DSYTRI_3)
 #define DPPTRF FC_GLOBAL(dpptrf,DPPTRF)
 #define DPPTRI FC_GLOBAL(dpptri,DPPTRI)
 
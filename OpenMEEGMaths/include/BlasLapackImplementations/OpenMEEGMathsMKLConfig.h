@@ -20,6 +20,9 @@ extern "C" {
 #define DSPTRF(X1,X2,X3,X4,X5)          LAPACK(dsptrf,DSPTRF)(LAPACK_COL_MAJOR,X1,X2,X3,X4)
 #define DSPTRS(X1,X2,X3,X4,X5,X6,X7,X8) LAPACK(dsptrs,DSPTRS)(LAPACK_COL_MAJOR,X1,X2,X3,X4,X5,X6,X7)
 #define DSPTRI(X1,X2,X3,X4,X5,X6)       LAPACK(dsptri,DSPTRI)(LAPACK_COL_MAJOR,X1,X2,X3,X4)
+#define DSYTRF_RK(X1,X2,X3,X4,X5,X6,X7,X8,X9)    LAPACK(dsytrf_rk,DSYTRF_RK)(LAPACK_COL_MAJOR,X1,X2,X3,X4,X5,X6)
+#define DSYTRS_3(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10) LAPACK(dsytrs_3,DSYTRS_3)(LAPACK_COL_MAJOR,X1,X2,X3,X4,X5,X6,X7,X8,X9)
+#define DSYTRI_3(X1,X2,X3,X4,X5,X6,X7,X8,X9)     LAPACK(dsytri_3,DSYTRI_3)(LAPACK_COL_MAJOR,X1,X2,X3,X4,X5,X6)
 #define DPPTRF(X1,X2,X3,X4)             LAPACK(dpptrf,DPPTRF)(LAPACK_COL_MAJOR,X1,X2,X3)
 #define DPPTRI(X1,X2,X3,X4)             LAPACK(dpptri,DPPTRI)(LAPACK_COL_MAJOR,X1,X2,X3)
 #define DGETRF(X1,X2,X3,X4,X5)          LAPACK(dgetrf,DGETRF)(LAPACK_COL_MAJOR,X1,X2,X3,X4,X5)
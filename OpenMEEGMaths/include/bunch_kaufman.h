@@ -0,0 +1,72 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "OpenMEEGMathsConfig.h"
+#include "vector.h"
+#include "matrix.h"
+#include "symmatrix.h"
+
+namespace OpenMEEG {
+
+    /// \brief Bunch-Kaufman factorization A = P U D U' P' of a symmetric (indefinite) matrix.
+    ///
+    /// The packed storage of SymMatrix only allows the level 2 BLAS routines DSPTRF/DSPTRS/DSPTRI, which scale poorly
+    /// with the number of cores. The factorization is thus computed on a full storage copy of the matrix with the blocked
+    /// routines DSYTRF_RK/DSYTRS_3/DSYTRI_3 (bounded Bunch-Kaufman pivoting), which rely on level 3 BLAS, including for
+    /// the solves with many right hand sides. This doubles the memory needed during the factorization. The factors are
+    /// not modified by the solves, which can thus be done concurrently.
+    ///
+    /// A factorization can be saved and reloaded, so that several gains can be computed from one O(N^3) factorization
+    /// with O(N^2) solves only. The file starts with a header (magic string, version and size) followed by the pivots,
+    /// the superdiagonal of D and the upper triangle of the factors, stored by columns as in SymMatrix.
+
+    class OPENMEEGMATHS_EXPORT BunchKaufman {
+    public:
+
+        BunchKaufman() { }
+        explicit BunchKaufman(const SymMatrix& A);
+        explicit BunchKaufman(const char* filename) { load(filename); }
+
+        Dimension size() const { return factors.nlin(); }
+
+        /// Replaces the columns of B by the solutions of A X = B.
+
+        void solve(Matrix& B) const;
+        void solve(Vector& B) const;
+
+        /// Inverse of A. When the factorization is no longer needed, the inverse is computed in place in its storage.
+
+        SymMatrix inverse() const& { Matrix inv(factors,DEEP_COPY); invert(inv); return SymMatrix(inv); }
+        SymMatrix inverse() &&     { invert(factors); return SymMatrix(factors); }
+
+        /// Stores the inverse of A in the packed storage of inv (which has the size of A), without any other copy than
+        /// the factors: the inverse is computed in their storage, so that the factorization is no longer usable.
+
+        void inverse(SymMatrix& inv) &&;
+
+        void save(const std::string& filename) const;
+        void load(const std::string& filename);
+
+        /// Tells whether filename contains a factorization (rather than a matrix).
+
+        static bool is_factorization_file(const std::string& filename);
+
+    private:
+
+        void solve(double* B,const Dimension nrhs) const;
+        void invert(Matrix& F) const;
+
+        Matrix                factors;   ///< U and the diagonal of D (upper triangle).
+        std::vector<double>   offdiag;   ///< Superdiagonal of D (non zero for its 2x2 blocks).
+        std::vector<BLAS_INT> pivots;
+    };
+}
@@ -0,0 +1,77 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#pragma once
+
+#include <string>
+#include <fstream>
+
+#include "OpenMEEGMathsConfig.h"
+#include "matrix.h"
+
+namespace OpenMEEG {
+
+    /// \brief Access by blocks of columns to a full matrix stored in a raw binary (.bin) file.
+    ///
+    /// Such a file contains the numbers of lines and columns followed by the values stored by columns (see TrivialBinIO),
+    /// so that a block of consecutive columns is a contiguous part of the file. This allows to process matrices which do
+    /// not fit in memory (e.g. source matrices of volumetric source spaces) one block of columns at a time.
+
+    class OPENMEEGMATHS_EXPORT ColumnBlocksReader {
+    public:
+
+        explicit ColumnBlocksReader(const std::string& filename);
+
+        Dimension nlin() const { return nlines;  }
+        Dimension ncol() const { return ncolumns; }
+
+        /// Reads the columns [first,first+n[ of the matrix.
+
+        Matrix read(const Index first,const Dimension n);
+
+        /// Tells whether filename designates a raw binary matrix file (the only format with block access).
+
+        static bool supported(const std::string& filename);
+
+    private:
+
+        std::string   name;
+        std::ifstream is;
+        Dimension     nlines;
+        Dimension     ncolumns;
+    };
+
+    /// \brief Writes a full matrix in a raw binary (.bin) file as a sequence of blocks of columns.
+    ///
+    /// The header is written at construction, and the blocks must be appended in order (the first block contains the
+    /// first columns of the matrix). The file is only valid once all the columns have been written.
+
+    class OPENMEEGMATHS_EXPORT ColumnBlocksWriter {
+    public:
+
+        ColumnBlocksWriter(const std::string& filename,const Dimension nlin,const Dimension ncol);
+
+        Dimension nlin() const { return nlines;  }
+        Dimension ncol() const { return ncolumns; }
+
+        /// Number of columns written so far.
+
+        Dimension written() const { return nwritten; }
+
+        /// Appends the columns of M (which must have nlin() lines) to the file.
+
+        void write(const Matrix& M);
+
+    private:
+
+        std::string   name;
+        std::ofstream os;
+        Dimension     nlines;
+        Dimension     ncolumns;
+        Dimension     nwritten = 0;
+    };
+}
@@ -21,6 +21,7 @@ namespace OpenMEEG {
     class SparseMatrix;
     class SymMatrix;
     class Vector;
+    class TransposedMatrix;
 
     /// \brief  Matrix class
     /// Matrix class
@@ -44,6 +45,7 @@ namespace OpenMEEG {
 
         explicit Matrix(const SymMatrix& A);
         explicit Matrix(const SparseMatrix& A);
+        explicit Matrix(const TransposedMatrix& A);
 
         Matrix(const Vector& v,const Dimension M,const Dimension N);
 
@@ -170,6 +172,99 @@ namespace OpenMEEG {
         return os;
     }
 
+    /// \brief View of the transpose of the first n lines of a matrix (of all its lines by default).
+    ///
+    /// The view shares the storage of the matrix and is handled by the products (see gemm) with the transposition flag
+    /// of BLAS, so that transposing costs nothing. The transpose is only copied when the view is converted to a Matrix.
+
+    class TransposedMatrix {
+    public:
+
+        explicit TransposedMatrix(const Matrix& M): TransposedMatrix(M,M.nlin()) { }
+        TransposedMatrix(const Matrix& M,const Dimension n): matrix(M),lines(n) { om_assert(n<=M.nlin()); }
+
+        Dimension nlin() const { return matrix.ncol(); }
+        Dimension ncol() const { return lines;         }
+        size_t    size() const { return static_cast<size_t>(nlin())*ncol(); }
+
+        double operator()(const Index i,const Index j) const {
+            om_assert(i<nlin() && j<ncol());
+            return matrix(j,i);
+        }
+
+        /// The matrix whose lines are viewed (in column major storage with leading dimension matrix().nlin()).
+
+        const Matrix& matrix_viewed() const { return matrix; }
+
+        Matrix operator*(const Matrix& B) const;
+        Matrix operator*(const TransposedMatrix& B) const;
+
+    private:
+
+        const Matrix    matrix;
+        const Dimension lines;
+    };
+
+    namespace details {
+
+        //  Description of an operand of a product for BLAS: storage, leading dimension and transposition.
+
+        struct BlasOperand {
+            const double* data;
+            Dimension     leading_dimension;
+            bool          transposed;
+        };
+
+        inline BlasOperand blas_operand(const Matrix& M)           { return { M.data(),M.nlin(),false };                                   }
+        inline BlasOperand blas_operand(const TransposedMatrix& M) { return { M.matrix_viewed().data(),M.matrix_viewed().nlin(),true }; }
+    }
+
+    /// \brief Computes C = alpha*A*B+beta*C, where A and B are matrices or transposed views of matrices.
+    ///
+    /// The product is accumulated in C, which avoids the temporaries of expressions such as C+A*B. If beta is 0, the
+    /// initial values of C are not used.
+
+    template <typename MatrixA,typename MatrixB>
+    void gemm(const double alpha,const MatrixA& A,const MatrixB& B,const double beta,Matrix& C) {
+        om_assert(A.ncol()==B.nlin() && C.nlin()==A.nlin() && C.ncol()==B.ncol());
+    #ifdef HAVE_BLAS
+        const details::BlasOperand& opA = details::blas_operand(A);
+        const details::BlasOperand& opB = details::blas_operand(B);
+        const BLAS_INT M = sizet_to_int(A.nlin());
+        const BLAS_INT N = sizet_to_int(A.ncol());
+        const BLAS_INT L = sizet_to_int(B.ncol());
+        DGEMM((opA.transposed) ? CblasTrans : CblasNoTrans,(opB.transposed) ? CblasTrans : CblasNoTrans,M,L,N,
+              alpha,opA.data,sizet_to_int(opA.leading_dimension),opB.data,sizet_to_int(opB.leading_dimension),
+              beta,C.data(),M);
+    #else
+        for (Index j=0; j<C.ncol(); ++j)
+            for (Index i=0; i<C.nlin(); ++i) {
+                double sum = 0.0;
+                for (Index k=0; k<A.ncol(); ++k)
+                    sum += A(i,k)*B(k,j);
+                C(i,j) = alpha*sum+((beta==0.0) ? 0.0 : beta*C(i,j));
+            }
+    #endif
+    }
+
+    inline Matrix::Matrix(const TransposedMatrix& A): Matrix(A.nlin(),A.ncol()) {
+        for (Index j=0; j<ncol(); ++j)
+            for (Index i=0; i<nlin(); ++i)
+                (*this)(i,j) = A(i,j);
+    }
+
+    inline Matrix TransposedMatrix::operator*(const Matrix& B) const {
+        Matrix C(nlin(),B.ncol());
+        gemm(1.0,*this,B,0.0,C);
+        return C;
+    }
+
+    inline Matrix TransposedMatrix::operator*(const TransposedMatrix& B) const {
+        Matrix C(nlin(),B.ncol());
+        gemm(1.0,*this,B,0.0,C);
+        return C;
+    }
+
     inline double Matrix::frobenius_norm() const {
         const size_t sz = size();
         if (sz==0)
@@ -333,19 +428,7 @@ namespace OpenMEEG {
     inline Matrix Matrix::operator*(const Matrix& B) const {
         om_assert(ncol()==B.nlin());
         Matrix C(nlin(),B.ncol());
-    #ifdef HAVE_BLAS
-        const BLAS_INT M = sizet_to_int(nlin());
-        const BLAS_INT N = sizet_to_int(ncol());
-        const BLAS_INT L = sizet_to_int(B.ncol());
-        DGEMM(CblasNoTrans,CblasNoTrans,M,L,N,1.0,data(),M,B.data(),N,0.0,C.data(),M);
-    #else
-        for (Index i=0; i<C.nlin(); ++i)
-            for (Index j=0; j<C.ncol(); ++j) {
-                C(i,j) = 0.0;
-                for (Index k=0; k<ncol(); ++k)
-                    C(i,j) += (*this)(i,k)*B(k,j);
-            }
-    #endif
+        gemm(1.0,*this,B,0.0,C);
         return C;
     }
 
@@ -406,29 +489,6 @@ namespace OpenMEEG {
         return C;
     }
 
-    inline Matrix Matrix::operator*(const SymMatrix& B) const {
-        om_assert(ncol()==B.nlin());
-        Matrix C(nlin(),B.ncol());
-
-    // Workaround an MKL bug
-    //#ifdef HAVE_BLAS
-    #if defined(HAVE_BLAS) && !defined(USE_MKL)
-        Matrix D(B);
-        const BLAS_INT m = sizet_to_int(nlin());
-        const BLAS_INT n = sizet_to_int(B.ncol());
-        DSYMM(CblasRight,CblasUpper,m,n,1.0,D.data(),n,data(),m,0.0,C.data(),m);
-    #else
-        for (Index j=0; j<B.ncol(); ++j)
-            for (Index i=0; i<nlin(); ++i) {
-                double sum = 0.0;
-                for (size_t k=0; k<ncol(); ++k)
-                    sum += (*this)(i,k)*B(k,j);
-                C(i,j) = sum;
-            }
-    #endif
-        return C;
-    }
-
     inline void Matrix::operator+=(const Matrix& B) {
         om_assert(nlin()==B.nlin());
         om_assert(ncol()==B.ncol());
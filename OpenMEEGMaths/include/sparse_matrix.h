@@ -9,68 +9,133 @@
 
 #include <OMassert.H>
 #include <map>
+#include <vector>
 #include <utility>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
 
 #include <linop.h>
 #include <vector.h>
 #include <matrix.h>
 
-#ifdef WIN32
-    template class OPENMEEGMATHS_EXPORT std::map<std::pair<size_t,size_t>,double>;
-#endif
-
 namespace OpenMEEG {
 
     class SymMatrix;
 
+    /// \brief Sparse matrix in compressed row storage (CSR).
+    ///
+    /// The non zero entries of line i are stored by increasing column indices at the positions [row_offsets()[i],
+    /// row_offsets()[i+1][ of column_indices() and values(). A matrix is either built at once from a list of triplets
+    /// (i,j,value), or entry by entry with operator()(i,j). In the latter case, the entries which are not yet stored are
+    /// kept apart and merged into the compressed storage when the matrix is next used by a const method, so a matrix
+    /// must not be shared between threads while it is being filled.
+
     class OPENMEEGMATHS_EXPORT SparseMatrix : public LinOp {
     public:
 
-        typedef std::map<std::pair<size_t,size_t>,double> Tank;
-        typedef Tank::const_iterator                      const_iterator;
-        typedef Tank::iterator                            iterator;
+        struct Triplet {
+            size_t i;
+            size_t j;
+            double value;
+        };
+
+        typedef std::vector<Triplet> Triplets;
+
+        /// Iterator over the non zero entries (by lines), giving ((i,j),value) pairs.
+
+        class const_iterator {
+        public:
+
+            typedef std::forward_iterator_tag                  iterator_category;
+            typedef std::pair<std::pair<size_t,size_t>,double> value_type;
+            typedef std::ptrdiff_t                             difference_type;
+            typedef const value_type*                          pointer;
+            typedef const value_type&                          reference;
+
+            const_iterator(): matrix(nullptr),index(0) { }
+            const_iterator(const SparseMatrix& m,const size_t k): matrix(&m),index(k) { update(); }
+
+            reference operator*()  const { return entry;  }
+            pointer   operator->() const { return &entry; }
 
-        SparseMatrix(): LinOp(0,0,SPARSE,2) {};
+            const_iterator& operator++()    { ++index; update(); return *this; }
+            const_iterator  operator++(int) { const_iterator it(*this); ++*this; return it; }
+
+            bool operator==(const const_iterator& it) const { return index==it.index; }
+            bool operator!=(const const_iterator& it) const { return index!=it.index; }
+
+        private:
+
+            void update() {
+                if (index>=matrix->columns.size())
+                    return;
+                while (matrix->offsets[line+1]<=index)
+                    ++line;
+                entry = value_type(std::make_pair(line,matrix->columns[index]),matrix->coefficients[index]);
+            }
+
+            const SparseMatrix* matrix;
+            size_t              index;
+            size_t              line = 0;
+            value_type          entry;
+        };
+
+        SparseMatrix(): LinOp(0,0,SPARSE,2) { }
         SparseMatrix(const char* fname): LinOp(0,0,SPARSE,2) { this->load(fname); }
-        SparseMatrix(const size_t N,const size_t M): LinOp(N,M,SPARSE,2) {};
-        ~SparseMatrix() {};
+        SparseMatrix(const size_t N,const size_t M): LinOp(N,M,SPARSE,2),offsets(N+1,0) { }
+
+        /// Matrix with the entries given by triplets (the values of duplicated entries are summed).
+
+        SparseMatrix(const size_t N,const size_t M,const Triplets& triplets);
+
+        ~SparseMatrix() { }
 
         inline double operator()(const size_t i,const size_t j) const {
             om_assert(i<nlin());
             om_assert(j<ncol());
-            const_iterator it = m_tank.find(std::make_pair(i,j));
-            return (it!=m_tank.end()) ? it->second : 0.0;
+            compress();
+            const size_t k = position(i,j);
+            return (k!=npos) ? coefficients[k] : 0.0;
         }
 
-        inline double& operator()( size_t i, size_t j ) {
+        inline double& operator()(const size_t i,const size_t j) {
             om_assert(i<nlin());
             om_assert(j<ncol());
-            return m_tank[std::make_pair(i,j)];
+            const size_t k = position(i,j);
+            return (k!=npos) ? coefficients[k] : pending[std::make_pair(i,j)];
         }
 
+        /// Number of stored entries.
+
         size_t size() const {
-            return m_tank.size();
+            compress();
+            return coefficients.size();
         }
 
-        const_iterator begin() const { return m_tank.begin(); }
-        const_iterator end()   const { return m_tank.end();   }
+        const_iterator begin() const { compress(); return const_iterator(*this,0);      }
+        const_iterator end()   const { compress(); return const_iterator(*this,size()); }
 
-        SparseMatrix transpose() const;
+        /// Compressed storage.
+
+        const std::vector<size_t>& row_offsets()    const { compress(); return offsets;      }
+        const std::vector<size_t>& column_indices() const { compress(); return columns;      }
+        const std::vector<double>& values()         const { compress(); return coefficients; }
 
-        const Tank& tank() const { return m_tank; }
+        SparseMatrix transpose() const;
 
         void set(const double d) {
-            for(auto& tkelmt : m_tank)
-                tkelmt.second = d;
+            compress();
+            std::fill(coefficients.begin(),coefficients.end(),d);
         }
 
         Vector getlin(const size_t i) const {
             om_assert(i<nlin());
+            compress();
             Vector v(ncol());
-            for (size_t j=0; j<ncol(); ++j) {
-                const_iterator it = m_tank.find(std::make_pair(i,j));
-                v(j) = (it!=m_tank.end()) ? it->second : 0.0;
-            }
+            v.set(0.0);
+            for (size_t k=offsets[i]; k<offsets[i+1]; ++k)
+                v(columns[k]) = coefficients[k];
             return v;
         }
 
@@ -112,6 +177,32 @@ namespace OpenMEEG {
 
     private:
 
-        Tank m_tank;
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        /// Position of entry (i,j) in the compressed storage (npos if it is not stored there).
+
+        size_t position(const size_t i,const size_t j) const {
+            if (i+1>=offsets.size())
+                return npos;
+            const auto first = columns.begin()+offsets[i];
+            const auto last  = columns.begin()+offsets[i+1];
+            const auto it    = std::lower_bound(first,last,j);
+            return (it!=last && *it==j) ? it-columns.begin() : npos;
+        }
+
+        /// Merges the pending entries into the compressed storage.
+
+        void compress() const {
+            if (!pending.empty() || offsets.size()!=nlin()+1)
+                merge_pending();
+        }
+
+        void merge_pending() const;
+
+        mutable std::vector<size_t> offsets;
+        mutable std::vector<size_t> columns;
+        mutable std::vector<double> coefficients;
+
+        mutable std::map<std::pair<size_t,size_t>,double> pending; ///< Entries created by operator()(i,j) since the last compress().
     };
 }
@@ -86,7 +86,7 @@ namespace OpenMEEG {
         void operator /=(const double x) { (*this)*=(1/x); }
 
         SymMatrix inverse() const;
-        void invert();
+        void invert(); ///< In place inversion (using a full N x N temporary for the factorization).
         SymMatrix posdefinverse() const;
         double det();
         // void eigen(Matrix& Z,Vector& D);
@@ -100,49 +100,13 @@ namespace OpenMEEG {
         friend class Matrix;
     };
 
-    // Returns the solution of (this)*X = B
+    /// \brief Computes C = alpha*A*B+beta*C (resp. C = alpha*B*A+beta*C) for a symmetric matrix A.
+    ///
+    /// The product is accumulated in C without unpacking A nor creating temporaries. If beta is 0, the initial values
+    /// of C are not used.
 
-    inline Vector SymMatrix::solveLin(const Vector& B) const {
-        SymMatrix invA(*this,DEEP_COPY);
-        Vector X(B,DEEP_COPY);
-
-    #ifdef HAVE_LAPACK
-        // Bunch Kaufman factorization
-        BLAS_INT* pivots=new BLAS_INT[nlin()];
-        int Info = 0;
-        DSPTRF('U',sizet_to_int(invA.nlin()),invA.data(),pivots,Info);
-        // Inverse
-        DSPTRS('U',sizet_to_int(invA.nlin()),1,invA.data(),pivots,X.data(),sizet_to_int(invA.nlin()),Info);
-
-        om_assert(Info==0);
-        delete[] pivots;
-    #else
-        std::cout << "solveLin not defined" << std::endl;
-    #endif
-        return X;
-    }
-
-    // stores in B the solution of (this)*X = B, where B is a set of nbvect vector
-
-    inline void SymMatrix::solveLin(Vector* B,const int nbvect) {
-        SymMatrix invA(*this,DEEP_COPY);
-
-    #ifdef HAVE_LAPACK
-        // Bunch Kaufman Factorization
-        BLAS_INT *pivots=new BLAS_INT[nlin()];
-        int Info = 0;
-        //char *uplo="U";
-        DSPTRF('U',sizet_to_int(invA.nlin()),invA.data(),pivots,Info);
-        // Inverse
-        for(int i = 0; i < nbvect; i++)
-            DSPTRS('U',sizet_to_int(invA.nlin()),1,invA.data(),pivots,B[i].data(),sizet_to_int(invA.nlin()),Info);
-
-        om_assert(Info==0);
-        delete[] pivots;
-    #else
-        std::cout << "solveLin not defined" << std::endl;
-    #endif
-    }
+    OPENMEEGMATHS_EXPORT void symm(const double alpha,const SymMatrix& A,const Matrix& B,const double beta,Matrix& C);
+    OPENMEEGMATHS_EXPORT void symm(const double alpha,const Matrix& B,const SymMatrix& A,const double beta,Matrix& C);
 
     inline void SymMatrix::operator+=(const SymMatrix& B) {
         om_assert(nlin()==B.nlin());
@@ -251,47 +215,6 @@ namespace OpenMEEG {
         return C;
     }
 
-    inline SymMatrix SymMatrix::inverse() const {
-    #ifdef HAVE_LAPACK
-        SymMatrix invA(*this, DEEP_COPY);
-        // LU
-        BLAS_INT* pivots = new BLAS_INT[nlin()];
-        int Info = 0;
-        const BLAS_INT M = sizet_to_int(nlin());
-        DSPTRF('U',M,invA.data(),pivots,Info);
-        // Inverse
-        double* work = new double[nlin()*64];
-        DSPTRI('U',M,invA.data(),pivots,work,Info);
-
-        om_assert(Info==0);
-        delete[] pivots;
-        delete[] work;
-        return invA;
-    #else
-        throw OpenMEEG::maths::LinearAlgebraError("Inverse not implemented, requires LAPACK");
-    #endif
-    }
-
-    inline void SymMatrix::invert() {
-    #ifdef HAVE_LAPACK
-        // LU
-        BLAS_INT* pivots = new BLAS_INT[nlin()];
-        int Info = 0;
-        const BLAS_INT M = sizet_to_int(nlin());
-        DSPTRF('U',M,data(),pivots,Info);
-        // Inverse
-        double* work = new double[nlin()*64];
-        DSPTRI('U',M,data(),pivots,work,Info);
-
-        om_assert(Info==0);
-        delete[] pivots;
-        delete[] work;
-        return;
-    #else
-        throw OpenMEEG::maths::LinearAlgebraError("Inverse not implemented, requires LAPACK");
-    #endif
-    }
-
     inline Vector SymMatrix::operator*(const Vector& v) const {
         om_assert(nlin()==v.size());
         Vector y(nlin());
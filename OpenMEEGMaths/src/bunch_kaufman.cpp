@@ -0,0 +1,135 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#include <OMMathExceptions.H>
+#include <bunch_kaufman.h>
+
+namespace OpenMEEG {
+
+    // Block size of the blocked LAPACK routines, used to size their workspaces.
+
+    constexpr BLAS_INT block_size = 64;
+
+    // Header of the factorization files.
+
+    constexpr char          magic[8] = "OMBKFAC";
+    constexpr std::uint32_t version  = 1;
+
+    BunchKaufman::BunchKaufman(const SymMatrix& A): factors(A),offdiag(A.nlin()),pivots(A.nlin()) {
+    #ifdef HAVE_LAPACK
+        // Only the upper triangle of factors is used.
+        const BLAS_INT N = sizet_to_int(size());
+        const BLAS_INT lwork = std::max(N,1)*block_size;
+        std::vector<double> work(lwork);
+        int Info = 0;
+        DSYTRF_RK('U',N,factors.data(),std::max(N,1),offdiag.data(),pivots.data(),work.data(),lwork,Info);
+        if (Info!=0)
+            throw maths::LinearAlgebraError("Bunch-Kaufman factorization failed (the matrix is probably singular).");
+    #else
+        throw maths::LinearAlgebraError("Bunch-Kaufman factorization not defined without LAPACK");
+    #endif
+    }
+
+    void BunchKaufman::solve(double* B,const Dimension nrhs) const {
+    #ifdef HAVE_LAPACK
+        const BLAS_INT N = sizet_to_int(size());
+        int Info = 0;
+        DSYTRS_3('U',N,sizet_to_int(nrhs),factors.data(),std::max(N,1),offdiag.data(),pivots.data(),B,std::max(N,1),Info);
+        om_assert(Info==0);
+    #else
+        throw maths::LinearAlgebraError("Bunch-Kaufman solve not defined without LAPACK");
+    #endif
+    }
+
+    void BunchKaufman::solve(Matrix& B) const {
+        om_assert(B.nlin()==size());
+        solve(B.data(),B.ncol());
+    }
+
+    void BunchKaufman::solve(Vector& B) const {
+        om_assert(B.size()==size());
+        solve(B.data(),1);
+    }
+
+    // Replaces the factors F (a copy of factors or factors itself) by the inverse of A (upper triangle).
+
+    void BunchKaufman::invert(Matrix& F) const {
+    #ifdef HAVE_LAPACK
+        const BLAS_INT N = sizet_to_int(size());
+        const BLAS_INT lwork = (N+block_size+1)*(block_size+3);
+        std::vector<double> work(lwork);
+        int Info = 0;
+        DSYTRI_3('U',N,F.data(),std::max(N,1),offdiag.data(),pivots.data(),work.data(),lwork,Info);
+        om_assert(Info==0);
+    #else
+        throw maths::LinearAlgebraError("Inverse not implemented, requires LAPACK");
+    #endif
+    }
+
+    void BunchKaufman::inverse(SymMatrix& inv) && {
+        om_assert(inv.nlin()==size());
+        invert(factors);
+        const Dimension N = size();
+        for (Dimension j=0; j<N; ++j)
+            std::copy(factors.data()+j*N,factors.data()+j*N+j+1,inv.data()+j*(j+1)/2);
+    }
+
+    void BunchKaufman::save(const std::string& filename) const {
+        std::ofstream ofs(filename,std::ios::binary);
+        if (!ofs)
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::WRITE);
+
+        const std::uint64_t n = size();
+        const std::vector<std::int32_t> ipiv(pivots.begin(),pivots.end());
+        ofs.write(magic,sizeof(magic));
+        ofs.write(reinterpret_cast<const char*>(&version),sizeof(version));
+        ofs.write(reinterpret_cast<const char*>(&n),sizeof(n));
+        ofs.write(reinterpret_cast<const char*>(ipiv.data()),n*sizeof(std::int32_t));
+        ofs.write(reinterpret_cast<const char*>(offdiag.data()),n*sizeof(double));
+        for (Dimension j=0; j<n; ++j)
+            ofs.write(reinterpret_cast<const char*>(factors.data()+j*n),(j+1)*sizeof(double));
+        if (!ofs)
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::WRITE);
+    }
+
+    void BunchKaufman::load(const std::string& filename) {
+        std::ifstream ifs(filename,std::ios::binary);
+        if (!ifs)
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::READ);
+
+        char          header[sizeof(magic)];
+        std::uint32_t file_version;
+        std::uint64_t n;
+        ifs.read(header,sizeof(header));
+        ifs.read(reinterpret_cast<char*>(&file_version),sizeof(file_version));
+        ifs.read(reinterpret_cast<char*>(&n),sizeof(n));
+        if (!ifs || std::memcmp(header,magic,sizeof(magic))!=0 || file_version!=version)
+            throw maths::BadHeader(ifs);
+
+        std::vector<std::int32_t> ipiv(n);
+        offdiag.resize(n);
+        factors = Matrix(n,n);
+        ifs.read(reinterpret_cast<char*>(ipiv.data()),n*sizeof(std::int32_t));
+        ifs.read(reinterpret_cast<char*>(offdiag.data()),n*sizeof(double));
+        for (Dimension j=0; j<n; ++j)
+            ifs.read(reinterpret_cast<char*>(factors.data()+j*n),(j+1)*sizeof(double));
+        if (!ifs)
+            throw maths::BadData(ifs,"Bunch-Kaufman factorization");
+        pivots.assign(ipiv.begin(),ipiv.end());
+    }
+
+    bool BunchKaufman::is_factorization_file(const std::string& filename) {
+        std::ifstream ifs(filename,std::ios::binary);
+        char header[sizeof(magic)];
+        return ifs.read(header,sizeof(header)) && std::memcmp(header,magic,sizeof(magic))==0;
+    }
+}
@@ -0,0 +1,81 @@
+// Project Name: OpenMEEG (http://openmeeg.github.io)
+// © INRIA and ENPC under the French open source license CeCILL-B.
+// See full copyright notice in the file LICENSE.txt
+// If you make a copy of this file, you must either:
+// - provide also LICENSE.txt and modify this header to refer to it.
+// - replace this header by the LICENSE.txt content.
+
+#include <OMMathExceptions.H>
+#include <MathsIO.H>
+#include <column_blocks.h>
+
+namespace OpenMEEG {
+
+    // Size of the header of raw binary matrix files (numbers of lines and of columns).
+
+    constexpr std::streamoff header_size = 2*sizeof(unsigned);
+
+    ColumnBlocksReader::ColumnBlocksReader(const std::string& filename): name(filename),is(filename,std::ios::binary) {
+        if (is.fail())
+            throw maths::BadFileOpening(name,maths::BadFileOpening::READ);
+
+        unsigned dims[2];
+        if (!is.read(reinterpret_cast<char*>(dims),sizeof(dims)))
+            throw maths::BadHeader(is);
+        nlines   = dims[0];
+        ncolumns = dims[1];
+
+        //  Check that the file contains a full matrix (and not a vector, a symmetric or a sparse matrix).
+
+        is.seekg(0,std::ios::end);
+        const std::streamoff size = static_cast<std::streamoff>(nlines)*ncolumns*sizeof(double);
+        if (static_cast<std::streamoff>(is.tellg())!=header_size+size)
+            throw maths::BadStorageType(name);
+    }
+
+    Matrix ColumnBlocksReader::read(const Index first,const Dimension n) {
+        om_assert(first+n<=ncol());
+
+        Matrix M(nlin(),n);
+        const std::size_t column_size = nlin()*sizeof(double);
+        is.seekg(header_size+static_cast<std::streamoff>(first)*column_size);
+
+        // Read column by column to avoid the very large reads which fail with some C++ libraries (see TrivialBinIO).
+
+        for (Index j=0; j<n; ++j)
+            if (!is.read(reinterpret_cast<char*>(M.data())+j*column_size,column_size))
+                throw maths::BadData(is,"raw binary matrix "+name);
+
+        return M;
+    }
+
+    bool ColumnBlocksReader::supported(const std::string& filename) {
+        try {
+            return maths::MathsIO::format_from_suffix(filename)->identity()=="binary";
+        } catch (maths::Exception&) {
+            return false;
+        }
+    }
+
+    ColumnBlocksWriter::ColumnBlocksWriter(const std::string& filename,const Dimension nlin,const Dimension ncol):
+        name(filename),os(filename,std::ios::binary),nlines(nlin),ncolumns(ncol)
+    {
+        if (os.fail())
+            throw maths::BadFileOpening(name,maths::BadFileOpening::WRITE);
+
+        const unsigned dims[2] = { nlines, ncolumns };
+        os.write(reinterpret_cast<const char*>(dims),sizeof(dims));
+    }
+
+    void ColumnBlocksWriter::write(const Matrix& M) {
+        om_assert(M.nlin()==nlin() && written()+M.ncol()<=ncol());
+
+        const std::size_t column_size = nlin()*sizeof(double);
+        for (Index j=0; j<M.ncol(); ++j)
+            os.write(reinterpret_cast<const char*>(M.data())+j*column_size,column_size);
+        if (os.fail())
+            throw maths::BadFileOpening(name,maths::BadFileOpening::WRITE);
+
+        nwritten += M.ncol();
+    }
+}
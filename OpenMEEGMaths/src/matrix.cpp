@@ -43,40 +43,41 @@ namespace OpenMEEG {
 
     /// pseudo inverse
     Matrix Matrix::pinverse(const double tolrel) const {
-        if (ncol()>nlin())
-            return transpose().pinverse().transpose();
-
         Matrix U,V;
         SparseMatrix S;
         svd(U,S,V,false);
+        const Dimension mini = std::min(nlin(),ncol());
+        if (mini==0)
+            return Matrix(ncol(),nlin());
+
         // Following LAPACK The singular values of A, sorted so that S(i) >= S(i+1).
         const double atol = S(0,0)*((tolrel==0.0) ? std::numeric_limits<double>::epsilon() : tolrel);
         const double tol = std::max(nlin(),ncol())* atol;
 
-        // Since here nlin()>=ncol(), S minimum dimension is ncol().
-
         Dimension rank = 0;
-        for (Index i=0; i<ncol(); ++i)
+        for (Index i=0; i<mini; ++i)
             if (S(i,i)>tol)
                 ++rank;
 
+        Matrix result(ncol(),nlin());
         if (rank==0) {
-            Matrix result(ncol(),nlin());
             result.set(0.0);
             return result;
         }
 
-        Matrix D(rank,rank);
-        D.set(0.0);
-        for (Index i=0; i<rank; ++i)
-            D(i,i) = 1.0/S(i,i);
-
-        // Keep only the first rank columns of U and V.
+        // With A = U*S*V (V being already transposed by svd), the pseudo inverse is Vr'*Sr^{-1}*Ur', where Ur and Vr are
+        // the first rank columns of U and lines of V. Ur*Sr^{-1} is formed in place in U, and the transpositions are
+        // handled by the product, whatever the shape of the matrix.
 
-        const Matrix Vr(V.transpose(),rank);
-        const Matrix Ur(U,rank);
+        Matrix Ur(U,rank);
+        for (Index j=0; j<rank; ++j) {
+            const double inv = 1.0/S(j,j);
+            for (Index i=0; i<nlin(); ++i)
+                Ur(i,j) *= inv;
+        }
 
-        return Vr*D*Ur.transpose();
+        gemm(1.0,TransposedMatrix(V,rank),TransposedMatrix(Ur),0.0,result);
+        return result;
     }
 
     Matrix Matrix::transpose() const {
@@ -125,17 +126,33 @@ namespace OpenMEEG {
     #endif
     }
 
+    Matrix Matrix::operator*(const SymMatrix& B) const {
+        om_assert(ncol()==B.nlin());
+        Matrix C(nlin(),B.ncol());
+        symm(1.0,*this,B,0.0,C);
+        return C;
+    }
+
     Matrix Matrix::operator*(const SparseMatrix& mat) const {
         om_assert(ncol()==mat.nlin());
         Matrix out(nlin(),mat.ncol());
         out.set(0.0);
 
-        for (SparseMatrix::const_iterator it=mat.begin(); it!=mat.end(); ++it) {
-            const Index i = it->first.first;
-            const Index j = it->first.second;
-            const double val = it->second;
-            for (Index k=0; k<nlin(); ++k)
-                out(k,j) += (*this)(k,i)*val;
+        //  Column j of the result combines the columns of this matrix given by the line j of the transpose of mat.
+
+        const SparseMatrix& matT = mat.transpose();
+        const std::vector<size_t>& offsets = matT.row_offsets();
+        const std::vector<size_t>& columns = matT.column_indices();
+        const std::vector<double>& values  = matT.values();
+
+        #pragma omp parallel for
+        for (int j=0; j<static_cast<int>(mat.ncol()); ++j) {
+            double* y = out.data()+static_cast<size_t>(j)*nlin();
+            for (size_t k=offsets[j]; k<offsets[j+1]; ++k) {
+                const double* x = data()+columns[k]*nlin();
+                for (Index i=0; i<nlin(); ++i)
+                    y[i] += values[k]*x[i];
+            }
         }
         return out;
     }
@@ -12,39 +12,152 @@ namespace OpenMEEG {
 
     static inline double sqr(const double x) { return x*x; }
 
+    SparseMatrix::SparseMatrix(const size_t N,const size_t M,const Triplets& triplets): LinOp(N,M,SPARSE,2),offsets(N+1,0) {
+
+        //  Sort the triplets by lines (counting sort) and then by columns within each line.
+
+        for (const auto& triplet : triplets) {
+            om_assert(triplet.i<N && triplet.j<M);
+            ++offsets[triplet.i+1];
+        }
+        for (size_t i=0; i<N; ++i)
+            offsets[i+1] += offsets[i];
+
+        std::vector<std::pair<size_t,double>> entries(triplets.size());
+        std::vector<size_t> next(offsets.begin(),offsets.end()-1);
+        for (const auto& triplet : triplets)
+            entries[next[triplet.i]++] = std::make_pair(triplet.j,triplet.value);
+
+        //  Store the entries, summing the duplicated ones.
+
+        columns.reserve(entries.size());
+        coefficients.reserve(entries.size());
+        size_t first = 0;
+        for (size_t i=0; i<N; ++i) {
+            const auto begin = entries.begin()+first;
+            const auto end   = entries.begin()+offsets[i+1];
+            std::sort(begin,end,[](const auto& e1,const auto& e2) { return e1.first<e2.first; });
+            for (auto it=begin; it!=end; ++it)
+                if (columns.size()>offsets[i] && columns.back()==it->first) {
+                    coefficients.back() += it->second;
+                } else {
+                    columns.push_back(it->first);
+                    coefficients.push_back(it->second);
+                }
+            first = offsets[i+1];
+            offsets[i+1] = columns.size();
+        }
+    }
+
+    void SparseMatrix::merge_pending() const {
+
+        //  The lines of the compressed storage may differ from nlin() if the dimensions were changed after the
+        //  construction (e.g. when reading a matrix from a file).
+
+        const size_t nlines = (offsets.empty()) ? 0 : offsets.size()-1;
+
+        std::vector<size_t> new_offsets(nlin()+1,0);
+        std::vector<size_t> new_columns;
+        std::vector<double> new_coefficients;
+        new_columns.reserve(columns.size()+pending.size());
+        new_coefficients.reserve(columns.size()+pending.size());
+
+        auto p = pending.begin();
+        for (size_t i=0; i<nlin(); ++i) {
+            size_t       k   = (i<nlines) ? offsets[i]   : 0;
+            const size_t end = (i<nlines) ? offsets[i+1] : 0;
+            while (k<end || (p!=pending.end() && p->first.first==i)) {
+                const bool from_pending = (k==end) || (p!=pending.end() && p->first.first==i && p->first.second<columns[k]);
+                if (from_pending) {
+                    new_columns.push_back(p->first.second);
+                    new_coefficients.push_back(p->second);
+                    ++p;
+                } else {
+                    new_columns.push_back(columns[k]);
+                    new_coefficients.push_back(coefficients[k]);
+                    ++k;
+                }
+            }
+            new_offsets[i+1] = new_columns.size();
+        }
+        om_assert(p==pending.end());
+
+        offsets.swap(new_offsets);
+        columns.swap(new_columns);
+        coefficients.swap(new_coefficients);
+        pending.clear();
+    }
+
     double SparseMatrix::frobenius_norm() const {
         double d = 0.;
-        for (const auto& tkelmt : m_tank)
-            d += sqr(tkelmt.second);
+        for (const auto& value : values())
+            d += sqr(value);
         return sqrt(d);
     }
 
+    //  The products are computed by lines of the sparse matrix, for each column of the right hand side. Each entry of the
+    //  result is thus obtained by a single thread, which sums the (few) non zero terms of the line, and the work is
+    //  distributed over all the (line,column) pairs.
+
     Vector SparseMatrix::operator*(const Vector& x) const {
+        om_assert(ncol()==x.nlin());
+        compress();
         Vector ret(nlin());
-        ret.set(0);
 
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            const double val = tkelmt.second;
-            ret(i) += val*x(j);
+        #pragma omp parallel for
+        for (int i=0; i<static_cast<int>(nlin()); ++i) {
+            double sum = 0.0;
+            for (size_t k=offsets[i]; k<offsets[i+1]; ++k)
+                sum += coefficients[k]*x(columns[k]);
+            ret(i) = sum;
         }
 
         return ret;
     }
 
-    Matrix SparseMatrix::operator*(const SymMatrix& mat) const
-    {
+    //  The lines of the product are combinations of the (few) lines of the symmetric matrix selected by the non zero
+    //  entries (e.g. the 3 vertices of the triangle containing an EEG sensor). These lines are gathered directly from the
+    //  packed storage: for a line r, the entries of columns c<r are contiguous (they are the top of the packed column r),
+    //  while the entry of column c>=r is at r+c(c+1)/2. The columns are processed by blocks, which are accumulated in a
+    //  small buffer and shared by all the lines handled by a thread, so that the parts of the packed columns they touch
+    //  stay in cache.
+
+    Matrix SparseMatrix::operator*(const SymMatrix& mat) const {
         om_assert(ncol()==mat.nlin());
-        Matrix out(nlin(),mat.ncol());
-        out.set(0.0);
-
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            const double val = tkelmt.second;
-            for (size_t k=0; k<mat.ncol(); ++k)
-                out(i,k) += val*mat(j,k);
+        compress();
+
+        constexpr size_t block_size = 256;
+
+        const size_t  n = mat.ncol();
+        const double* S = mat.data();
+        Matrix out(nlin(),n);
+
+        #pragma omp parallel
+        {
+            double acc[block_size];
+            for (size_t first=0; first<n; first+=block_size) {
+                const size_t last = std::min(first+block_size,n);
+
+                #pragma omp for schedule(static) nowait
+                for (int i=0; i<static_cast<int>(nlin()); ++i) {
+                    std::fill(acc,acc+(last-first),0.0);
+                    for (size_t k=offsets[i]; k<offsets[i+1]; ++k) {
+                        const size_t r     = columns[k];
+                        const double value = coefficients[k];
+                        const size_t split = std::max(first,std::min(r,last));
+
+                        const double* line = S+r*(r+1)/2;
+                        for (size_t c=first; c<split; ++c)
+                            acc[c-first] += value*line[c];
+
+                        size_t pos = r+split*(split+1)/2;
+                        for (size_t c=split; c<last; pos+=++c)
+                            acc[c-first] += value*S[pos];
+                    }
+                    for (size_t c=first; c<last; ++c)
+                        out(i,c) = acc[c-first];
+                }
+            }
         }
 
         return out;
@@ -52,87 +165,82 @@ namespace OpenMEEG {
 
     Matrix SparseMatrix::operator*(const Matrix& mat) const {
         om_assert(ncol()==mat.nlin());
+        compress();
         Matrix out(nlin(),mat.ncol());
-        out.set(0.0);
-
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            const double val = tkelmt.second;
-            for (size_t k=0; k<mat.ncol(); ++k)
-                out(i,k) += val*mat(j,k);
-        }
+
+        #pragma omp parallel for collapse(2)
+        for (int c=0; c<static_cast<int>(mat.ncol()); ++c)
+            for (int i=0; i<static_cast<int>(nlin()); ++i) {
+                const double* x = mat.data()+static_cast<size_t>(c)*mat.nlin();
+                double sum = 0.0;
+                for (size_t k=offsets[i]; k<offsets[i+1]; ++k)
+                    sum += coefficients[k]*x[columns[k]];
+                out(i,c) = sum;
+            }
 
         return out;
     }
 
     SparseMatrix SparseMatrix::operator*(const SparseMatrix& mat) const {
-        // fast enough ?
         om_assert(ncol()==mat.nlin());
-        SparseMatrix out(nlin(),mat.ncol());
-
-        for (const auto& tkelmt1 : m_tank) {
-            const size_t i = tkelmt1.first.first;
-            const size_t j = tkelmt1.first.second;
-            for (const auto& elmt2 : mat)
-                if (elmt2.first.first==j)
-                    out(i,elmt2.first.second) += tkelmt1.second*elmt2.second;
-        }
-        return out;
+        compress();
+        mat.compress();
+
+        //  Line i of the product combines the lines of mat given by the columns of line i of this matrix.
+
+        Triplets triplets;
+        for (size_t i=0; i<nlin(); ++i)
+            for (size_t k=offsets[i]; k<offsets[i+1]; ++k)
+                for (size_t l=mat.offsets[columns[k]]; l<mat.offsets[columns[k]+1]; ++l)
+                    triplets.push_back({ i, mat.columns[l], coefficients[k]*mat.coefficients[l] });
+
+        return SparseMatrix(nlin(),mat.ncol(),triplets);
     }
 
     SparseMatrix SparseMatrix::operator+(const SparseMatrix& mat) const {
         om_assert(nlin()==mat.nlin() && ncol()==mat.ncol());
-        SparseMatrix out(nlin(),ncol());
 
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            out(i,j) += tkelmt.second;
-        }
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            out(i,j) += tkelmt.second;
-        }
-        return out;
+        Triplets triplets;
+        triplets.reserve(size()+mat.size());
+        for (const auto& m : { this, &mat })
+            for (const auto& entry : *m)
+                triplets.push_back({ entry.first.first, entry.first.second, entry.second });
+
+        return SparseMatrix(nlin(),ncol(),triplets);
     }
 
     SparseMatrix SparseMatrix::transpose() const {
-        SparseMatrix tsp(ncol(),nlin());
-        for (const auto& tkelmt : m_tank) {
-            const size_t i = tkelmt.first.first;
-            const size_t j = tkelmt.first.second;
-            tsp(j,i) = tkelmt.second;
-        }
-        return tsp;
+        Triplets triplets;
+        triplets.reserve(size());
+        for (const auto& entry : *this)
+            triplets.push_back({ entry.first.second, entry.first.first, entry.second });
+        return SparseMatrix(ncol(),nlin(),triplets);
     }
 
-
     void SparseMatrix::info() const {
-        if (nlin()==0 || ncol()==0 || m_tank.empty()) {
+        if (nlin()==0 || ncol()==0 || size()==0) {
             std::cout << "Matrix Empty" << std::endl;
             return;
         }
 
         std::cout << "Dimensions : " << nlin() << " x " << ncol() << std::endl;
 
-        double minv = m_tank.begin()->second;
-        double maxv = m_tank.begin()->second;
+        double minv = coefficients.front();
+        double maxv = coefficients.front();
         size_t mini = 0;
         size_t maxi = 0;
         size_t minj = 0;
         size_t maxj = 0;
 
-        for (const auto& tkelmt : m_tank)
-            if (minv>tkelmt.second) {
-                minv = tkelmt.second;
-                mini = tkelmt.first.first;
-                minj = tkelmt.first.second;
-            } else if (maxv<tkelmt.second) {
-                maxv = tkelmt.second;
-                maxi = tkelmt.first.first;
-                maxj = tkelmt.first.second;
+        for (const auto& entry : *this)
+            if (minv>entry.second) {
+                minv = entry.second;
+                mini = entry.first.first;
+                minj = entry.first.second;
+            } else if (maxv<entry.second) {
+                maxv = entry.second;
+                maxi = entry.first.first;
+                maxj = entry.first.second;
             }
 
         std::cout << "Min Value : " << minv << " (" << mini << "," << minj << ")" << std::endl;
@@ -140,8 +248,8 @@ namespace OpenMEEG {
         std::cout << "First Values" << std::endl;
 
         size_t cnt = 0;
-        for (const auto& tkelmt : m_tank) {
-            std::cout << "(" << tkelmt.first.first << "," << tkelmt.first.second << ") " << tkelmt.second << std::endl;
+        for (const auto& entry : *this) {
+            std::cout << "(" << entry.first.first << "," << entry.first.second << ") " << entry.second << std::endl;
             if (++cnt==5)
                 break;
         }
@@ -9,10 +9,12 @@
 #include <cmath>
 #include <cstdlib>
 #include <algorithm>
+#include <vector>
 
 #include "OpenMEEGMathsConfig.h"
 #include "matrix.h"
 #include "symmatrix.h"
+#include "bunch_kaufman.h"
 
 namespace OpenMEEG {
 
@@ -84,69 +86,151 @@ namespace OpenMEEG {
         return mat;
     }
 
-    Matrix SymMatrix::operator*(const SymMatrix& m) const {
-        om_assert(nlin()==m.nlin());
-    // Workaround an MKL bug
-    //#ifdef HAVE_BLAS
-    #if defined(HAVE_BLAS) && !defined(USE_MKL)
-        Matrix D(*this);
-        Matrix B(m);
-        Matrix C(nlin(),nlin());
-        const BLAS_INT M = sizet_to_int(nlin());
-        DSYMM(CblasLeft,CblasUpper,M,M,1.0,D.data(),M,B.data(),M,0.0,C.data(),M);
-    #else
-        Matrix C(nlin());
-        for (Index j = 0; j<m.ncol(); ++j)
-            for (Index i=0; i<ncol(); ++i) {
-                C(i,j) = 0;
-                for (Index k=0; k<ncol(); ++k)
-                    C(i,j) += (*this)(i,k)*m(k,j);
+    // The products with a symmetric matrix S in packed storage are computed without unpacking the whole of S. S is
+    // processed by panels of columns J=[first,last[: the part S(0:last,J) of the panel on and above the diagonal (which
+    // is contiguous in the packed storage) is copied in a buffer U, and the lower part of its diagonal block is filled
+    // by symmetry. Each panel contributes to the product by two level 3 BLAS calls:
+    //   S*B: C(0:last,:) += U*B(J,:)           and  C(J,:) += U(0:first,:)^T*B(0:first,:)
+    //   B*S: C(:,0:last) += B(:,J)*U^T         and  C(:,J) += B(:,0:first)*U(0:first,:)
+    // where the second calls account for the entries S(J,0:first) left of the panel, by symmetry. DGEMM is used for
+    // all of them, which also avoids the DSYMM bug of MKL.
+
+    namespace {
+    #ifdef HAVE_BLAS
+        constexpr Dimension panel_size = 128;
+
+        void unpack_panel(const SymMatrix& S,const Index first,const Index last,double* panel) {
+            const double* packed = S.data();
+            #pragma omp parallel for
+            for (int j=first; j<static_cast<int>(last); ++j) {
+                double* column = panel+static_cast<size_t>(j-first)*last;
+                std::copy(packed+static_cast<size_t>(j)*(j+1)/2,packed+static_cast<size_t>(j+1)*(j+2)/2,column);
+                for (Index i=j+1; i<last; ++i)
+                    column[i] = packed[j+static_cast<size_t>(i)*(i+1)/2];
             }
+        }
     #endif
-        return C;
+
+        void scale(const double beta,Matrix& C) {
+            if (beta==0.0)
+                C.set(0.0);
+            else if (beta!=1.0)
+                C *= beta;
+        }
     }
 
-    Matrix SymMatrix::operator*(const Matrix& B) const {
-        om_assert(ncol()==B.nlin());
-        Matrix C(nlin(),B.ncol());
-    // Workaround an MKL bug
-    //#ifdef HAVE_BLAS
-    #if defined(HAVE_BLAS) && !defined(USE_MKL)
-        Matrix D(*this);
-        const BLAS_INT M = sizet_to_int(nlin());
-        const BLAS_INT N = sizet_to_int(B.ncol());
-        DSYMM(CblasLeft,CblasUpper,M,N,1.0,D.data(),M,B.data(),M,0.0,C.data(),M);
+    void symm(const double alpha,const SymMatrix& A,const Matrix& B,const double beta,Matrix& C) {
+        om_assert(A.ncol()==B.nlin() && C.nlin()==A.nlin() && C.ncol()==B.ncol());
+        scale(beta,C);
+        const Dimension n = A.nlin();
+        if (n==0 || B.ncol()==0)
+            return;
+    #ifdef HAVE_BLAS
+        std::vector<double> panel(static_cast<size_t>(n)*std::min(panel_size,n));
+        const BLAS_INT N = sizet_to_int(n);
+        const BLAS_INT M = sizet_to_int(B.ncol());
+        for (Index first=0; first<n; first+=panel_size) {
+            const Dimension last = std::min(first+panel_size,n);
+            unpack_panel(A,first,last,panel.data());
+            const BLAS_INT L = sizet_to_int(last);
+            const BLAS_INT W = sizet_to_int(last-first);
+            DGEMM(CblasNoTrans,CblasNoTrans,L,M,W,alpha,panel.data(),L,B.data()+first,N,1.0,C.data(),N);
+            if (first>0)
+                DGEMM(CblasTrans,CblasNoTrans,W,M,sizet_to_int(first),alpha,panel.data(),L,B.data(),N,1.0,C.data()+first,N);
+        }
     #else
         for (Index j=0; j<B.ncol(); ++j)
-            for (Index i=0; i<nlin(); ++i) {
+            for (Index i=0; i<n; ++i) {
                 double sum = 0.0;
-                for (Index k=0; k<i; ++k) {
-                    C(k,j) += (*this)(i,k)*B(i,j);
-                    sum += (*this)(i,k)*B(k,j);
-                }
-                C(i,j) = (*this)(i,i)*B(i,j)+sum;
+                for (Index k=0; k<n; ++k)
+                    sum += A(i,k)*B(k,j);
+                C(i,j) += alpha*sum;
+            }
+    #endif
+    }
+
+    void symm(const double alpha,const Matrix& B,const SymMatrix& A,const double beta,Matrix& C) {
+        om_assert(B.ncol()==A.nlin() && C.nlin()==B.nlin() && C.ncol()==A.ncol());
+        scale(beta,C);
+        const Dimension n = A.nlin();
+        if (n==0 || B.nlin()==0)
+            return;
+    #ifdef HAVE_BLAS
+        std::vector<double> panel(static_cast<size_t>(n)*std::min(panel_size,n));
+        const BLAS_INT M = sizet_to_int(B.nlin());
+        for (Index first=0; first<n; first+=panel_size) {
+            const Dimension last = std::min(first+panel_size,n);
+            unpack_panel(A,first,last,panel.data());
+            const BLAS_INT L = sizet_to_int(last);
+            const BLAS_INT W = sizet_to_int(last-first);
+            DGEMM(CblasNoTrans,CblasTrans,M,L,W,alpha,B.data()+static_cast<size_t>(first)*M,M,panel.data(),L,1.0,C.data(),M);
+            if (first>0)
+                DGEMM(CblasNoTrans,CblasNoTrans,M,W,sizet_to_int(first),alpha,B.data(),M,panel.data(),L,1.0,C.data()+static_cast<size_t>(first)*M,M);
+        }
+    #else
+        for (Index j=0; j<n; ++j)
+            for (Index i=0; i<B.nlin(); ++i) {
+                double sum = 0.0;
+                for (Index k=0; k<n; ++k)
+                    sum += B(i,k)*A(k,j);
+                C(i,j) += alpha*sum;
             }
     #endif
+    }
+
+    Matrix SymMatrix::operator*(const SymMatrix& m) const {
+        om_assert(nlin()==m.nlin());
+        Matrix C(nlin(),nlin());
+        symm(1.0,*this,Matrix(m),0.0,C);
         return C;
     }
 
+    Matrix SymMatrix::operator*(const Matrix& B) const {
+        om_assert(ncol()==B.nlin());
+        Matrix C(nlin(),B.ncol());
+        symm(1.0,*this,B,0.0,C);
+        return C;
+    }
+
+    // The linear systems are solved and the inverses computed using a Bunch-Kaufman factorization in full storage
+    // (see bunch_kaufman.h).
+
+    // Returns the solution of (this)*X = B
+
+    Vector SymMatrix::solveLin(const Vector& B) const {
+        Vector X(B,DEEP_COPY);
+        BunchKaufman(*this).solve(X);
+        return X;
+    }
+
+    // Stores in B the solution of (this)*X = B, where B is a set of nbvect vectors.
+
+    void SymMatrix::solveLin(Vector* B,const int nbvect) {
+        Matrix RHS(nlin(),nbvect);
+        for (int i=0; i<nbvect; ++i)
+            RHS.setcol(i,B[i]);
+        BunchKaufman(*this).solve(RHS);
+        for (int i=0; i<nbvect; ++i) {
+            const Vector& X = RHS.getcol(i);
+            std::copy(X.data(),X.data()+X.size(),B[i].data());
+        }
+    }
+
     Matrix SymMatrix::solveLin(Matrix& RHS) const {
-    om_assert(nlin()==RHS.nlin());
-    #ifdef HAVE_LAPACK
-        SymMatrix A(*this,DEEP_COPY);
-        const BLAS_INT M = sizet_to_int(nlin());
-        const BLAS_INT N = sizet_to_int(RHS.ncol());
-        // LU
-        BLAS_INT* pivots = new BLAS_INT[nlin()];
-        int Info = 0;
-        DSPTRF('U',M,A.data(),pivots,Info);
-        // Solve the linear system AX=B
-        DSPTRS('U',M,N,A.data(),pivots,RHS.data(),M,Info);
-        om_assert(Info == 0);
+        om_assert(nlin()==RHS.nlin());
+        BunchKaufman(*this).solve(RHS);
         return RHS;
-    #else
-        throw OpenMEEG::maths::LinearAlgebraError("solveLin not defined without LAPACK: Try a GMres");
-    #endif
+    }
+
+    SymMatrix SymMatrix::inverse() const {
+        return BunchKaufman(*this).inverse();
+    }
+
+    //  The inverse is unpacked directly from the storage of the factors: the memory needed is that of the matrix plus
+    //  a full (N x N) matrix.
+
+    void SymMatrix::invert() {
+        BunchKaufman(*this).inverse(*this);
     }
 
     void SymMatrix::info() const {
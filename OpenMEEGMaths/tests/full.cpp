@@ -110,5 +110,22 @@ int main () {
         std::cerr << "Error: PseudoInverse is WRONG-2" << std::endl;
         exit(1);
     }
+    zero = M1.transpose().pinverse()-M1pinv.transpose();
+    if (zero.frobenius_norm()>eps) {
+        zero.info();
+        std::cerr << "Error: PseudoInverse is WRONG-3" << std::endl;
+        exit(1);
+    }
+
+    // Accumulated product
+
+    Matrix C(M1,DEEP_COPY);
+    gemm(2.0,M1,M1pinv*M1,-1.0,C);
+    zero = C-M1;
+    if (zero.frobenius_norm()>eps) {
+        zero.info();
+        std::cerr << "Error: gemm is WRONG" << std::endl;
+        exit(1);
+    }
     return 0;
 }
@@ -9,12 +9,21 @@
 
 #include <OpenMEEGMathsConfig.h>
 #include <sparse_matrix.h>
+#include <symmatrix.h>
 #include <fast_sparse_matrix.h>
 #include <generic_test.hpp>
 
-int main () {
+using namespace OpenMEEG;
+
+// Checks that the sparse matrix spM has the same dimensions and entries as the dense matrix M.
+
+bool same_entries(const SparseMatrix& spM,const Matrix& M) {
+    if (spM.nlin()!=M.nlin() || spM.ncol()!=M.ncol() || spM.row_offsets().size()!=M.nlin()+1)
+        return false;
+    return (Matrix(spM)-M).frobenius_norm()==0.0;
+}
 
-    using namespace OpenMEEG;
+int main () {
 
     // section SparseMatrix
 
@@ -47,15 +56,81 @@ int main () {
         spM2(n%10, p%10) = n;
     }
     Mzero += Matrix(spM*spM2) - Matrix(spM)*Matrix(spM2) - Matrix(spM2)*Matrix(spM) + Matrix(spM2*spM);
+    // Sym & Sparse (3 non zeros per line, as for the EEG sensors, with more columns than a block of the product)
+    SymMatrix S(600);
+    for (unsigned j=0;j<S.ncol();++j)
+        for (unsigned i=0;i<=j;++i)
+            S(i,j) = 1.0/(1.0+i+2*j);
+    SparseMatrix spM3(20,600);
+    for (unsigned i=0;i<20;++i)
+        for (unsigned k=0;k<3;++k)
+            spM3(i,(i*97+k*211)%600) = 0.5+k;
+    const double symerr = (spM3*S-Matrix(spM3)*Matrix(S)).frobenius_norm();
     // Vectt & Sparse
     Vector Vzero = (spM*v) - (Matrix(spM)*v);
-    if ( Mzero.frobenius_norm() + Vzero.norm() > eps) {
+    if ( Mzero.frobenius_norm() + Vzero.norm() + symerr > eps) {
         std::cerr << "Error: Operator* is WRONG-1" << std::endl;
         Mzero.info();
         Vzero.info();
         exit(1);
     }
 
+    // Triplets (duplicated entries are summed).
+
+    const SparseMatrix::Triplets triplets = { { 2, 3, 1.0 }, { 0, 1, 2.0 }, { 2, 3, 0.5 }, { 4, 0, -1.0 }, { 2, 1, 3.0 }, { 0, 1, 1.0 } };
+    const SparseMatrix spT(5,4,triplets);
+    Matrix T(5,4);
+    T.set(0.0);
+    T(0,1) = 3.0;
+    T(2,1) = 3.0;
+    T(2,3) = 1.5;
+    T(4,0) = -1.0;
+    if (!same_entries(spT,T) || spT.size()!=4) {
+        std::cerr << "Error: Triplet constructor is WRONG" << std::endl;
+        exit(1);
+    }
+
+    // Element-wise filling of a matrix which is already compressed (entries are both overwritten and added).
+
+    SparseMatrix spF(spT);
+    spF(2,3) = 4.0;
+    spF(1,2) = 5.0;
+    spF(4,3) = 6.0;
+    spF(0,0) = 7.0;
+    T(2,3) = 4.0;
+    T(1,2) = 5.0;
+    T(4,3) = 6.0;
+    T(0,0) = 7.0;
+    if (!same_entries(spF,T) || spF.size()!=7 || spF(1,2)!=5.0) {
+        std::cerr << "Error: Merge of pending entries is WRONG" << std::endl;
+        exit(1);
+    }
+    spF(3,3) = 8.0;
+    T(3,3) = 8.0;
+    if (spF(3,3)!=8.0 || !same_entries(spF,T)) {
+        std::cerr << "Error: Merge of pending entries is WRONG" << std::endl;
+        exit(1);
+    }
+
+    // Loading (the entries read are pending until the matrix is used).
+
+    for (const char* filename : { "tmp_sparse.txt", "tmp_sparse.bin" }) {
+        spF.save(filename);
+        SparseMatrix spL(filename);
+        if (!same_entries(spL,T)) {
+            std::cerr << "Error: Load of sparse matrix " << filename << " is WRONG" << std::endl;
+            exit(1);
+        }
+    }
+
+    // Sum (each operand is counted once, including for the entries common to both).
+
+    const SparseMatrix spS = spT+spF;
+    if (!same_entries(spS,Matrix(spT)+T) || !same_entries(spF+spF,T*2.0)) {
+        std::cerr << "Error: Operator+ is WRONG" << std::endl;
+        exit(1);
+    }
+
     std::cout << std::endl << "========== fast sparse matrices ==========" << std::endl;
     std::cout << spM;
     FastSparseMatrix fspM(spM);
@@ -32,5 +32,57 @@ int main() {
     std::cout << "Matrice R : " << std::endl;
     R.info();
 
+    // Inverse and linear systems of an indefinite matrix (Bunch-Kaufman factorization with 2x2 pivots).
+
+    const double eps = 1e-12;
+    SymMatrix T(5);
+    for (unsigned i=0; i<5; ++i)
+        for (unsigned j=i; j<5; ++j)
+            T(i,j) = (i==j) ? 0.0 : 1.0/(i+j+1.0);
+
+    const Matrix& unit = Matrix(T)*Matrix(T.inverse());
+    for (unsigned i=0; i<unit.nlin(); ++i)
+        for (unsigned j=0; j<unit.ncol(); ++j)
+            if (std::abs(unit(i,j)-((i==j) ? 1.0 : 0.0))>eps) {
+                std::cerr << "Error: inverse is WRONG " << "unit(" << i << "," << j << ") = " << unit(i,j) << std::endl;
+                exit(1);
+            }
+
+    Matrix B(5,3);
+    for (unsigned i=0; i<5; ++i)
+        for (unsigned j=0; j<3; ++j)
+            B(i,j) = i+2.0*j;
+    Matrix X(B,DEEP_COPY);
+    T.solveLin(X);
+    const Matrix& TX = T*X;
+    for (unsigned i=0; i<5; ++i)
+        for (unsigned j=0; j<3; ++j)
+            if (std::abs(TX(i,j)-B(i,j))>eps) {
+                std::cerr << "Error: solveLin is WRONG " << "(" << i << "," << j << ")" << std::endl;
+                exit(1);
+            }
+
+    // Products with a matrix larger than a panel of the blocked products.
+
+    SymMatrix P(300);
+    for (unsigned i=0; i<300; ++i)
+        for (unsigned j=i; j<300; ++j)
+            P(i,j) = 1.0/(1.0+i+2.0*j);
+    Matrix Q(300,7);
+    for (unsigned i=0; i<300; ++i)
+        for (unsigned j=0; j<7; ++j)
+            Q(i,j) = std::cos(i+3.0*j);
+    const Matrix& PQ = P*Q;
+    const Matrix& PP = P*P;
+    const Matrix& QP = Q.transpose()*P;
+    Matrix PQ2(PQ,DEEP_COPY);
+    symm(1.0,P,Q,-1.0,PQ2);
+    const double err = (PQ-Matrix(P)*Q).frobenius_norm()+(PP-Matrix(P)*Matrix(P)).frobenius_norm()+
+                       (QP-Q.transpose()*Matrix(P)).frobenius_norm()+PQ2.frobenius_norm();
+    if (err>eps) {
+        std::cerr << "Error: operator* is WRONG " << err << std::endl;
+        exit(1);
+    }
+
     return 0;
 }
@@ -29,6 +29,8 @@ int main(int argc, char** argv)
 
     const CommandLine cmd(argc,argv,"Compute various head matrices [options] geometry");
     const bool use_old_ordering = cmd.option("-old-ordering", false,"Using old ordering i.e using (V1, p1, V2, p2, V3) instead of (V1, V2, V3, p1, p2)");
+    const double hmatrix_tolerance = cmd.option("-hmatrix-tolerance",0.0,"Accuracy of the compression of far-field HeadMat blocks, to save memory (0 means no compression)");
+    const double far_field_ratio   = cmd.option("-far-field-ratio",0.0,"Triangle pairs further apart than this ratio times their size use a low order HeadMat quadrature (0 means never)");
 
     if (argc<2 || cmd.help_mode()) {
         help(argv[0]);
@@ -65,8 +67,47 @@ int main(int argc, char** argv)
         if (!geo.selfCheck()) // Check for intersecting meshes
             exit(1);
 
-        const SymMatrix& HM = HeadMat(geo);
-        HM.save(opt_parms[3]);
+        const Integrator integrator(3,0,0.005,far_field_ratio);
+        if (hmatrix_tolerance>0.0) {
+            const CompressedHeadMat HM(geo,HMatrixParameters(hmatrix_tolerance),integrator);
+            HM.save(opt_parms[3]);
+        } else {
+            const SymMatrix& HM = HeadMat(geo,integrator);
+            HM.save(opt_parms[3]);
+        }
+    }
+
+    const auto& HMCparms = { geomfileopt, condfileopt, "components file" };
+    if (char** opt_parms = cmd.option({ "-HeadMatComponents", "-HMC", "-hmc" },HMCparms)) {
+
+        assert_non_conflicting_options(argv[0],++num_options);
+
+        const Geometry geo(opt_parms[1],opt_parms[2],use_old_ordering);
+
+        if (!geo.selfCheck()) // Check for intersecting meshes
+            exit(1);
+
+        const HeadMatComponents components(geo,Integrator(3,0,0.005,far_field_ratio));
+        components.save(opt_parms[3]);
+    }
+
+    const auto& HMSparms = { geomfileopt, "components file", condfileopt, outputfileopt, "[conductivity file, output file]..." };
+    if (char** opt_parms = cmd.option({ "-HeadMatSweep", "-HMS", "-hms" },HMSparms)) {
+
+        assert_non_conflicting_options(argv[0],++num_options);
+
+        const unsigned num_args = cmd.num_args(opt_parms);
+        if (num_args%2!=0) {
+            std::cerr << "Option " << opt_parms[0] << " expects pairs of conductivity and output files." << std::endl;
+            exit(1);
+        }
+
+        const HeadMatComponents components(opt_parms[2]);
+        for (unsigned i=3; i<num_args; i+=2) {
+            const Geometry geo(opt_parms[1],opt_parms[i],use_old_ordering);
+            const SymMatrix& HM = HeadMat(geo,components);
+            HM.save(opt_parms[i+1]);
+        }
     }
 
     const auto& CMparms = { geomfileopt, condfileopt, "sensors file", "domain name", outputfileopt };
@@ -343,7 +384,30 @@ void help(const char* cmd_name) {
               << "             Arguments:" << std::endl
               << "               geometry file (.geom)" << std::endl
               << "               conductivity file (.cond)" << std::endl
-              << "               output matrix" << std::endl << std::endl;
+              << "               output matrix" << std::endl
+              << "             Option -hmatrix-tolerance tol approximates the far-field blocks between distinct meshes" << std::endl
+              << "             with hierarchical matrices at the relative accuracy tol. The matrix is then never formed:" << std::endl
+              << "             the output is a compressed operator (binary file), used by the adjoint methods of om_gain" << std::endl
+              << "             with an iterative solver (-solver gmres or minres). This only saves memory: the products" << std::endl
+              << "             with the operator are slower than with the dense matrix." << std::endl
+              << "             Option -far-field-ratio r integrates the triangle pairs further apart than r times" << std::endl
+              << "             their size with a 3 points rule." << std::endl << std::endl;
+
+    std::cout << "   -HeadMatComponents, -HMC, -hmc:   " << std::endl
+              << "       Compute the conductivity independent components of the Head Matrix (for conductivity sweeps, see -HeadMatSweep)." << std::endl
+              << "             Arguments:" << std::endl
+              << "               geometry file (.geom)" << std::endl
+              << "               conductivity file (.cond) (only the domains of null conductivity matter)" << std::endl
+              << "               output components file (binary file with the blocks of each pair of communicating meshes)" << std::endl << std::endl;
+
+    std::cout << "   -HeadMatSweep, -HMS, -hms:   " << std::endl
+              << "       Compute Head Matrices for several sets of conductivities from the components computed with -HeadMatComponents." << std::endl
+              << "             Arguments:" << std::endl
+              << "               geometry file (.geom)" << std::endl
+              << "               components file" << std::endl
+              << "               conductivity file (.cond)" << std::endl
+              << "               output matrix" << std::endl
+              << "               [other pairs of conductivity file and output matrix]" << std::endl << std::endl;
 
     std::cout << "   -CorticalMat, -CM, -cm:   " << std::endl
               << "       Compute Cortical Matrix for Symmetric BEM (left-hand side of linear system)." << std::endl
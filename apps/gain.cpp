@@ -5,6 +5,8 @@
 // - provide also LICENSE.txt and modify this header to refer to it.
 // - replace this header by the LICENSE.txt content.
 
+#include <map>
+
 #include <om_utils.h>
 #include <commandline.h>
 #include <gain.h>
@@ -20,10 +22,66 @@ error(const char* command,const bool unknown_option=false) {
     exit(1);
 }
 
+// Solver of the head system for the adjoint methods.
+
+SolverParameters
+solver_parameters(const std::string& method,const std::string& preconditioner,const double tolerance) {
+    const std::map<std::string,SolverParameters::Method> methods = {
+        { "direct", SolverParameters::DIRECT }, { "gmres", SolverParameters::GMRES }, { "minres", SolverParameters::MINRES }
+    };
+    const std::map<std::string,SolverParameters::Preconditioner> preconditioners = {
+        { "auto", SolverParameters::AUTO }, { "none", SolverParameters::NONE }, { "jacobi", SolverParameters::JACOBI },
+        { "block-jacobi", SolverParameters::BLOCK_JACOBI }, { "s-blocks", SolverParameters::S_BLOCKS }
+    };
+
+    const auto mit = methods.find(method);
+    const auto pit = preconditioners.find(preconditioner);
+    if (mit==methods.end() || pit==preconditioners.end()) {
+        std::cerr << "Error: unknown " << ((mit==methods.end()) ? "solver \"" : "preconditioner \"")
+                  << ((mit==methods.end()) ? method : preconditioner) << "\"." << std::endl;
+        exit(1);
+    }
+
+    //  The compatibility of the solver and the preconditioner is checked by linsolve.
+
+    return SolverParameters(mit->second,pit->second,tolerance);
+}
+
+// Calls compute with the product of the head to sensors matrix with the inverse of the head matrix, given either the
+// inverse or the factorization of the head matrix. This product is a Matrix or a TransposedMatrix (see linsolve) and
+// the head matrix is released before compute is called.
+
+template <typename SensorsMatrix,typename Function>
+void
+with_head_operator(const char* headmat_file,const char* head2sensors_file,const Function& compute) {
+    if (BunchKaufman::is_factorization_file(headmat_file)) {
+        const TransposedMatrix& HeadOperator = linsolve(BunchKaufman(headmat_file),SensorsMatrix(head2sensors_file));
+        compute(HeadOperator);
+    } else {
+        const Matrix& HeadOperator = SensorsMatrix(head2sensors_file)*SymMatrix(headmat_file);
+        compute(HeadOperator);
+    }
+}
+
+// The blockwise gain computation needs raw binary files for the source matrices and the gain.
+
+void
+check_blockwise_files(const std::initializer_list<const char*>& files) {
+    for (const char* file : files)
+        if (!ColumnBlocksReader::supported(file)) {
+            std::cerr << "Error: -memory requires raw binary (.bin) source matrices and gain (" << file << ")." << std::endl;
+            exit(1);
+        }
+}
+
 int
 main(int argc,char** argv) {
 
     const CommandLine cmd(argc,argv);
+    const std::string method         = cmd.option("-solver",std::string("direct"),"Solver of the head system for the adjoint methods (direct, gmres or minres)");
+    const std::string preconditioner = cmd.option("-preconditioner",std::string("auto"),"Preconditioner of the iterative solvers (auto, none, jacobi, block-jacobi or s-blocks). auto is block-jacobi for gmres and jacobi for minres");
+    const double      tolerance      = cmd.option("-tolerance",1e-8,"Relative residual at which the iterative solvers stop");
+    const double      memory         = cmd.option("-memory",0.0,"Memory budget (in MB) of the blockwise computation of the -EEG, -MEG, -IP and -EITIP gains");
 
     if (cmd.help_mode()) {
         help(argv[0]);
@@ -39,6 +97,9 @@ main(int argc,char** argv) {
     print_version(argv[0]);
     cmd.print();
 
+    const SolverParameters& solver = solver_parameters(method,preconditioner,tolerance);
+    const double memory_budget = memory*1024*1024;
+
     constexpr char geomfileopt[]       = "geometry file";
     constexpr char condfileopt[]       = "conductivity file";
     constexpr char outputfileopt[]     = "output file";
@@ -68,15 +129,20 @@ main(int argc,char** argv) {
 
         // EEG DATA
 
-        //  Split the 2 matrix multiplications in order to spare memory.
-        //  This is why we do not use GainEEG...
+        //  Split the 2 matrix multiplications in order to spare memory: the head matrix (inverse or factorization) is
+        //  released before the source matrix is loaded. This is why we do not use GainEEG...
+
+        if (memory_budget>0.0)
+            check_blockwise_files({ opt_parms[2], opt_parms[4] });
 
-        const SymMatrix    HeadMatInv(opt_parms[1]);
-        const SparseMatrix Head2EEGMat(opt_parms[3]);
-        const Matrix& tmp = Head2EEGMat*HeadMatInv;
-        const Matrix SourceMat(opt_parms[2]);
-        const Matrix& EEGGainMat = tmp*SourceMat;
-        EEGGainMat.save(opt_parms[4]);
+        with_head_operator<SparseMatrix>(opt_parms[1],opt_parms[3],[&](const auto& HeadOperator) {
+            if (memory_budget>0.0) {
+                blockwise_gain(HeadOperator,opt_parms[2],"",opt_parms[4],memory_budget);
+            } else {
+                const Matrix& EEGGainMat = HeadOperator*Matrix(opt_parms[2]);
+                EEGGainMat.save(opt_parms[4]);
+            }
+        });
     }
 
     const auto& EEGAdjointparms = {
@@ -91,10 +157,13 @@ main(int argc,char** argv) {
 
         Geometry geo(opt_parms[1],opt_parms[2]);
         const Matrix dipoles(opt_parms[3]);
-        const SymMatrix HeadMat(opt_parms[4]);
         const SparseMatrix Head2EEGMat(opt_parms[5]);
 
-        const GainEEGadjoint EEGGainMat(geo, dipoles, HeadMat, Head2EEGMat);
+        const GainEEGadjoint& EEGGainMat = (BunchKaufman::is_factorization_file(opt_parms[4])) ?
+            GainEEGadjoint(geo,dipoles,BunchKaufman(opt_parms[4]),Head2EEGMat) :
+            (CompressedHeadMat::is_compressed_file(opt_parms[4])) ?
+            GainEEGadjoint(geo,dipoles,CompressedHeadMat(opt_parms[4]),Head2EEGMat,solver) :
+            GainEEGadjoint(geo,dipoles,SymMatrix(opt_parms[4]),Head2EEGMat,solver);
         EEGGainMat.save(opt_parms[6]);
     }
 
@@ -108,17 +177,22 @@ main(int argc,char** argv) {
 
         // MEG DATA
 
-        //  We split the 3 matrix multiplications in order to spare memory.
+        //  We split the 3 matrix multiplications in order to spare memory: the head matrix is released before the
+        //  source matrix is loaded and the gain is accumulated in the Source2MEG matrix.
         //  This is also why we do not use GainMEG...
 
-        const SymMatrix HeadMatInv(opt_parms[1]);
-        const Matrix Head2MEGMat(opt_parms[3]);
-        const Matrix& tmp1 = Head2MEGMat*HeadMatInv;
-        const Matrix SourceMat(opt_parms[2]);
-        const Matrix& tmp2 = tmp1*SourceMat;
-        const Matrix Source2MEGMat(opt_parms[4]);
-        const Matrix MEGGainMat = Source2MEGMat+tmp2;
-        MEGGainMat.save(opt_parms[5]);
+        if (memory_budget>0.0)
+            check_blockwise_files({ opt_parms[2], opt_parms[4], opt_parms[5] });
+
+        with_head_operator<Matrix>(opt_parms[1],opt_parms[3],[&](const auto& HeadOperator) {
+            if (memory_budget>0.0) {
+                blockwise_gain(HeadOperator,opt_parms[2],opt_parms[4],opt_parms[5],memory_budget);
+            } else {
+                Matrix MEGGainMat(opt_parms[4]);
+                gemm(1.0,HeadOperator,Matrix(opt_parms[2]),1.0,MEGGainMat);
+                MEGGainMat.save(opt_parms[5]);
+            }
+        });
     }
 
     const auto& MEGAdjointparms = {
@@ -133,11 +207,14 @@ main(int argc,char** argv) {
 
         Geometry geo(opt_parms[1],opt_parms[2]);
         const Matrix dipoles(opt_parms[3]);
-        const SymMatrix HeadMat(opt_parms[4]);
         const Matrix Head2MEGMat(opt_parms[5]);
         const Matrix Source2MEGMat(opt_parms[6]);
 
-        const GainMEGadjoint MEGGainMat(geo, dipoles, HeadMat, Head2MEGMat, Source2MEGMat);
+        const GainMEGadjoint& MEGGainMat = (BunchKaufman::is_factorization_file(opt_parms[4])) ?
+            GainMEGadjoint(geo,dipoles,BunchKaufman(opt_parms[4]),Head2MEGMat,Source2MEGMat) :
+            (CompressedHeadMat::is_compressed_file(opt_parms[4])) ?
+            GainMEGadjoint(geo,dipoles,CompressedHeadMat(opt_parms[4]),Head2MEGMat,Source2MEGMat,solver) :
+            GainMEGadjoint(geo,dipoles,SymMatrix(opt_parms[4]),Head2MEGMat,Source2MEGMat,solver);
         MEGGainMat.save(opt_parms[7]);
     }
 
@@ -154,12 +231,15 @@ main(int argc,char** argv) {
 
         Geometry geo(opt_parms[1],opt_parms[2]);
         const Matrix dipoles(opt_parms[3]);
-        const SymMatrix HeadMat(opt_parms[4]);
         const SparseMatrix Head2EEGMat(opt_parms[5]);
         const Matrix Head2MEGMat(opt_parms[6]);
         const Matrix Source2MEGMat(opt_parms[7]);
 
-        const GainEEGMEGadjoint EEGMEGGainMat(geo,dipoles,HeadMat,Head2EEGMat,Head2MEGMat,Source2MEGMat);
+        const GainEEGMEGadjoint& EEGMEGGainMat = (BunchKaufman::is_factorization_file(opt_parms[4])) ?
+            GainEEGMEGadjoint(geo,dipoles,BunchKaufman(opt_parms[4]),Head2EEGMat,Head2MEGMat,Source2MEGMat) :
+            (CompressedHeadMat::is_compressed_file(opt_parms[4])) ?
+            GainEEGMEGadjoint(geo,dipoles,CompressedHeadMat(opt_parms[4]),Head2EEGMat,Head2MEGMat,Source2MEGMat,solver) :
+            GainEEGMEGadjoint(geo,dipoles,SymMatrix(opt_parms[4]),Head2EEGMat,Head2MEGMat,Source2MEGMat,solver);
         EEGMEGGainMat.saveEEG(opt_parms[8]);
         EEGMEGGainMat.saveMEG(opt_parms[9]);
     }
@@ -172,16 +252,18 @@ main(int argc,char** argv) {
 
         assert_non_conflicting_options(argv[0],++num_options);
 
-        const SymMatrix HeadMatInv(opt_parms[1]);
-        const Matrix Head2IPMat(opt_parms[3]);
-
-        const Matrix& tmp1 = Head2IPMat*HeadMatInv;
-        const Matrix SourceMat(opt_parms[2]);
-        const Matrix& tmp2 = tmp1*SourceMat;
-        const Matrix Source2IPMat(opt_parms[4]);
-
-        const Matrix& InternalPotGainMat = Source2IPMat+tmp2;
-        InternalPotGainMat.save(opt_parms[5]);
+        if (memory_budget>0.0)
+            check_blockwise_files({ opt_parms[2], opt_parms[4], opt_parms[5] });
+
+        with_head_operator<Matrix>(opt_parms[1],opt_parms[3],[&](const auto& HeadOperator) {
+            if (memory_budget>0.0) {
+                blockwise_gain(HeadOperator,opt_parms[2],opt_parms[4],opt_parms[5],memory_budget);
+            } else {
+                Matrix InternalPotGainMat(opt_parms[4]);
+                gemm(1.0,HeadOperator,Matrix(opt_parms[2]),1.0,InternalPotGainMat);
+                InternalPotGainMat.save(opt_parms[5]);
+            }
+        });
     }
 
     const auto& EITIPparms = {
@@ -192,13 +274,17 @@ main(int argc,char** argv) {
 
         assert_non_conflicting_options(argv[0],++num_options);
 
-        const SymMatrix HeadMatInv(opt_parms[1]);
-        const Matrix SourceMat(opt_parms[2]);
-        const Matrix Head2IPMat(opt_parms[3]);
-
-        const Matrix& InternalPotGainMat = (Head2IPMat*HeadMatInv)*SourceMat;
-
-        InternalPotGainMat.save(opt_parms[4]);
+        if (memory_budget>0.0)
+            check_blockwise_files({ opt_parms[2], opt_parms[4] });
+
+        with_head_operator<Matrix>(opt_parms[1],opt_parms[3],[&](const auto& HeadOperator) {
+            if (memory_budget>0.0) {
+                blockwise_gain(HeadOperator,opt_parms[2],"",opt_parms[4],memory_budget);
+            } else {
+                const Matrix& InternalPotGainMat = HeadOperator*Matrix(opt_parms[2]);
+                InternalPotGainMat.save(opt_parms[4]);
+            }
+        });
     }
 
     if (num_options==0) {
@@ -263,4 +349,15 @@ help(const char* cmd_name) {
               << "            dipoles positions and orientations" << std::endl
               << "            HeadMat, Head2EEGMat, Head2MEGMat, Source2MEGMat, EEGGainMatrix, MEGGainMatrix" << std::endl
               << "            bin Matrix" << std::endl << std::endl;
+
+    std::cout << "   HeadMatInv (resp. HeadMat for the adjoint methods) can be replaced by the factorization of HeadMat" << std::endl
+              << "   computed by om_minverser -factorize. All the gains of a head then share a single factorization." << std::endl << std::endl;
+
+    std::cout << "   With -memory size (in MB), the -EEG, -MEG, -IP and -EITIP gains are computed by blocks of sources" << std::endl
+              << "   fitting in this memory budget, so that SourceMat (and Source2MEGMat or Source2IPMat) need not fit in" << std::endl
+              << "   memory. These matrices and the gain must then be raw binary (.bin) files." << std::endl << std::endl;
+
+    std::cout << "   The adjoint methods solve the head system directly (factorization of HeadMat) by default. For large meshes," << std::endl
+              << "   use -solver gmres (or minres) with -preconditioner and -tolerance to solve it iteratively. HeadMat can" << std::endl
+              << "   then also be the compressed head matrix computed by om_assemble -HeadMat -hmatrix-tolerance." << std::endl << std::endl;
 }
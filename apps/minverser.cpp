@@ -10,6 +10,7 @@
 #include <matrix.h>
 #include <symmatrix.h>
 #include <vector.h>
+#include <bunch_kaufman.h>
 
 #include <commandline.h>
 #include <om_utils.h>
@@ -21,7 +22,11 @@ help(const char* cmd_name) {
     std::cout << cmd_name <<" [-option] [filepaths...]" << std::endl << std::endl
               << "   Inverse HeadMatrix " << std::endl
               << "   Filepaths are in order :" << std::endl
-              << "       HeadMat (bin), HeadMatInv (bin)" << std::endl << std::endl;
+              << "       HeadMat (bin), HeadMatInv (bin)" << std::endl << std::endl
+              << "   With -factorize, the factorization of HeadMat is stored instead of its inverse." << std::endl
+              << "   om_gain accepts this file in place of HeadMatInv or HeadMat." << std::endl << std::endl
+              << "   The factorization and the inversion use a full (N x N) copy of HeadMat: the memory needed is about" << std::endl
+              << "   three times the size of the HeadMat file." << std::endl << std::endl;
 
     exit(0);
 }
@@ -31,13 +36,19 @@ main(int argc,char* argv[]) try {
 
     print_version(argv[0]);
     const CommandLine cmd(argc,argv);
+    const bool factorize = cmd.option("-factorize",false,"Store the factorization of HeadMat instead of its inverse");
 
     if (cmd.help_mode()) {
         help(argv[0]);
         return 0;
     }
 
-    if (argc<3) {
+    std::vector<const char*> files;
+    for (int i=1; i<argc; ++i)
+        if (argv[i][0]!='-')
+            files.push_back(argv[i]);
+
+    if (files.size()<2) {
         std::cerr << "Not enough arguments." << std::endl;
         help(argv[0]);
         return 1;
@@ -51,9 +62,14 @@ main(int argc,char* argv[]) try {
 
     SymMatrix HeadMat;
 
-    HeadMat.load(argv[1]);
-    HeadMat.invert(); // invert inplace
-    HeadMat.save(argv[2]);
+    HeadMat.load(files[0]);
+    if (factorize) {
+        const BunchKaufman factorization(HeadMat);
+        factorization.save(files[1]);
+    } else {
+        HeadMat.invert(); // invert inplace
+        HeadMat.save(files[1]);
+    }
 
     // Stop Chrono
 
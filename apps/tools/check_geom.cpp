@@ -23,6 +23,7 @@ main(int argc,char* argv[]) {
     const std::string& mesh_filename = cmd.option("-m",std::string(),"Mesh file (ex: to test .geom with cortex mesh)");
     const std::string& dip_filename  = cmd.option("-d",std::string(),"The dipole .dip file (ex: to test .geom with cortical dipoles");
     const bool         verbose       = cmd.option("-v",false,        "Print verbose information about the geometry");
+    const bool         report_all    = cmd.option("-a",false,        "Report all the intersecting triangles (not only the first ones)");
 
     if (cmd.help_mode())
         return 0;
@@ -34,7 +35,7 @@ main(int argc,char* argv[]) {
 
     Geometry g(geom_filename);
 
-    if (!g.selfCheck())
+    if (!g.selfCheck(report_all))
         return 1;
 
     if (verbose) {
@@ -45,7 +46,7 @@ main(int argc,char* argv[]) {
     std::cout << ".geom : OK" << std::endl;
     if (mesh_filename!="") {
         Mesh m(mesh_filename);
-        if (!g.check(m))
+        if (!g.check(m,report_all))
             return 1;
         std::cout << ".geom and mesh : OK" << std::endl;
     }
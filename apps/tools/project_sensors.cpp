@@ -43,8 +43,9 @@ main(int argc,char* argv[]) {
 
     Matrix output(sensors.getNumberOfPositions(), 3);
 
-    const size_t nb_positions = sensors.getNumberOfPositions();
-    for (size_t i=0; i<nb_positions; ++i) {
+    const int nb_positions = sensors.getNumberOfPositions();
+    #pragma omp parallel for
+    for (int i=0; i<nb_positions; ++i) {
         const Vector position = sensors.getPosition(i);
         Vect3 current_position;
         for (unsigned k=0; k<3; ++k)
@@ -27,6 +27,21 @@ foreach (HEADNUM 1 2 ${HEAD3})
     OPENMEEG_COMPARISON_TEST(H2ECOGM-OLD-Head${HEADNUM} Head${HEADNUM}-old.ecog initialTest/${BASE_FILE_NAME} "-sparse")
 endforeach()
 
+# Verify that the gains computed from the factorization of the head matrix match those computed from its inverse.
+
+foreach (HEADNUM 1 2)
+    set(HEAD Head${HEADNUM})
+    OPENMEEG_COMPARISON_TEST(DipGainEEGfact-${HEAD} ${HEAD}-fact.dgem ${OpenMEEG_BINARY_DIR}/tests/${HEAD}.dgem -full DEPENDS DipGainEEG-${HEAD})
+    OPENMEEG_COMPARISON_TEST(DipGainEEGadjointfact-${HEAD} ${HEAD}-adjoint-fact.dgem ${OpenMEEG_BINARY_DIR}/tests/${HEAD}.dgem -full DEPENDS DipGainEEG-${HEAD})
+    OPENMEEG_COMPARISON_TEST(DipGainMEGfact-${HEAD} ${HEAD}-fact.dgmm ${OpenMEEG_BINARY_DIR}/tests/${HEAD}.dgmm -full DEPENDS DipGainMEG-${HEAD})
+    OPENMEEG_COMPARISON_TEST(DipGainInternalPotfact-${HEAD} ${HEAD}-fact.dgip ${OpenMEEG_BINARY_DIR}/tests/${HEAD}.dgip -full DEPENDS DipGainInternalPot-${HEAD})
+endforeach()
+
+# Verify that the gains computed by blocks of sources match those computed at once.
+
+OPENMEEG_COMPARISON_TEST(DipGainEEGblockwise-Head1 Head1-blockwise-dgem.bin ${OpenMEEG_BINARY_DIR}/tests/Head1.dgem -full DEPENDS DipGainEEG-Head1)
+OPENMEEG_COMPARISON_TEST(DipGainMEGblockwise-Head1 Head1-blockwise-dgmm.bin ${OpenMEEG_BINARY_DIR}/tests/Head1.dgmm -full DEPENDS DipGainMEG-Head1)
+
 #   TEST EEG RESULTS ON DIPOLES
 
 # defining variables for those who do not use VTK
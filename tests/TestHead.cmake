@@ -40,6 +40,7 @@ function(TESTHEAD HEADNUM)
     set(AREAS                  ${SUBJECT}.ai)
     set(HMMAT                  ${SUBJECT}.hm)
     set(HMINVMAT               ${SUBJECT}.hm_inv)
+    set(HMFACTMAT              ${SUBJECT}.hm_fact)
     set(SSMMAT                 ${SUBJECT}.ssm)
     set(CMMAT                  ${SUBJECT}.cm)
     set(ECOGMMAT               ${SUBJECT}.ecog)
@@ -71,6 +72,10 @@ function(TESTHEAD HEADNUM)
     set(DGMMADJOINT2MAT        ${SUBJECT}-adjoint2.dgmm)
     set(DGMMMAT-TANGENTIAL     ${SUBJECT}-tangential.dgmm)
     set(DGMMMAT-NORADIAL       ${SUBJECT}-noradial.dgmm)
+    set(DGEMFACTMAT            ${SUBJECT}-fact.dgem)
+    set(DGEMADJOINTFACTMAT     ${SUBJECT}-adjoint-fact.dgem)
+    set(DGMMFACTMAT            ${SUBJECT}-fact.dgmm)
+    set(DGIPFACTMAT            ${SUBJECT}-fact.dgip)
 
     set(ESTEEG                 ${SUBJECT}.est_eeg)
     set(ESTMEG                 ${SUBJECT}.est_meg)
@@ -187,6 +192,33 @@ function(TESTHEAD HEADNUM)
     OPENMEEG_TEST(DipGainInternalPot-${SUBJECT} ${GAIN} -IP ${HMINVMAT} ${DSMMAT} ${H2IPMAT} ${DS2IPMAT} ${DGIPMAT}
                   DEPENDS HMInv-${SUBJECT} DSM-${SUBJECT} H2IPM-${SUBJECT} S2IPM-${SUBJECT})
 
+    # Gains computed from the factorization of the head matrix (instead of its inverse).
+
+    if (${HEADNUM} EQUAL 1 OR ${HEADNUM} EQUAL 2)
+        OPENMEEG_TEST(HMFact-${SUBJECT} ${INVERSER} -factorize ${HMMAT} ${HMFACTMAT} DEPENDS HM-${SUBJECT})
+
+        OPENMEEG_TEST(DipGainEEGfact-${SUBJECT} ${GAIN} -EEG ${HMFACTMAT} ${DSMMAT} ${H2EMMAT} ${DGEMFACTMAT}
+                      DEPENDS HMFact-${SUBJECT} DSM-${SUBJECT} H2EM-${SUBJECT})
+        OPENMEEG_TEST(DipGainEEGadjointfact-${SUBJECT} ${GAIN} -EEGadjoint ${GEOM} ${COND} ${DIPPOS} ${HMFACTMAT} ${H2EMMAT} ${DGEMADJOINTFACTMAT}
+                      DEPENDS HMFact-${SUBJECT} H2EM-${SUBJECT})
+        OPENMEEG_TEST(DipGainMEGfact-${SUBJECT} ${GAIN} -MEG ${HMFACTMAT} ${DSMMAT} ${H2MMMAT} ${DS2MMMAT} ${DGMMFACTMAT}
+                      DEPENDS HMFact-${SUBJECT} DSM-${SUBJECT} H2MM-${SUBJECT} DS2MM-${SUBJECT})
+        OPENMEEG_TEST(DipGainInternalPotfact-${SUBJECT} ${GAIN} -IP ${HMFACTMAT} ${DSMMAT} ${H2IPMAT} ${DS2IPMAT} ${DGIPFACTMAT}
+                      DEPENDS HMFact-${SUBJECT} DSM-${SUBJECT} H2IPM-${SUBJECT} S2IPM-${SUBJECT})
+    endif()
+
+    # Gains computed by blocks of sources within a memory budget small enough to require several blocks.
+
+    if (${HEADNUM} EQUAL 1)
+        OPENMEEG_TEST(DSMbin-${SUBJECT} ${ASSEMBLE} -DSM ${GEOM} ${COND} ${DIPPOS} ${SUBJECT}-dsm.bin DEPENDS CLEAN-TESTS)
+        OPENMEEG_TEST(DS2MMbin-${SUBJECT} ${ASSEMBLE} -DS2MM ${DIPPOS} ${SQUIDS} ${SUBJECT}-ds2mm.bin DEPENDS CLEAN-TESTS)
+
+        OPENMEEG_TEST(DipGainEEGblockwise-${SUBJECT} ${GAIN} -memory 0.08 -EEG ${HMINVMAT} ${SUBJECT}-dsm.bin ${H2EMMAT} ${SUBJECT}-blockwise-dgem.bin
+                      DEPENDS HMInv-${SUBJECT} DSMbin-${SUBJECT} H2EM-${SUBJECT})
+        OPENMEEG_TEST(DipGainMEGblockwise-${SUBJECT} ${GAIN} -memory 0.4 -MEG ${HMFACTMAT} ${SUBJECT}-dsm.bin ${H2MMMAT} ${SUBJECT}-ds2mm.bin ${SUBJECT}-blockwise-dgmm.bin
+                      DEPENDS HMFact-${SUBJECT} DSMbin-${SUBJECT} H2MM-${SUBJECT} DS2MMbin-${SUBJECT})
+    endif()
+
     # forward gainmatrix.bin dipoleActivation.src estimatedeegdata.txt noiselevel
 
     OPENMEEG_TEST(EEG-dipoles-${SUBJECT} ${FORWARD} ${DGEMMAT} ${DIPSOURCES} ${ESTDIPBASE}.est_eeg 0.0
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <geometry.h>
+#include <analytics.h>
+
+using namespace OpenMEEG;
+
+// Compare the batched analytical kernels (analyticS::f, analyticD3::f and analyticSD::f) to their scalar (Vect3)
+// versions for each instruction set supported by the processor. The points are taken on all the triangles of the
+// meshes (as the quadrature points of the assembly), so that they are far from, close to or on the triangle of the
+// kernel. Their number is not a multiple of the vector widths, so the remainder loops are also checked.
+
+struct Points {
+
+    void add(const Vect3& p) {
+        x.push_back(p(0));
+        y.push_back(p(1));
+        z.push_back(p(2));
+    }
+
+    size_t size() const { return x.size(); }
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+};
+
+bool
+close(const double batched,const double scalar,const double scale) {
+    return std::abs(batched-scalar)<=1e-10*std::max(scale,std::abs(scalar));
+}
+
+unsigned
+check_kernels(const Triangle& triangle,const Points& points) {
+    const size_t npts = points.size();
+    std::vector<double> S(npts), D0(npts), D1(npts), D2(npts);
+    std::vector<double> SDS(npts), SD0(npts), SD1(npts), SD2(npts);
+
+    const analyticS  analyS(triangle);
+    const analyticD3 analyD(triangle);
+    const analyticSD analySD(triangle);
+    analyS.f(npts,points.x.data(),points.y.data(),points.z.data(),S.data());
+    analyD.f(npts,points.x.data(),points.y.data(),points.z.data(),D0.data(),D1.data(),D2.data());
+    analySD.f(npts,points.x.data(),points.y.data(),points.z.data(),SDS.data(),SD0.data(),SD1.data(),SD2.data());
+
+    //  The D kernels are proportional to the solid angle and thus bounded, while the S kernel scales with the size of
+    //  the triangle.
+
+    const double scaleS = std::sqrt(triangle.area());
+    const double scaleD = 1.0;
+
+    unsigned errors = 0;
+    for (size_t i=0; i<npts; ++i) {
+        const Vect3 p(points.x[i],points.y[i],points.z[i]);
+        const double s = analyS.f(p);
+        const Vect3& d = analyD.f(p);
+        if (!close(S[i],s,scaleS) || !close(SDS[i],s,scaleS) ||
+            !close(D0[i],d(0),scaleD) || !close(D1[i],d(1),scaleD) || !close(D2[i],d(2),scaleD) ||
+            !close(SD0[i],d(0),scaleD) || !close(SD1[i],d(1),scaleD) || !close(SD2[i],d(2),scaleD))
+        {
+            if (errors==0)
+                std::cerr << "Batched kernels differ from the scalar ones at point " << p << ": S " << S[i] << ' ' << SDS[i]
+                          << " vs " << s << ", D " << D0[i] << ' ' << D1[i] << ' ' << D2[i] << " vs " << d << std::endl;
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=3) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    const Geometry geo(argv[1],argv[2]);
+
+    //  Quadrature like points and points close to a vertex (the kernels are singular at the vertices of their triangle)
+    //  of all the triangles.
+
+    Points points;
+    for (const auto& mesh : geo.meshes())
+        for (const auto& triangle : mesh.triangles()) {
+            const Vect3& v0 = triangle.vertex(0);
+            const Vect3& v1 = triangle.vertex(1);
+            const Vect3& v2 = triangle.vertex(2);
+            points.add((v0+v1+v2)/3.0);
+            points.add((4.0*v0+v1+v2)/6.0);
+            points.add((v0+4.0*v1+v2)/6.0);
+            points.add((v0+v1+4.0*v2)/6.0);
+            points.add((98.0*v0+v1+v2)/100.0);
+        }
+    points.add(Vect3(0.0,0.0,0.0));
+
+    const InstructionSet best = instruction_set();
+    unsigned errors = 0;
+    for (const InstructionSet iset : { InstructionSet::Scalar, InstructionSet::AVX2, InstructionSet::AVX512 }) {
+        set_instruction_set(iset);
+        if (instruction_set()!=iset) {
+            std::cout << "Instruction set " << static_cast<int>(iset) << " is not supported: skipped." << std::endl;
+            continue;
+        }
+        unsigned iset_errors = 0;
+        for (const auto& mesh : geo.meshes())
+            for (const auto& triangle : mesh.triangles())
+                iset_errors += check_kernels(triangle,points);
+        std::cout << "Instruction set " << static_cast<int>(iset) << ": " << iset_errors << " errors on "
+                  << points.size() << " points." << std::endl;
+        errors += iset_errors;
+    }
+    set_instruction_set(best);
+
+    return (errors==0) ? 0 : 1;
+}
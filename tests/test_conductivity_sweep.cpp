@@ -0,0 +1,58 @@
+#include <iostream>
+#include <string>
+
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+// Compare the HeadMat obtained from the conductivity independent components with the one assembled directly,
+// for the conductivities of the file, for scaled ones and for ones with a different skull/scalp ratio.
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=3) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    Geometry geo(argv[1],argv[2]);
+
+    HeadMatComponents(geo).save("test_conductivity_sweep.hmc");
+    const HeadMatComponents components("test_conductivity_sweep.hmc");
+
+    const auto& check = [&](const std::string& description) {
+        const SymMatrix& direct   = HeadMat(geo);
+        const SymMatrix& combined = HeadMat(geo,components);
+
+        const double error = Matrix(direct-combined).frobenius_norm()/Matrix(direct).frobenius_norm();
+        std::cout << "Relative error of the combined HeadMat (" << description << "): " << error << std::endl;
+        if (error>1e-12) {
+            std::cerr << "Combined HeadMat differs from the assembled one." << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    for (const double scale : { 1.0, 0.5, 3.0 }) {
+        for (auto& domain : geo.domains())
+            if (domain.conductivity()!=0.0)
+                domain.set_conductivity(domain.conductivity()*scale);
+        if (!check("conductivities scaled by "+std::to_string(scale)))
+            return 1;
+    }
+
+    //  The skull/scalp ratio changes only the coefficients of the pairs of meshes bounding the skull.
+
+    for (const double ratio : { 1.0/25.0, 1.0/80.0 }) {
+        const double scalp = geo.domain("Scalp").conductivity();
+        for (auto& domain : geo.domains())
+            if (domain.name()=="Skull")
+                domain.set_conductivity(ratio*scalp);
+        if (!check("skull/scalp ratio "+std::to_string(ratio)))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+#include <geometry.h>
+#include <assemble.h>
+#include <operators.h>
+
+using namespace OpenMEEG;
+
+// Check the HeadMat blocks computed with a far field ratio: the batched kernels must give the same S and D* blocks as the
+// scalar integrator (low order rule for the far pairs of triangles, full rule for the others), and the HeadMat must be
+// close to the one computed without far field ratio.
+
+double
+elapsed(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+unsigned
+check_blocks(const Geometry& geo,const Mesh& mesh1,const Mesh& mesh2,const Integrator& integrator) {
+    const unsigned size = geo.nb_parameters()-geo.nb_current_barrier_triangles();
+    Matrix matrix(size,size);
+    matrix.set(0.0);
+    NonDiagonalBlock(mesh1,mesh2,integrator).set_SD_blocks(1.0,1.0,matrix);
+
+    unsigned errors  = 0;
+    unsigned nb_far  = 0;
+    unsigned nb_near = 0;
+    double   maxdiff = 0.0;
+    for (const auto& triangle1 : mesh1.triangles()) {
+        const analyticS  analyS(triangle1);
+        const analyticD3 analyD(triangle1);
+        const auto& Sfunc = [&analyS](const Vect3& r) { return analyS.f(r); };
+        const auto& Dfunc = [&analyD](const Vect3& r) { return analyD.f(r); };
+        for (const auto& triangle2 : mesh2.triangles()) {
+            ++((integrator.far_pair(triangle2,triangle1)) ? nb_far : nb_near);
+            const double S = integrator.integrate(Sfunc,triangle2,triangle1);
+            const Vect3& D = integrator.integrate(Dfunc,triangle2,triangle1);
+            maxdiff = std::max(maxdiff,std::abs(matrix(triangle1.index(),triangle2.index())-S)/std::abs(S));
+            if (std::abs(matrix(triangle1.index(),triangle2.index())-S)>1e-10*std::abs(S))
+                ++errors;
+
+            //  D* entries accumulate the contributions of all the triangles of mesh1 sharing a vertex: compare the sums.
+
+            for (unsigned i=0; i<3; ++i)
+                matrix(triangle2.index(),triangle1.vertex(i).index()) -= D(i);
+        }
+    }
+
+    double dmax = 0.0;
+    for (const auto& triangle2 : mesh2.triangles())
+        for (const auto& vertex : mesh1.vertices())
+            dmax = std::max(dmax,std::abs(matrix(triangle2.index(),vertex->index())));
+    if (dmax>1e-10)
+        ++errors;
+
+    std::cout << "Blocks " << mesh1.name() << " x " << mesh2.name() << ": " << nb_far << " far and " << nb_near
+              << " near pairs, max relative S difference " << maxdiff << ", max D* difference " << dmax << std::endl;
+    if (errors!=0)
+        std::cerr << "Batched blocks differ from the scalar integration." << std::endl;
+    return errors;
+}
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=4) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    const Geometry geo(argv[1],argv[2]);
+    const double ratio = atof(argv[3]);
+    const Integrator integrator(3,0,0.005,ratio);
+
+    unsigned errors = 0;
+    for (const auto& mp : geo.communicating_mesh_pairs())
+        if (&mp(0)!=&mp(1) && !mp(0).current_barrier() && !mp(1).current_barrier())
+            errors += check_blocks(geo,mp(0),mp(1),integrator);
+
+    auto start = std::chrono::steady_clock::now();
+    const SymMatrix& reference = HeadMat(geo);
+    const double reference_time = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    const SymMatrix& far_field = HeadMat(geo,integrator);
+    const double far_field_time = elapsed(start);
+
+    const double error = Matrix(reference-far_field).frobenius_norm()/Matrix(reference).frobenius_norm();
+    std::cout << "Relative error of the far field HeadMat: " << error << " (assembled in " << far_field_time
+              << "s instead of " << reference_time << "s)" << std::endl;
+    if (error>1e-3) {
+        std::cerr << "Far field HeadMat is not accurate enough." << std::endl;
+        ++errors;
+    }
+
+    return (errors==0) ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+
+#include <geometry.h>
+#include <assemble.h>
+#include <hmatrix.h>
+#include <gain.h>
+
+using namespace OpenMEEG;
+
+// Compare the products of the compressed head matrix (and of its saved copy) with those of the dense one, and the
+// solutions of the head system obtained with GMRES from the compressed head matrix to the direct ones.
+
+double
+relative_error(const Vector& v,const Vector& reference) {
+    return (v-reference).norm()/reference.norm();
+}
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=4) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    const Geometry geo(argv[1],argv[2]);
+    const double tolerance = atof(argv[3]);
+
+    const SymMatrix& dense = HeadMat(geo);
+    const CompressedHeadMat compressed(geo,HMatrixParameters(tolerance,2.0,8));
+    std::cout << "Compression ratio of the HeadMat: " << compressed.compression_ratio() << std::endl;
+
+    compressed.save("tmp_compressed_headmat.bin");
+    const CompressedHeadMat loaded("tmp_compressed_headmat.bin");
+
+    unsigned errors = 0;
+    if (!CompressedHeadMat::is_compressed_file("tmp_compressed_headmat.bin") || loaded.nlin()!=dense.nlin()) {
+        std::cerr << "Wrong saved compressed HeadMat." << std::endl;
+        ++errors;
+    }
+
+    //  Corrupted (truncated or overwritten) files must be rejected.
+
+    {
+        std::ifstream ifs("tmp_compressed_headmat.bin",std::ios::binary);
+        const std::string contents((std::istreambuf_iterator<char>(ifs)),std::istreambuf_iterator<char>());
+        for (unsigned k=0; k<20; ++k) {
+            std::string corrupted = contents.substr(0,(k%2==0) ? (k+1)*contents.size()/23 : contents.size());
+            if (k%2==1)
+                for (unsigned i=0; i<16; ++i)
+                    corrupted[(k*7919+i*104729)%corrupted.size()] ^= 0x5a;
+            std::ofstream("tmp_corrupted_headmat.bin",std::ios::binary) << corrupted;
+            try {
+                const CompressedHeadMat corrupted_matrix("tmp_corrupted_headmat.bin");
+                Vector x(corrupted_matrix.nlin());
+                x.set(1.0);
+                corrupted_matrix*x;
+                if (k%2==0) {
+                    std::cerr << "Truncated compressed HeadMat file not rejected." << std::endl;
+                    ++errors;
+                }
+            } catch (const IOException&) {
+            }
+        }
+    }
+
+    for (unsigned k=1; k<=3; ++k) {
+        Vector x(dense.nlin());
+        for (unsigned i=0; i<x.size(); ++i)
+            x(i) = sin(k*(i+1.0));
+        const Vector& y = dense*x;
+        const double error = relative_error(compressed*x,y);
+        std::cout << "Relative error of the compressed HeadMat product: " << error << std::endl;
+        //  The products of the saved copy only differ by the summation order of the concurrent blocks.
+
+        if (error>10*tolerance || relative_error(loaded*x,compressed*x)>1e-12) {
+            std::cerr << "Compressed HeadMat product is not accurate enough." << std::endl;
+            ++errors;
+        }
+    }
+
+    //  Entries of the blocks of a mesh with itself (used by the preconditioners) are exact.
+
+    double max_diff = 0.0;
+    for (const auto& block : preconditioner_blocks(geo,SolverParameters::BLOCK_JACOBI))
+        for (const unsigned i : block)
+            for (const unsigned j : block)
+                max_diff = std::max(max_diff,std::abs(compressed(i,j)-dense(i,j)));
+    if (max_diff>1e-10) {
+        std::cerr << "Wrong entries of the compressed HeadMat: " << max_diff << std::endl;
+        ++errors;
+    }
+
+    //  Solutions of the head system.
+
+    Matrix rhs(2,dense.nlin());
+    for (unsigned i=0; i<dense.nlin(); ++i) {
+        rhs(0,i) = cos(i+1.0);
+        rhs(1,i) = (i%7==0) ? 1.0 : 0.0;
+    }
+    const Matrix& direct    = Matrix(linsolve(dense,rhs));
+    const Matrix& iterative = Matrix(linsolve(compressed,rhs,geo,SolverParameters(SolverParameters::GMRES)));
+    const double solve_error = (direct-iterative).frobenius_norm()/direct.frobenius_norm();
+    std::cout << "Relative error of the head system solution with the compressed HeadMat: " << solve_error << std::endl;
+    if (solve_error>100*tolerance) {
+        std::cerr << "Head system solution with the compressed HeadMat is not accurate enough." << std::endl;
+        ++errors;
+    }
+
+    // Check the H-matrix vector product on a smooth kernel between two distant clouds of points.
+
+    const unsigned N = 200;
+    std::vector<BoundingBox> boxes1(N);
+    std::vector<BoundingBox> boxes2(N);
+    std::vector<Vect3> pts1(N);
+    std::vector<Vect3> pts2(N);
+    for (unsigned i=0; i<N; ++i) {
+        pts1[i] = Vect3(cos(i),sin(2.0*i),cos(3.0*i));
+        pts2[i] = Vect3(5.0+cos(5.0*i),sin(7.0*i),cos(11.0*i));
+        boxes1[i].add(Vertex(pts1[i]));
+        boxes2[i].add(Vertex(pts2[i]));
+    }
+
+    const auto& kernel = [&](const unsigned i,const unsigned j) { return 1.0/(pts1[i]-pts2[j]).norm(); };
+    const auto& entries = [&](const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) {
+        for (unsigned i=0; i<rows.size(); ++i)
+            for (unsigned j=0; j<cols.size(); ++j)
+                values(i,j) = kernel(rows[i],cols[j]);
+    };
+    const HMatrix H(ClusterTree(boxes1,16),ClusterTree(boxes2,16),entries,HMatrixParameters(tolerance));
+
+    Vector x(N);
+    for (unsigned j=0; j<N; ++j)
+        x(j) = sin(j);
+
+    Vector y(N);
+    Vector yt(N);
+    y.set(0.0);
+    yt.set(0.0);
+    for (unsigned i=0; i<N; ++i)
+        for (unsigned j=0; j<N; ++j) {
+            y(i)  += kernel(i,j)*x(j);
+            yt(j) += kernel(i,j)*x(i);
+        }
+
+    const double mv_error = std::max(relative_error(H*x,y),relative_error(H.tmult(x),yt));
+    std::cout << "Relative error of the H-matrix vector products: " << mv_error << " (compression ratio "
+              << H.compression_ratio() << ")" << std::endl;
+    if (mv_error>10*tolerance || H.compression_ratio()>=1.0)
+        ++errors;
+
+    return (errors==0) ? 0 : 1;
+}
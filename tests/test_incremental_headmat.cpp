@@ -0,0 +1,50 @@
+#include <iostream>
+#include <string>
+
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+// Compare the HeadMat reassembled incrementally from the one of a previous geometry with the one assembled directly,
+// for an unchanged geometry, after a conductivity change and after a change of the innermost mesh.
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=3) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    const Geometry old_geo(argv[1],argv[2]);
+    const SymMatrix& old_matrix = HeadMat(old_geo);
+
+    Geometry geo(argv[1],argv[2]);
+
+    const auto& check = [&](const std::string& test) {
+        const SymMatrix& direct      = HeadMat(geo);
+        const SymMatrix& incremental = HeadMat(geo,old_geo,old_matrix);
+        const double error = Matrix(direct-incremental).frobenius_norm()/Matrix(direct).frobenius_norm();
+        std::cout << "Relative error of the incrementally assembled HeadMat (" << test << "): " << error << std::endl;
+        return error<=1e-12;
+    };
+
+    if (!check("unchanged geometry"))
+        return 1;
+
+    Domain& domain = geo.domains().front();
+    domain.set_conductivity(2.0*domain.conductivity());
+    if (!check("conductivity change"))
+        return 1;
+    domain.set_conductivity(0.5*domain.conductivity());
+
+    Mesh& mesh = geo.meshes().front();
+    for (auto& vertex : mesh.vertices())
+        *vertex *= 0.95;
+    mesh.update(false);
+    if (!check("mesh change"))
+        return 1;
+
+    return 0;
+}
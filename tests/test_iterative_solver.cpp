@@ -0,0 +1,57 @@
+#include <iostream>
+#include <string>
+
+#include <geometry.h>
+#include <assemble.h>
+#include <gain.h>
+
+using namespace OpenMEEG;
+
+// Compare the solutions of the head system obtained with the iterative solvers (and their preconditioners) to the one
+// obtained with the direct solver, for a few right hand sides. The default preconditioner must be accepted by both
+// iterative solvers, while MINRES must reject the (non positive definite) block preconditioners.
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=3) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    const Geometry geo(argv[1],argv[2]);
+    const SymMatrix& H = HeadMat(geo);
+
+    Matrix S(5,H.nlin());
+    for (unsigned i=0; i<S.nlin(); ++i)
+        for (unsigned j=0; j<S.ncol(); ++j)
+            S(i,j) = std::cos(0.1*(i+1)*j+i);
+
+    const Matrix direct = linsolve(H,S).matrix_viewed();
+
+    const auto& check = [&](const std::string& test,const SolverParameters::Method method,const SolverParameters::Preconditioner preconditioner) {
+        const Matrix iterative = linsolve(H,S,geo,SolverParameters(method,preconditioner,1e-10)).matrix_viewed();
+        const double error = (direct-iterative).frobenius_norm()/direct.frobenius_norm();
+        std::cout << "Relative error of the iterative solution (" << test << "): " << error << std::endl;
+        return error<=1e-6;
+    };
+
+    if (!check("gmres, no preconditioner",SolverParameters::GMRES,SolverParameters::NONE) ||
+        !check("gmres, jacobi",SolverParameters::GMRES,SolverParameters::JACOBI) ||
+        !check("gmres, block jacobi",SolverParameters::GMRES,SolverParameters::BLOCK_JACOBI) ||
+        !check("gmres, S blocks",SolverParameters::GMRES,SolverParameters::S_BLOCKS) ||
+        !check("minres, no preconditioner",SolverParameters::MINRES,SolverParameters::NONE) ||
+        !check("minres, jacobi",SolverParameters::MINRES,SolverParameters::JACOBI) ||
+        !check("gmres, default preconditioner",SolverParameters::GMRES,SolverParameters::AUTO) ||
+        !check("minres, default preconditioner",SolverParameters::MINRES,SolverParameters::AUTO))
+        return 1;
+
+    try {
+        linsolve(H,S,geo,SolverParameters(SolverParameters::MINRES,SolverParameters::BLOCK_JACOBI));
+        std::cerr << "MINRES with a block Jacobi preconditioner should be rejected" << std::endl;
+        return 1;
+    } catch (const GenericError&) {
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <cmath>
+#include <limits>
+
+#include <geometry.h>
+#include <danielsson.h>
+#include <triangle_bvh.h>
+#include <constants.h>
+
+using namespace OpenMEEG;
+
+// Compare the closest triangles and the solid angles found with the bounding volume hierarchy of an interface to those
+// found by an exhaustive search, for points inside, on and outside the interface. The error of the solid angle must be
+// within its bound, and the points must be classified as with the exact solid angle. Check also the intersecting triangles
+// of a mesh and of a translated copy of it. The checks of the interfaces are repeated after the vertices have been
+// moved, to verify that the trees are rebuilt.
+
+unsigned
+check_interface(const Interface& interface) {
+    unsigned errors = 0;
+    for (unsigned i=0; i<200; ++i) {
+        const double theta = 0.37*i;
+        const double phi   = 0.11*i;
+        const double r     = 0.5+0.01*i;
+        const Vect3 p(r*std::cos(theta)*std::sin(phi),r*std::sin(theta)*std::sin(phi),r*std::cos(phi));
+
+        double          distmin = std::numeric_limits<double>::max();
+        const Triangle* nearest = nullptr;
+        for (const auto& omesh : interface.oriented_meshes())
+            for (const auto& triangle : omesh.mesh().triangles()) {
+                bool  inside;
+                Vect3 alphas;
+                const double distance = dist_point_triangle(p,triangle,alphas,inside);
+                if (distance<distmin) {
+                    distmin = distance;
+                    nearest = &triangle;
+                }
+            }
+
+        Vect3 alphas;
+        const auto& res = dist_point_interface(p,interface,alphas);
+        if (&std::get<1>(res)!=nearest || std::get<0>(res)!=distmin) {
+            std::cerr << "Wrong closest triangle of interface " << interface.name() << " for point " << p << std::endl;
+            ++errors;
+        }
+
+        double solangle = 0.0;
+        for (const auto& omesh : interface.oriented_meshes())
+            solangle += omesh.orientation()*omesh.mesh().solid_angle(p);
+        double error_bound;
+        const double estimate = interface.triangle_bvh().solid_angle(p,error_bound);
+        if (std::abs(estimate-solangle)>error_bound+1e-10 || error_bound>Pi/2) {
+            std::cerr << "Wrong solid angle of interface " << interface.name() << " for point " << p << ": " << estimate
+                      << " (error bound " << error_bound << ") instead of " << solangle << std::endl;
+            ++errors;
+        }
+        if (interface.contains(p)!=(solangle<-2*Pi)) {
+            std::cerr << "Wrong classification of point " << p << " for interface " << interface.name() << std::endl;
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+unsigned
+check_intersections(const Mesh& mesh) {
+    mesh.save("tmp_bvh.tri");
+    Mesh copy("tmp_bvh.tri");
+    for (const auto& vertex : copy.vertices())
+        *vertex = *vertex+Vect3(0.013,0.007,-0.011);
+    copy.update(false);
+
+    unsigned nb_self = 0;
+    const Triangles& triangles = mesh.triangles();
+    for (auto tit1=triangles.begin(); tit1!=triangles.end(); ++tit1)
+        for (auto tit2=tit1+1; tit2!=triangles.end(); ++tit2)
+            if (!tit1->contains(tit2->vertex(0)) && !tit1->contains(tit2->vertex(1)) && !tit1->contains(tit2->vertex(2)))
+                nb_self += tit1->intersects(*tit2);
+
+    unsigned nb = 0;
+    for (const auto& triangle1 : triangles)
+        for (const auto& triangle2 : copy.triangles())
+            nb += triangle1.intersects(triangle2);
+
+    unsigned errors = 0;
+    if (mesh.self_intersections().size()!=nb_self || mesh.intersections(copy).size()!=nb || nb==0 ||
+        mesh.intersections(copy,false).size()!=1) {
+        std::cerr << "Wrong intersecting triangles for mesh " << mesh.name() << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+int
+main(int argc,char** argv) {
+
+    if (argc!=3) {
+        std::cerr << "Wrong nb of parameters" << std::endl;
+        return 1;
+    }
+
+    Geometry geo(argv[1],argv[2]);
+
+    unsigned errors = 0;
+    for (const auto& domain : geo.domains())
+        for (const auto& boundary : domain.boundaries())
+            errors += check_interface(boundary.interface());
+
+    for (auto& vertex : geo.vertices())
+        vertex = 1.1*vertex;
+    for (auto& mesh : geo.meshes())
+        mesh.update(false);
+
+    for (const auto& domain : geo.domains())
+        for (const auto& boundary : domain.boundaries())
+            errors += check_interface(boundary.interface());
+
+    for (const auto& mesh : geo.meshes())
+        errors += check_intersections(mesh);
+
+    return (errors==0) ? 0 : 1;
+}